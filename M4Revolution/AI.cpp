@@ -1,76 +1,269 @@
 #include "pch.h"
 #include "AI.h"
-#include <regex>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 namespace AI {
 	static const Locale LOCALE("English", LC_NUMERIC);
 
+	const std::string TYPE_F32 = "f32";
+	const std::string TYPE_STRING = "string";
+
+	// for searching the index by key alone
+	struct IndexKeyLess {
+		bool operator()(const Index::value_type &indexValue, std::string_view key) const {
+			return indexValue.first < key;
+		}
+
+		bool operator()(std::string_view key, const Index::value_type &indexValue) const {
+			return key < indexValue.first;
+		}
+	};
+
 	Ubi::BigFile::File::Size findFileSize(Work::Edit &edit, const Ubi::BigFile::Path::Vector &pathVector) {
 		return Ubi::BigFile::findFile(edit.fileStream, pathVector)->size;
 	}
 
+	static bool isSpace(char ch) {
+		return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+	}
+
+	static std::string_view::size_type skipSpace(std::string_view line, std::string_view::size_type i) {
+		while (i < line.length() && isSpace(line[i])) {
+			i++;
+		}
+		return i;
+	}
+
+	static std::string_view::size_type skipToken(std::string_view line, std::string_view::size_type i, char end) {
+		while (i < line.length() && !isSpace(line[i]) && line[i] != end) {
+			i++;
+		}
+		return i;
+	}
+
+	// a line is: key ( type , value )
+	// with any amount of space around everything, except that only one space after the comma
+	// is not part of the value (so the value keeps whatever padding it had)
+	static bool getEntry(std::string_view line, std::string_view &key, Entry &entry) {
+		std::string_view::size_type i = skipSpace(line, 0);
+		std::string_view::size_type keyPosition = i;
+		i = skipToken(line, i, '(');
+
+		if (i == keyPosition) {
+			return false;
+		}
+
+		key = line.substr(keyPosition, i - keyPosition);
+		i = skipSpace(line, i);
+
+		if (i >= line.length() || line[i] != '(') {
+			return false;
+		}
+
+		i = skipSpace(line, i + 1);
+		std::string_view::size_type typePosition = i;
+		i = skipToken(line, i, ',');
+
+		if (i == typePosition) {
+			return false;
+		}
+
+		entry.type = line.substr(typePosition, i - typePosition);
+		i = skipSpace(line, i);
+
+		if (i >= line.length() || line[i] != ',') {
+			return false;
+		}
+
+		i++;
+
+		if (i < line.length() && isSpace(line[i])) {
+			i++;
+		}
+
+		// the value ends at the last bracket, which must only have space after it
+		std::string_view::size_type end = line.rfind(')');
+
+		if (end == std::string_view::npos || end < i || skipSpace(line, end + 1) != line.length()) {
+			return false;
+		}
+
+		entry.value = line.substr(i, end - i);
+
+		std::string_view::size_type width = entry.value.length();
+
+		while (width && isSpace(entry.value[width - 1])) {
+			width--;
+		}
+
+		entry.width = width;
+		return true;
+	}
+
+	void getIndex(std::string_view script, Index &index) {
+		index.clear();
+
+		// there can't be more entries than lines, so the index is only ever allocated once
+		index.reserve((Index::size_type)std::count(script.begin(), script.end(), '\n') + 1);
+
+		std::string_view::size_type position = 0;
+		std::string_view::size_type end = 0;
+
+		std::string_view key = {};
+		Entry entry = {};
+
+		// lines that aren't values (like comments) are skipped
+		while (position < script.length()) {
+			end = script.find('\n', position);
+
+			if (end == std::string_view::npos) {
+				end = script.length();
+			}
+
+			if (getEntry(script.substr(position, end - position), key, entry)) {
+				index.push_back({ key, entry });
+			}
+
+			position = end + 1;
+		}
+
+		// the values are views into the script, so where they are in it breaks ties between repeated keys
+		std::sort(index.begin(), index.end(), [](const Index::value_type &a, const Index::value_type &b) {
+			if (a.first != b.first) {
+				return a.first < b.first;
+			}
+			return a.second.value.data() < b.second.value.data();
+		});
+	}
+
+	IndexRange findRange(const Index &index, std::string_view key) {
+		return std::equal_range(index.begin(), index.end(), key, IndexKeyLess());
+	}
+
+	const Entry* findEntry(const Index &index, std::string_view key, std::string_view type) {
+		IndexRange range = findRange(index, key);
+
+		for (Index::const_iterator indexIterator = range.first; indexIterator != range.second; indexIterator++) {
+			if (indexIterator->second.type == type) {
+				return &indexIterator->second;
+			}
+		}
+		return nullptr;
+	}
+
+	// integer types are s or u, then the number of bits
+	static bool isIntegerType(std::string_view type, bool &isUnsigned) {
+		if (type.length() < 2) {
+			return false;
+		}
+
+		if (type[0] == 'u') {
+			isUnsigned = true;
+		} else if (type[0] == 's') {
+			isUnsigned = false;
+		} else {
+			return false;
+		}
+
+		for (std::string_view::size_type i = 1; i < type.length(); i++) {
+			if (type[i] < '0' || type[i] > '9') {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool isValueType(std::string_view type, const Value &value) {
+		if (std::holds_alternative<float>(value)) {
+			return type == TYPE_F32;
+		}
+
+		if (std::holds_alternative<long long>(value)) {
+			bool isUnsigned = false;
+
+			if (!isIntegerType(type, isUnsigned)) {
+				return false;
+			}
+			return !isUnsigned || std::get<long long>(value) >= 0;
+		}
+		return type == TYPE_STRING;
+	}
+
+	bool getCode(std::string_view script, std::streampos position, const Entry &entry, const Value &value, Work::Edit::Code &code) {
+		// otherwise, say, an integer could be written into an f32
+		if (!isValueType(entry.type, value)) {
+			return false;
+		}
+
+		// only apply the locale here (use default locale for the write to the console)
+		std::ostringstream fileOutputStringStream;
+		fileOutputStringStream.exceptions(std::ostringstream::badbit);
+		fileOutputStringStream.imbue(LOCALE);
+
+		// std::left is used to left align because otherwise we'll shift the value over
+		std::visit([&fileOutputStringStream, &entry](const auto &value) {
+			fileOutputStringStream << std::left << std::setw((std::streamsize)entry.width) << value;
+		}, value);
+
+		std::string str = fileOutputStringStream.str();
+
+		// ensure it is not too long and will not replace the end
+		if (str.length() > entry.value.length()) {
+			return false;
+		}
+
+		code.offset = position + (std::streamoff)(entry.value.data() - script.data());
+		code.str = str;
+		return true;
+	}
+
 	void editF32(
 		Work::Edit &edit,
 		const Ubi::BigFile::Path::Vector &pathVector,
 		const std::string &name,
 		const std::string &key,
 		float min,
-		float max
+		float max,
+		std::optional<float> f32Optional
 	) {
 		std::fstream &fileStream = edit.fileStream;
 
 		Ubi::BigFile::File::Size size = findFileSize(edit, pathVector);
 		std::streampos position = fileStream.tellg();
 
-		std::string ai = "";
-		copyStreamToString(fileStream, ai, size);
+		std::string script = "";
+		copyStreamToString(fileStream, script, size);
 
-		// find the line that the value is on
-		static const std::regex AI_LINE(R"(^(\s*([^\s\(]+)\s*\(\s*([^\s,]+)\s*,\s?)(.*)\)[^\S\n]*(?:\n|$))");
-		static const std::string TYPE_F32 = "f32";
+		Index index = {};
+		getIndex(script, index);
 
-		size_t f32Size = 0;
+		// find the line that the value is on
+		// (the script is null terminated, and the value always ends at a bracket, so it's safe to read it in place)
+		const Entry* entryPointer = nullptr;
 		float f32 = 0.0f;
-		std::smatch matches = {};
 
-		while (!f32Size
-			&& std::regex_search(ai, matches, AI_LINE)
-			&& matches.size() > 4) {
-			MAKE_SCOPE_EXIT(aiScopeExit) {
-				const std::string &matchLine = matches[0];
+		IndexRange range = findRange(index, key);
 
-				position += (std::streamoff)matches.prefix().length() + (std::streamoff)matchLine.length();
-				ai = matches.suffix();
-			};
+		for (Index::const_iterator indexIterator = range.first; indexIterator != range.second; indexIterator++) {
+			const Entry &entry = indexIterator->second;
 
-			const std::string &matchKey = matches[2];
-
-			if (matchKey != key) {
+			if (entry.type != TYPE_F32) {
 				continue;
 			}
 
-			const std::string &matchType = matches[3];
-
-			if (matchType != TYPE_F32) {
-				continue;
-			}
-
-			const std::string &valueStr = matches[4];
-
-			f32Size = stringToFloat(valueStr.c_str(), f32, LOCALE);
-
-			if (!f32Size) {
+			if (!stringToFloat(entry.value.data(), f32, LOCALE)) {
 				continue;
 			}
 
-			aiScopeExit.dismiss();
+			entryPointer = &entry;
+			break;
 		}
 
-		if (!f32Size) {
-			throw std::invalid_argument("f32Size must not be zero");
+		if (!entryPointer) {
+			throw std::invalid_argument("entryPointer must not be NULL");
 		}
 
 		if (f32 < min) {
@@ -89,28 +282,31 @@ namespace AI {
 		Work::Edit::outputCurrent(consoleOutputStringStream, name, f32);
 		consoleLog(consoleOutputStringStream.str().c_str());
 
-		// second stream so we get standard defaultfloat behaviour for the float
-		// that we write to the file (no precision weirdness)
-		// also, only apply the locale here
-		// (use default locale for the write to the console)
-		std::ostringstream fileOutputStringStream;
-		fileOutputStringStream.exceptions(std::ostringstream::badbit);
-		fileOutputStringStream.imbue(LOCALE);
+		Work::Edit::Code code = {};
 
-		const std::string &valueStr = matches[4];
+		// if we were given the value, there's nobody to ask for another one
+		// so it must be checked before the copy thread is started
+		if (f32Optional.has_value()) {
+			f32 = f32Optional.value();
 
-		// get the number from the user and pad it to replace the existing number
-		// ensure it is not too long and will not replace the end
-		std::string::size_type fileOutputStringLength = 0;
-		std::string::size_type fileOutputStringLengthMax = valueStr.length();
+			if (f32 < min || f32 > max) {
+				throw std::invalid_argument("f32Optional must be between min and max");
+			}
+
+			if (!getCode(script, position, *entryPointer, f32, code)) {
+				throw std::invalid_argument("f32Optional must not be longer than entry value");
+			}
+		}
 
 		// we've now found the position of the number to replace
 		// create a new thread to begin copying the file in the background
 		// while we ask the user to input the edited value
 		std::thread copyThread(Work::Edit::copyThread, std::ref(edit));
 
-		do {
-			if (fileOutputStringLength) {
+		bool fits = true;
+
+		while (!f32Optional.has_value()) {
+			if (!fits) {
 				consoleLog("The number is too long. Please enter a shorter number.");
 			}
 
@@ -119,23 +315,15 @@ namespace AI {
 			Work::Edit::outputNew(consoleOutputStringStream, name);
 			f32 = consoleFloat(consoleOutputStringStream.str().c_str(), min, max, LOCALE);
 
-			fileOutputStringStream.str("");
+			// get the number from the user and pad it to replace the existing number
+			fits = getCode(script, position, *entryPointer, f32, code);
 
-			// std::left is used to left align because otherwise we'll shift the number over
-			fileOutputStringStream << std::left << std::setw((std::streamsize)f32Size) << f32;
-			fileOutputStringLength = fileOutputStringStream.str().length();
-		} while (fileOutputStringLength > fileOutputStringLengthMax);
+			if (fits) {
+				break;
+			}
+		}
 
 		// tell the edit to the copy thread
-		const std::string &valueStrPrefix = matches[1];
-
-		edit.apply(copyThread,
-			
-		{
-			{
-				position + (std::streamoff)valueStrPrefix.length(),
-				fileOutputStringStream.str()
-			}
-		});
+		edit.apply(copyThread, { code });
 	}
 }
\ No newline at end of file
@@ -1,13 +1,48 @@
 #pragma once
 #include "Work.h"
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <utility>
 
 namespace AI {
+	// one value in a script, which is a line like: m_fadingTime ( f32 , 2.0 )
+	// these are views into the script, so the script must outlive them
+	struct Entry {
+		std::string_view type = {};
+
+		// everything between the comma and the closing bracket, which a new value must fit in
+		std::string_view value = {};
+
+		// how much of the value is the value, and not padding after it
+		std::string_view::size_type width = 0;
+	};
+
+	// sorted by key, so it's searched with equal_range
+	// keys may be repeated, in which case they are kept in the order they are in the script
+	using Index = std::vector<std::pair<std::string_view, Entry>>;
+	using IndexRange = std::pair<Index::const_iterator, Index::const_iterator>;
+
+	// a value must be one that the entry's type can hold:
+	// a float for f32, an integer for s8 to s64, a positive or zero integer for u8 to u64, and a string for string
+	using Value = std::variant<float, long long, std::string>;
+
+	extern const std::string TYPE_F32;
+	extern const std::string TYPE_STRING;
+
+	void getIndex(std::string_view script, Index &index);
+	IndexRange findRange(const Index &index, std::string_view key);
+	const Entry* findEntry(const Index &index, std::string_view key, std::string_view type);
+
+	bool getCode(std::string_view script, std::streampos position, const Entry &entry, const Value &value, Work::Edit::Code &code);
+
 	void editF32(
 		Work::Edit &edit,
 		const Ubi::BigFile::Path::Vector &pathVector,
 		const std::string &name,
 		const std::string &key,
 		float min,
-		float max
+		float max,
+		std::optional<float> f32Optional = std::nullopt
 	);
 };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "Hash.h"
+
+static constexpr Hash::Value PRIME_1 = 0x9E3779B185EBCA87ULL;
+static constexpr Hash::Value PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr Hash::Value PRIME_3 = 0x165667B19E3779F9ULL;
+static constexpr Hash::Value PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr Hash::Value PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+static inline Hash::Value rotateLeft(Hash::Value value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+// the hash is defined as little endian, and so are all the platforms we build for
+static inline Hash::Value read64(const unsigned char* pointer) {
+	Hash::Value value = 0;
+	memcpy(&value, pointer, sizeof(value));
+	return value;
+}
+
+static inline Hash::Value read32(const unsigned char* pointer) {
+	uint32_t value = 0;
+	memcpy(&value, pointer, sizeof(value));
+	return value;
+}
+
+static inline Hash::Value round(Hash::Value accumulator, Hash::Value input) {
+	accumulator += input * PRIME_2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * PRIME_1;
+}
+
+static inline Hash::Value mergeRound(Hash::Value accumulator, Hash::Value value) {
+	accumulator ^= round(0, value);
+	return accumulator * PRIME_1 + PRIME_4;
+}
+
+Hash::Value Hash::get(const void* pointer, size_t size, Value seed) {
+	Hash hash(seed);
+	hash.update(pointer, size);
+	return hash.get();
+}
+
+Hash::Hash(Value seed)
+	: seed(seed) {
+	accumulators[0] = seed + PRIME_1 + PRIME_2;
+	accumulators[1] = seed + PRIME_2;
+	accumulators[2] = seed;
+	accumulators[3] = seed - PRIME_1;
+}
+
+void Hash::update(const void* pointer, size_t size) {
+	if (!size) {
+		return;
+	}
+
+	if (!pointer) {
+		throw std::invalid_argument("pointer must not be NULL");
+	}
+
+	const unsigned char* bytePointer = (const unsigned char*)pointer;
+	this->size += size;
+
+	// finish off the stripe left over from last time first
+	if (stripeSize) {
+		size_t stripeCopySize = __min(STRIPE_SIZE - stripeSize, size);
+		memcpy(stripe + stripeSize, bytePointer, stripeCopySize);
+
+		stripeSize += stripeCopySize;
+		bytePointer += stripeCopySize;
+		size -= stripeCopySize;
+
+		if (stripeSize < STRIPE_SIZE) {
+			return;
+		}
+
+		for (size_t i = 0; i < 4; i++) {
+			accumulators[i] = round(accumulators[i], read64(stripe + (i * sizeof(Value))));
+		}
+
+		stripeSize = 0;
+	}
+
+	while (size >= STRIPE_SIZE) {
+		for (size_t i = 0; i < 4; i++) {
+			accumulators[i] = round(accumulators[i], read64(bytePointer + (i * sizeof(Value))));
+		}
+
+		bytePointer += STRIPE_SIZE;
+		size -= STRIPE_SIZE;
+	}
+
+	// keep the rest for next time
+	memcpy(stripe, bytePointer, size);
+	stripeSize = size;
+}
+
+Hash::Value Hash::get() const {
+	Value value = 0;
+
+	if (size >= STRIPE_SIZE) {
+		value = rotateLeft(accumulators[0], 1)
+			+ rotateLeft(accumulators[1], 7)
+			+ rotateLeft(accumulators[2], 12)
+			+ rotateLeft(accumulators[3], 18);
+
+		for (size_t i = 0; i < 4; i++) {
+			value = mergeRound(value, accumulators[i]);
+		}
+	} else {
+		value = seed + PRIME_5;
+	}
+
+	value += size;
+
+	const unsigned char* bytePointer = stripe;
+	size_t remainingSize = stripeSize;
+
+	while (remainingSize >= sizeof(Value)) {
+		value ^= round(0, read64(bytePointer));
+		value = rotateLeft(value, 27) * PRIME_1 + PRIME_4;
+
+		bytePointer += sizeof(Value);
+		remainingSize -= sizeof(Value);
+	}
+
+	if (remainingSize >= sizeof(uint32_t)) {
+		value ^= read32(bytePointer) * PRIME_1;
+		value = rotateLeft(value, 23) * PRIME_2 + PRIME_3;
+
+		bytePointer += sizeof(uint32_t);
+		remainingSize -= sizeof(uint32_t);
+	}
+
+	while (remainingSize) {
+		value ^= *bytePointer * PRIME_5;
+		value = rotateLeft(value, 11) * PRIME_1;
+
+		bytePointer++;
+		remainingSize--;
+	}
+
+	// avalanche
+	value ^= value >> 33;
+	value *= PRIME_2;
+	value ^= value >> 29;
+	value *= PRIME_3;
+	value ^= value >> 32;
+	return value;
+}
@@ -2,12 +2,18 @@
 #include "M4Revolution.h"
 #include "AI.h"
 #include "GlobalHandle.h"
+#include "Resample.h"
+#include "PortableExecutable.h"
+#include <M4Image.h>
 #include <filesystem>
 #include <iostream>
 #include <chrono>
 #include <sstream>
 #include <iomanip>
 #include <array>
+#include <regex>
+#include <tuple>
+#include <algorithm>
 
 #ifdef D3D9
 #include <wrl/client.h>
@@ -18,10 +24,6 @@
 #endif
 
 void M4Revolution::destroy() {
-	#ifdef MULTITHREADED
-	CloseThreadpool(pool);
-	#endif
-
 	// delete the temporary file when done
 	try {
 		std::filesystem::remove(Work::Output::FILE_NAME);
@@ -60,6 +62,29 @@ M4Revolution::Log::~Log() {
 	}
 }
 
+long long M4Revolution::Log::getMilliseconds(Work::Stalls::Clock::duration duration) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+// whichever stage the others spend the most time waiting on is the one to speed up
+void M4Revolution::Log::stalls(Work::ConvertChannel &convertChannel) {
+	// the converters each wait on their own, so theirs is added up across all of them
+	Work::Stalls stalls = convertChannel.getStalls();
+
+	std::cout << "Stalls for converting (in milliseconds)" << std::endl
+		<< "Reading, waiting on Converting: " << getMilliseconds(stalls.push) << std::endl
+		<< "Converting, waiting on Reading: " << getMilliseconds(stalls.pop) << std::endl << std::endl;
+}
+
+void M4Revolution::Log::stalls(const char* fileName, Work::Tasks &tasks) {
+	Work::Stalls stalls = tasks.fileChannel.getStalls();
+
+	std::cout << "Stalls for " << fileName << " (in milliseconds)" << std::endl
+		<< "Reading, waiting on Writing: " << getMilliseconds(stalls.push) << std::endl
+		<< "Writing, waiting on Reading: " << getMilliseconds(stalls.pop) << std::endl
+		<< "Writing, waiting on Converting: " << getMilliseconds(tasks.conversionStall) << std::endl << std::endl;
+}
+
 void M4Revolution::Log::step() {
 	files++;
 }
@@ -124,7 +149,7 @@ M4Revolution::CompressionOptions::CompressionOptions() {
 }
 
 const nvtt::CompressionOptions &M4Revolution::CompressionOptions::get(
-	const Ubi::BigFile::File &file, const nvtt::Surface &surface, bool hasAlpha
+	const Ubi::BigFile::File &file, int width, int height, int depth, bool hasAlpha
 ) const {
 	// immediately use RGBA if the file forces us to
 	if (file.rgba) {
@@ -135,10 +160,6 @@ const nvtt::CompressionOptions &M4Revolution::CompressionOptions::get(
 	// so if they are not, we must use RGBA instead
 	static constexpr int DEPTH_SQUARE = 1;
 
-	int width = surface.width();
-	int height = surface.height();
-	int depth = surface.depth();
-
 	if (width != height || depth != DEPTH_SQUARE) {
 		return rgba;
 	}
@@ -150,6 +171,12 @@ const nvtt::CompressionOptions &M4Revolution::CompressionOptions::get(
 	return hasAlpha ? dxt5 : dxt1;
 }
 
+const nvtt::CompressionOptions &M4Revolution::CompressionOptions::get(
+	const Ubi::BigFile::File &file, const nvtt::Surface &surface, bool hasAlpha
+) const {
+	return get(file, surface.width(), surface.height(), surface.depth(), hasAlpha);
+}
+
 M4Revolution::OutputHandler::OutputHandler(Work::FileTask &fileTask)
 	: fileTask(fileTask) {
 }
@@ -174,10 +201,9 @@ bool M4Revolution::OutputHandler::writeData(const void* data, int size) {
 			return false;
 		}
 
-		// this locks the FileTask for a single line
-		// when it unlocks, the output thread will wake up to write the data
+		// if the output stage is waiting on this FileTask, it will wake up to write the data
 		// then it will wait on more data again
-		fileTask.lock().get().emplace(size, pointer);
+		fileTask.push(Work::Data(size, pointer));
 
 		this->size += size;
 	} catch (...) {
@@ -191,20 +217,95 @@ void M4Revolution::ErrorHandler::error(nvtt::Error error) {
 	result = false;
 }
 
-void M4Revolution::waitFiles(Work::FileTask::PointerQueue::size_type fileTasks) {
-	// this function waits for the output thread to catch up
-	// if too many files are queued at once (to prevent running out of memory)
-	// this is only done on copying files so that it isn't run too often
-	if (fileTasks < maxFileTasks) {
-		return;
+std::filesystem::path M4Revolution::Profile::getPath(Number number) {
+	// like data.2.m4b, next to the original
+	std::filesystem::path path = Work::Output::DATA_PATH;
+	path.replace_extension(std::to_string(number) + Work::Output::DATA_PATH.extension().string());
+	return path;
+}
+
+M4Revolution::Profile::Profile(const Work::Convert::Configuration &configuration, const Ubi::BigFile::File &inputFile, Number number,
+	Work::FileTask::Channel::Size maxFileTasks)
+	: configuration(configuration),
+	tasks(maxFileTasks),
+	path(getPath(number)),
+	inputFilePointer(std::make_shared<Ubi::BigFile::File>(inputFile)) {
+	// must be an 8.3 filename, like the usual one
+	std::ostringstream outputFileNameStringStream;
+	outputFileNameStringStream << "~M4R" << number << ".tmp";
+	outputFileName = outputFileNameStringStream.str();
+
+	filePointerMap[&inputFile] = inputFilePointer;
+}
+
+void M4Revolution::Profile::mapFiles(const Ubi::BigFile::Directory &directory, const Ubi::BigFile::Directory &profileDirectory) {
+	// the profile's copy was read from the same filesystem, so everything is in the same place in both
+	mapFiles(directory.binaryFilePointerVector, profileDirectory.binaryFilePointerVector);
+	mapFiles(directory.filePointerVector, profileDirectory.filePointerVector);
+
+	const Ubi::BigFile::Directory::Vector &directoryVector = directory.directoryVector;
+	const Ubi::BigFile::Directory::Vector &profileDirectoryVector = profileDirectory.directoryVector;
+
+	if (directoryVector.size() != profileDirectoryVector.size()) {
+		throw std::logic_error("profileDirectoryVector must be the same size as directoryVector");
+	}
+
+	for (
+		auto directoryVectorIterator = directoryVector.begin(), profileDirectoryVectorIterator = profileDirectoryVector.begin();
+		directoryVectorIterator != directoryVector.end();
+		directoryVectorIterator++, profileDirectoryVectorIterator++
+	) {
+		mapFiles(*directoryVectorIterator, *profileDirectoryVectorIterator);
+	}
+}
+
+void M4Revolution::Profile::mapFiles(const Ubi::BigFile::File::PointerVector &filePointerVector, const Ubi::BigFile::File::PointerVector &profileFilePointerVector) {
+	if (filePointerVector.size() != profileFilePointerVector.size()) {
+		throw std::logic_error("profileFilePointerVector must be the same size as filePointerVector");
+	}
+
+	for (
+		auto filePointerVectorIterator = filePointerVector.begin(), profileFilePointerVectorIterator = profileFilePointerVector.begin();
+		filePointerVectorIterator != filePointerVector.end();
+		filePointerVectorIterator++, profileFilePointerVectorIterator++
+	) {
+		filePointerMap[filePointerVectorIterator->get()] = *profileFilePointerVectorIterator;
 	}
+}
+
+Ubi::BigFile::File::Pointer M4Revolution::Profile::getFilePointer(const Ubi::BigFile::File &file) const {
+	Ubi::BigFile::File::Pointer filePointer = filePointerMap.at(&file);
+
+	// these are only decided once the file is reached, so they're brought over then
+	// (this must be before the output stage can get to the file, because it may add to the padding)
+	filePointer->padding = file.padding;
+	filePointer->alignment = file.alignment;
+	return filePointer;
+}
+
+Ubi::BigFile::File::PointerVectorPointer M4Revolution::Profile::getFilePointerVectorPointer(const Ubi::BigFile::File::PointerVector &filePointerVector) const {
+	Ubi::BigFile::File::PointerVectorPointer profileFilePointerVectorPointer = std::make_shared<Ubi::BigFile::File::PointerVector>();
 
-	// this is just some moderately small amount of time
-	static constexpr std::chrono::milliseconds MILLISECONDS(25);
+	for (
+		auto filePointerVectorIterator = filePointerVector.begin();
+		filePointerVectorIterator != filePointerVector.end();
+		filePointerVectorIterator++
+	) {
+		profileFilePointerVectorPointer->push_back(getFilePointer(**filePointerVectorIterator));
+	}
+	return profileFilePointerVectorPointer;
+}
 
-	while (tasks.fileLock().get().size() >= maxFileTasks) {
-		std::this_thread::sleep_for(MILLISECONDS);
+void M4Revolution::pushFileTask(Work::Tasks &tasks, const Work::FileTask::Pointer &fileTaskPointer) {
+	// if too many files are queued at once, this waits for the output stage to catch up
+	// (to prevent running out of memory)
+	// but the output stage can't get past the files in a batch until it's converted
+	// so it must be submitted before we (might) wait on the output stage
+	if (tasks.fileChannel.full()) {
+		convertBatch();
 	}
+
+	tasks.fileChannel.push(fileTaskPointer);
 }
 
 void M4Revolution::copyFiles(
@@ -215,28 +316,50 @@ void M4Revolution::copyFiles(
 	const std::streampos &bigFileInputPosition,
 	Log &log
 ) {
-	inputStream.seekg(bigFileInputPosition + (std::streamoff)inputCopyOffset);
+	// the output stage can't get past the files in a batch until it's converted
+	// so it's submitted before the output stage gets stuck behind it
+	convertBatch();
 
-	Work::FileTask::PointerQueue::size_type fileTasks = 0;
+	inputStream.seekg(bigFileInputPosition + (std::streamoff)inputCopyOffset);
 
 	// note: this must get created even if filePointerVectorPointer is empty or the count to copy would be zero
-	// so that the bigFileInputPosition is reliably seen by the output thread
+	// so that the bigFileInputPosition is reliably seen by the output stage
 	Work::FileTask::Pointer fileTaskPointer =
 		std::make_shared<Work::FileTask>(bigFileInputPosition, filePointerVectorPointer);
 
-	// we grab files in this scope so we won't have to lock this twice unnecessarily
-	{
-		Work::FileTask::PointerQueueLock fileLock = tasks.fileLock();
-		Work::FileTask::PointerQueue &queue = fileLock.get();
-		queue.push(fileTaskPointer);
-		fileTasks = queue.size();
+	// the other profiles get the same files, which are read only once for all of them
+	Work::FileTask::PointerVector profileFileTaskPointerVector = {};
+
+	for (
+		auto profilePointerVectorIterator = profilePointerVector.begin();
+		profilePointerVectorIterator != profilePointerVector.end();
+		profilePointerVectorIterator++
+	) {
+		Profile &profile = **profilePointerVectorIterator;
+
+		Ubi::BigFile::File::PointerVectorPointer profileFilePointerVectorPointer =
+			profile.getFilePointerVectorPointer(*filePointerVectorPointer);
+
+		Work::FileTask::Pointer profileFileTaskPointer =
+			std::make_shared<Work::FileTask>(bigFileInputPosition, profileFilePointerVectorPointer);
+
+		pushFileTask(profile.tasks, profileFileTaskPointer);
+		profileFileTaskPointerVector.push_back(profileFileTaskPointer);
 	}
 
+	pushFileTask(tasks, fileTaskPointer);
+
 	Work::FileTask &fileTask = *fileTaskPointer;
-	fileTask.copy(inputStream, inputOffset - inputCopyOffset);
+	fileTask.copy(inputStream, inputOffset - inputCopyOffset, profileFileTaskPointerVector);
 	fileTask.complete();
 
-	waitFiles(fileTasks);
+	for (
+		auto profileFileTaskPointerVectorIterator = profileFileTaskPointerVector.begin();
+		profileFileTaskPointerVectorIterator != profileFileTaskPointerVector.end();
+		profileFileTaskPointerVectorIterator++
+	) {
+		(*profileFileTaskPointerVectorIterator)->complete();
+	}
 
 	filePointerVectorPointer = std::make_shared<Ubi::BigFile::File::PointerVector>();
 
@@ -249,11 +372,16 @@ void M4Revolution::convertFile(
 	Ubi::BigFile::File &file,
 	Work::Convert::FileWorkCallback fileWorkCallback
 ) {
-	Work::Convert &convert = *new Work::Convert(configuration, context, file);
+	// tiny images (like the slices cube faces are split into) spend more time on the overhead of
+	// being converted than actually being converted, so they are batched with the ones after them
+	static constexpr Ubi::BigFile::File::Size BATCH_FILE_SIZE_MAX = 0x8000;
+	static constexpr Ubi::BigFile::File::Size BATCH_SIZE_MAX = 0x40000;
+	static constexpr Work::ConvertBatch::ConvertPointerVector::size_type BATCH_FILES_MAX = 16;
 
-	MAKE_SCOPE_EXIT(convertScopeExit) {
-		delete &convert;
-	};
+	std::unique_ptr<Work::Convert> convertPointer = std::make_unique<Work::Convert>(configuration, context, file);
+	Work::Convert &convert = *convertPointer;
+
+	std::streamoff inputOffset = inputStream.tellg();
 
 	Work::Data::Pointer &dataPointer = convert.dataPointer;
 	dataPointer = makeSharedArray<unsigned char>(file.size);
@@ -261,24 +389,78 @@ void M4Revolution::convertFile(
 
 	Work::FileTask::Pointer &fileTaskPointer = convert.fileTaskPointer;
 	fileTaskPointer = std::make_shared<Work::FileTask>(ownerBigFileInputPosition, &file);
-	tasks.fileLock().get().push(fileTaskPointer);
+
+	if (deterministic || incremental) {
+		Work::Source &source = fileTaskPointer->sourceOptional.emplace();
+		source.offset = inputOffset;
+		source.size = file.size;
+		source.hash = Hash::get(dataPointer.get(), file.size);
+
+		if (cacheOptional.has_value()) {
+			Work::Cache &cache = cacheOptional.value();
+			const Work::Manifest::Entry* entryPointer = cache.find(source);
+
+			if (entryPointer) {
+				// this file hasn't changed since last time, so copy what it was converted to then
+				// (the size must be set before the output stage gets to it)
+				file.size = entryPointer->size;
+				pushFileTask(tasks, fileTaskPointer);
+
+				std::ifstream &cacheFileStream = cache.fileStream;
+				cacheFileStream.seekg(entryPointer->slot);
+
+				Work::FileTask &fileTask = *fileTaskPointer;
+				fileTask.copy(cacheFileStream, file.size);
+				fileTask.complete();
+
+				cache.reused++;
+				return;
+			}
+		}
+	}
+
+	// the file is converted for the other profiles along with this one, from the same decoded image
+	for (
+		auto profilePointerVectorIterator = profilePointerVector.begin();
+		profilePointerVectorIterator != profilePointerVector.end();
+		profilePointerVectorIterator++
+	) {
+		Profile &profile = **profilePointerVectorIterator;
+		Ubi::BigFile::File::Pointer profileFilePointer = profile.getFilePointer(file);
+
+		std::unique_ptr<Work::Convert> profileConvertPointer =
+			std::make_unique<Work::Convert>(profile.configuration, context, *profileFilePointer);
+
+		Work::FileTask::Pointer &profileFileTaskPointer = profileConvertPointer->fileTaskPointer;
+		profileFileTaskPointer = std::make_shared<Work::FileTask>(ownerBigFileInputPosition, profileFilePointer.get());
+		pushFileTask(profile.tasks, profileFileTaskPointer);
+
+		convert.profileConvertPointerVector.push_back(std::move(profileConvertPointer));
+	}
+
+	pushFileTask(tasks, fileTaskPointer);
 
 	convert.fileWorkCallback = fileWorkCallback;
 
-	#ifdef MULTITHREADED
-	PTP_WORK work = CreateThreadpoolWork(convertFileProc, &convert, NULL);
-	osErr(work);
+	if (file.size <= BATCH_FILE_SIZE_MAX) {
+		if (!convertBatchPointer) {
+			convertBatchPointer = std::make_unique<Work::ConvertBatch>();
+		}
 
-	convertScopeExit.dismiss();
+		Work::ConvertBatch::ConvertPointerVector &convertPointerVector = convertBatchPointer->convertPointerVector;
+		Ubi::BigFile::File::Size &size = convertBatchPointer->size;
 
-	SubmitThreadpoolWork(work);
-	CloseThreadpoolWork(work);
-	#endif
-	#ifdef SINGLETHREADED
-	convertScopeExit.dismiss();
+		convertPointerVector.push_back(std::move(convertPointer));
+		size += file.size;
 
-	convertFileWorkCallback(&convert);
-	#endif
+		if (size >= BATCH_SIZE_MAX || convertPointerVector.size() >= BATCH_FILES_MAX) {
+			convertBatch();
+		}
+		return;
+	}
+
+	// this waits if the converters are all busy and there are already enough files waiting for them
+	convertChannel.push(std::move(convertPointer));
 }
 
 void M4Revolution::convertFile(
@@ -289,9 +471,21 @@ void M4Revolution::convertFile(
 ) {
 	inputStream.seekg(bigFileInputPosition + (std::streamoff)file.offset);
 
+	// large images are read on their own, so they are worth putting on a boundary
+	// (this is before conversion, so it's the size of the input, but the output is only ever bigger)
+	if (
+		layout.alignImages
+		&& (file.type == Ubi::BigFile::File::Type::IMAGE_STANDARD || file.type == Ubi::BigFile::File::Type::IMAGE_ZAP)
+		&& file.size >= Work::Layout::ALIGNMENT_SIZE_MIN
+	) {
+		file.alignment = Work::Layout::ALIGNMENT;
+	}
+
 	// these conversion functions update the file sizes passed in
 	switch (file.type) {
 		case Ubi::BigFile::File::Type::BIG_FILE:
+		// batches only ever have files from the same BigFile
+		convertBatch();
 		fixLoading(inputStream, bigFileInputPosition, file, log);
 		break;
 		case Ubi::BigFile::File::Type::IMAGE_STANDARD:
@@ -302,17 +496,73 @@ void M4Revolution::convertFile(
 		break;
 		default:
 		// either a file we need to copy at the same position as ones we need to convert, or is a type not yet implemented
+		Work::FileTask::PointerVector profileFileTaskPointerVector = {};
+
+		for (
+			auto profilePointerVectorIterator = profilePointerVector.begin();
+			profilePointerVectorIterator != profilePointerVector.end();
+			profilePointerVectorIterator++
+		) {
+			Profile &profile = **profilePointerVectorIterator;
+
+			Work::FileTask::Pointer profileFileTaskPointer = std::make_shared<Work::FileTask>(
+				bigFileInputPosition, profile.getFilePointer(file).get());
+
+			pushFileTask(profile.tasks, profileFileTaskPointer);
+			profileFileTaskPointerVector.push_back(profileFileTaskPointer);
+		}
+
 		Work::FileTask::Pointer fileTaskPointer = std::make_shared<Work::FileTask>(bigFileInputPosition, &file);
-		tasks.fileLock().get().push(fileTaskPointer);
+		pushFileTask(tasks, fileTaskPointer);
 
 		Work::FileTask &fileTask = *fileTaskPointer;
-		fileTask.copy(inputStream, file.size);
+		fileTask.copy(inputStream, file.size, profileFileTaskPointerVector);
 		fileTask.complete();
+
+		for (
+			auto profileFileTaskPointerVectorIterator = profileFileTaskPointerVector.begin();
+			profileFileTaskPointerVectorIterator != profileFileTaskPointerVector.end();
+			profileFileTaskPointerVectorIterator++
+		) {
+			(*profileFileTaskPointerVectorIterator)->complete();
+		}
 	}
 
 	log.converting(file);
 }
 
+void M4Revolution::convertBatch() {
+	if (!convertBatchPointer) {
+		return;
+	}
+
+	convertChannel.push(std::move(convertBatchPointer));
+}
+
+void M4Revolution::loadCache() {
+	cacheOptional = std::nullopt;
+
+	// there won't be one the first time, which is fine
+	if (!std::filesystem::is_regular_file(Work::Manifest::PATH)
+		|| !std::filesystem::is_regular_file(Work::Cache::PATH)) {
+		return;
+	}
+
+	std::ifstream inputFileStream(Work::Manifest::PATH);
+
+	try {
+		cacheOptional.emplace(inputFileStream, configuration);
+		return;
+	} catch (const std::invalid_argument &ex) {
+		consoleLog(ex.what(), 2);
+	} catch (const std::runtime_error &ex) {
+		consoleLog(ex.what(), 2);
+	}
+
+	cacheOptional = std::nullopt;
+	consoleLog("The cache from the last time could not be used, so every file will be converted.", 2);
+}
+
 void M4Revolution::stepFile(
 	Ubi::BigFile::File::Size inputOffset,
 	Ubi::BigFile::File::Size &inputFileOffset,
@@ -326,6 +576,196 @@ void M4Revolution::stepFile(
 	log.step();
 }
 
+void M4Revolution::getLayoutPaths(const Ubi::BigFile::Directory &directory, std::string path) {
+	static constexpr char SEPERATOR = '/';
+
+	if (directory.nameOptional.has_value()) {
+		path += directory.nameOptional.value();
+		path += SEPERATOR;
+	}
+
+	const std::array<const Ubi::BigFile::File::PointerVector*, 2> FILE_POINTER_VECTOR_POINTERS = {
+		&directory.binaryFilePointerVector,
+		&directory.filePointerVector
+	};
+
+	for (
+		auto filePointerVectorPointersIterator = FILE_POINTER_VECTOR_POINTERS.begin();
+		filePointerVectorPointersIterator != FILE_POINTER_VECTOR_POINTERS.end();
+		filePointerVectorPointersIterator++
+	) {
+		const Ubi::BigFile::File::PointerVector &filePointerVector = **filePointerVectorPointersIterator;
+
+		for (
+			auto filePointerVectorIterator = filePointerVector.begin();
+			filePointerVectorIterator != filePointerVector.end();
+			filePointerVectorIterator++
+		) {
+			const Ubi::BigFile::File &file = **filePointerVectorIterator;
+
+			if (file.nameOptional.has_value()) {
+				layoutPathMap[&file] = path + file.nameOptional.value();
+			}
+		}
+	}
+
+	for (
+		auto directoryVectorIterator = directory.directoryVector.begin();
+		directoryVectorIterator != directory.directoryVector.end();
+		directoryVectorIterator++
+	) {
+		getLayoutPaths(*directoryVectorIterator, path);
+	}
+}
+
+Work::Layout::Rank M4Revolution::getLayoutRank(const Ubi::BigFile::File::PointerSet &filePointerSet) const {
+	// files that aren't in the trace go after all the ones that are
+	Work::Layout::Rank rank = SIZE_MAX;
+
+	for (
+		auto filePointerSetIterator = filePointerSet.begin();
+		filePointerSetIterator != filePointerSet.end();
+		filePointerSetIterator++
+	) {
+		LayoutPathMap::const_iterator layoutPathMapIterator = layoutPathMap.find(filePointerSetIterator->get());
+
+		if (layoutPathMapIterator == layoutPathMap.end()) {
+			continue;
+		}
+
+		Work::Layout::RankMap::const_iterator traceRankMapIterator = layout.traceRankMap.find(layoutPathMapIterator->second);
+
+		if (traceRankMapIterator != layout.traceRankMap.end()) {
+			rank = __min(rank, traceRankMapIterator->second);
+		}
+	}
+	return rank;
+}
+
+void M4Revolution::layOut(
+	const Ubi::BigFile::File &file,
+	const Ubi::BigFile::Directory &directory,
+	Ubi::BigFile::File::PointerSetMap &filePointerSetMap,
+	LayoutGroupVector &layoutGroupVector
+) {
+	layoutGroupVector.clear();
+	layoutGroupVector.reserve(filePointerSetMap.size());
+
+	// by default, the layout is the same as the input
+	for (
+		auto filePointerSetMapIterator = filePointerSetMap.begin();
+		filePointerSetMapIterator != filePointerSetMap.end();
+		filePointerSetMapIterator++
+	) {
+		layoutGroupVector.push_back(filePointerSetMapIterator);
+	}
+
+	if (!layout.isOrdered()) {
+		return;
+	}
+
+	// the paths in here are under the path of the BigFile itself
+	if (!layout.traceRankMap.empty()) {
+		static constexpr char SEPERATOR = '/';
+
+		LayoutPathMap::const_iterator layoutPathMapIterator = layoutPathMap.find(&file);
+
+		getLayoutPaths(
+			directory,
+
+			layoutPathMapIterator == layoutPathMap.end()
+			? ""
+			: layoutPathMapIterator->second + SEPERATOR
+		);
+	}
+
+	// everything is sorted by these, in this order
+	// cluster is the index of the first file in the same group (the same face, for slices)
+	// and the index breaks ties, so that files which aren't moved stay in the same order as the input
+	struct Key {
+		Work::Layout::Rank rank = 0;
+		LayoutGroupVector::size_type cluster = 0;
+		unsigned long row = 0;
+		unsigned long col = 0;
+		LayoutGroupVector::size_type index = 0;
+
+		bool operator<(const Key &key) const {
+			return std::tie(rank, cluster, row, col, index) < std::tie(key.rank, key.cluster, key.row, key.col, key.index);
+		}
+	};
+
+	using KeyVector = std::vector<Key>;
+	using FaceClusterMap = std::map<std::string, LayoutGroupVector::size_type, IgnoreCaseComparer>;
+
+	// slices are named like face_row_col (for example, back_01_02.dds)
+	// their masks have the same names, so they end up right next to them
+	static const std::regex FACE_SLICE(R"(^([a-z]+)_(\d{2})_(\d{2})\.)", std::regex::icase);
+
+	// since these have leading zeros, I use base 10 specifically
+	static constexpr int BASE = 10;
+
+	KeyVector keyVector = {};
+	keyVector.reserve(layoutGroupVector.size());
+
+	FaceClusterMap faceClusterMap = {};
+	std::smatch matches = {};
+
+	for (LayoutGroupVector::size_type i = 0; i < layoutGroupVector.size(); i++) {
+		const Ubi::BigFile::File::PointerSet &filePointerSet = layoutGroupVector[i]->second;
+
+		Key &key = keyVector.emplace_back();
+		key.rank = getLayoutRank(filePointerSet);
+		key.cluster = i;
+		key.index = i;
+
+		if (!layout.groupFaces) {
+			continue;
+		}
+
+		for (
+			auto filePointerSetIterator = filePointerSet.begin();
+			filePointerSetIterator != filePointerSet.end();
+			filePointerSetIterator++
+		) {
+			const std::optional<std::string> &nameOptional = (*filePointerSetIterator)->nameOptional;
+
+			if (!nameOptional.has_value()
+				|| !std::regex_search(nameOptional.value(), matches, FACE_SLICE)
+				|| matches.size() <= 3) {
+				continue;
+			}
+
+			unsigned long row = 0;
+			unsigned long col = 0;
+
+			if (!stringToLong(matches[2].str().c_str(), row, BASE)
+				|| !stringToLong(matches[3].str().c_str(), col, BASE)) {
+				continue;
+			}
+
+			key.cluster = faceClusterMap.try_emplace(matches[1].str(), i).first->second;
+			key.row = row;
+			key.col = col;
+			break;
+		}
+	}
+
+	std::sort(keyVector.begin(), keyVector.end());
+
+	LayoutGroupVector sortedLayoutGroupVector = {};
+	sortedLayoutGroupVector.reserve(keyVector.size());
+
+	for (
+		auto keyVectorIterator = keyVector.begin();
+		keyVectorIterator != keyVector.end();
+		keyVectorIterator++
+	) {
+		sortedLayoutGroupVector.push_back(layoutGroupVector[keyVectorIterator->index]);
+	}
+
+	layoutGroupVector = sortedLayoutGroupVector;
+}
+
 void M4Revolution::fixLoading(std::istream &inputStream,
 	const std::streampos &ownerBigFileInputPosition, Ubi::BigFile::File &file, Log &log) {
 	// filePointerSetMap is a map where the keys are the file offsets beginning to end
@@ -337,13 +777,49 @@ void M4Revolution::fixLoading(std::istream &inputStream,
 	// (because it's on our stack, but we're passing it to a shared_ptr)
 	// but it actually isn't because it's only used in the constructor
 	// (BigFileTask doesn't hold onto it)
-	tasks.bigFileLock().get()[bigFileInputPosition] = std::make_shared<Work::BigFileTask>(
+	Work::BigFileTask::Pointer bigFileTaskPointer = std::make_shared<Work::BigFileTask>(
 		inputStream,
 		ownerBigFileInputPosition,
 		file,
 		filePointerSetMap
 	);
 
+	tasks.bigFileLock().get()[bigFileInputPosition] = bigFileTaskPointer;
+
+	// each profile reads the same filesystem into its own copy of the BigFile
+	// then they all end up in the same place in the input
+	if (!profilePointerVector.empty()) {
+		std::streampos inputPosition = inputStream.tellg();
+		const Ubi::BigFile::Directory &directory = bigFileTaskPointer->getBigFilePointer()->directory;
+
+		for (
+			auto profilePointerVectorIterator = profilePointerVector.begin();
+			profilePointerVectorIterator != profilePointerVector.end();
+			profilePointerVectorIterator++
+		) {
+			Profile &profile = **profilePointerVectorIterator;
+			Ubi::BigFile::File::PointerSetMap profileFilePointerSetMap = {};
+
+			inputStream.seekg(bigFileInputPosition);
+
+			Work::BigFileTask::Pointer profileBigFileTaskPointer = std::make_shared<Work::BigFileTask>(
+				inputStream,
+				ownerBigFileInputPosition,
+				*profile.getFilePointer(file),
+				profileFilePointerSetMap
+			);
+
+			profile.tasks.bigFileLock().get()[bigFileInputPosition] = profileBigFileTaskPointer;
+			profile.mapFiles(directory, profileBigFileTaskPointer->getBigFilePointer()->directory);
+		}
+
+		inputStream.seekg(inputPosition);
+	}
+
+	// the files are output in the order of the layout (by default, the same as the input)
+	LayoutGroupVector layoutGroupVector = {};
+	layOut(file, bigFileTaskPointer->getBigFilePointer()->directory, filePointerSetMap, layoutGroupVector);
+
 	// inputCopyOffset is the offset of the files to copy
 	// inputFileOffset is the offset of a specific input file (for file.size calculation)
 	Ubi::BigFile::File::Size inputCopyOffset = (Ubi::BigFile::File::Size)(inputStream.tellg() - bigFileInputPosition);
@@ -352,17 +828,49 @@ void M4Revolution::fixLoading(std::istream &inputStream,
 	// convert keeps track of if we just converted any files within the inner, set loop
 	// (in which case, inputCopyOffset is advanced)
 	// countCopy is the count of the bytes to copy when copying files
-	// filePointerVectorPointer is to communicate file sizes/offsets to the output thread
+	// filePointerVectorPointer is to communicate file sizes/offsets to the output stage
 	bool convert = false;
 
 	Ubi::BigFile::File::PointerVectorPointer filePointerVectorPointer =
 		std::make_shared<Ubi::BigFile::File::PointerVector>();
 
+	// where the files before these in the layout are in the input
+	// and the files that come after them in the input (so we know if the layout moved them)
+	Ubi::BigFile::File::PointerSetMap::iterator nextFilePointerSetMapIterator = filePointerSetMap.begin();
+	Ubi::BigFile::File::Size previousOffset = 0;
+	Ubi::BigFile::File::Size previousSize = 0;
+
 	for (
-		auto filePointerSetMapIterator = filePointerSetMap.begin();
-		filePointerSetMapIterator != filePointerSetMap.end();
-		filePointerSetMapIterator++
+		auto layoutGroupVectorIterator = layoutGroupVector.begin();
+		layoutGroupVectorIterator != layoutGroupVector.end();
+		layoutGroupVectorIterator++
 	) {
+		Ubi::BigFile::File::PointerSetMap::iterator filePointerSetMapIterator = *layoutGroupVectorIterator;
+
+		// if the layout moved these files away from the ones before them in the input
+		// then the files we're copying end with the ones before them
+		// and start again from here (the padding is only the size of the last file, so this goes right after it)
+		if (!convert && filePointerSetMapIterator != nextFilePointerSetMapIterator) {
+			if (!filePointerVectorPointer->empty()) {
+				copyFiles(
+					inputStream,
+					previousOffset + previousSize,
+					inputCopyOffset,
+					filePointerVectorPointer,
+					bigFileInputPosition,
+					log
+				);
+			}
+
+			// (this may wrap around, but the padding is calculated by subtracting it, so that's fine)
+			inputCopyOffset = filePointerSetMapIterator->first;
+			inputFileOffset = inputCopyOffset - previousSize;
+		}
+
+		nextFilePointerSetMapIterator = std::next(filePointerSetMapIterator);
+		previousOffset = filePointerSetMapIterator->first;
+		previousSize = 0;
+
 		if (convert) {
 			inputCopyOffset = filePointerSetMapIterator->first;
 			inputFileOffset = inputCopyOffset;
@@ -378,6 +886,7 @@ void M4Revolution::fixLoading(std::istream &inputStream,
 			filePointerSetIterator++
 		) {
 			Ubi::BigFile::File &file = **filePointerSetIterator;
+			previousSize = __max(previousSize, file.size);
 
 			// if we encounter a file we need to convert for the first time, then first copy the files before it
 			if (
@@ -420,17 +929,57 @@ void M4Revolution::fixLoading(std::istream &inputStream,
 
 	// if we just converted a set of files then there are no remaining files to copy, but otherwise...
 	if (!convert) {
+		// copy to the end, unless the layout moved the last files in the input somewhere else
+		// (then whatever is after them has already been copied or was padding)
+		Ubi::BigFile::File::Size inputOffset = file.size;
+
+		if (nextFilePointerSetMapIterator != filePointerSetMap.end()) {
+			inputOffset = previousOffset + previousSize;
+		}
+
 		// always copy here even if filePointerVectorPointer is empty
 		// (ensure every BigFile has at least one FileTask)
 		copyFiles(
 			inputStream,
-			file.size,
+			inputOffset,
 			inputCopyOffset,
 			filePointerVectorPointer,
 			bigFileInputPosition,
 			log
 		);
 	}
+
+	// the end of the BigFile is the end of the batch
+	convertBatch();
+
+	// the files inside these have all been found, so their paths
+	// (and their copies in the other profiles) aren't needed anymore
+	if (!layout.traceRankMap.empty() || !profilePointerVector.empty()) {
+		for (
+			auto filePointerSetMapIterator = filePointerSetMap.begin();
+			filePointerSetMapIterator != filePointerSetMap.end();
+			filePointerSetMapIterator++
+		) {
+			const Ubi::BigFile::File::PointerSet &filePointerSet = filePointerSetMapIterator->second;
+
+			for (
+				auto filePointerSetIterator = filePointerSet.begin();
+				filePointerSetIterator != filePointerSet.end();
+				filePointerSetIterator++
+			) {
+				const Ubi::BigFile::File* filePointer = filePointerSetIterator->get();
+				layoutPathMap.erase(filePointer);
+
+				for (
+					auto profilePointerVectorIterator = profilePointerVector.begin();
+					profilePointerVectorIterator != profilePointerVector.end();
+					profilePointerVectorIterator++
+				) {
+					(*profilePointerVectorIterator)->filePointerMap.erase(filePointer);
+				}
+			}
+		}
+	}
 }
 
 const Ubi::BigFile::Path::Vector M4Revolution::TRANSITION_FADE_PATH_VECTOR = {
@@ -440,7 +989,7 @@ const Ubi::BigFile::Path::Vector M4Revolution::TRANSITION_FADE_PATH_VECTOR = {
 
 const M4Revolution::CompressionOptions M4Revolution::COMPRESSION_OPTIONS;
 
-void M4Revolution::toggleFullScreen(std::ifstream &inputFileStream) {
+void M4Revolution::toggleFullScreen(std::ifstream &inputFileStream, std::optional<bool> toggledOnOptional) {
 	static const std::string LINE_SECTION_BEGIN = "; Added by Myst IV: Revolution";
 	static const std::string LINE_SECTION_END = "; End of section";
 
@@ -449,7 +998,7 @@ void M4Revolution::toggleFullScreen(std::ifstream &inputFileStream) {
 	static constexpr char FULL_SCREEN_OFF[FULL_SCREEN_SIZE + 1] = "{graphic\n    full_screen     ( false )\n}\n";
 
 	// we assume if we don't find the section full screen is on by default
-	Work::Output output(false);
+	Work::Output output(Work::Output::FILE_NAME, false);
 	bool toggledOn = true;
 
 	// is_regular_file is used instead of is_open
@@ -506,7 +1055,7 @@ void M4Revolution::toggleFullScreen(std::ifstream &inputFileStream) {
 		Work::Backup::createEmpty(Work::Output::USER_PREFERENCE_PATH);
 	}
 
-	toggledOn = !toggledOn;
+	toggledOn = toggledOnOptional.value_or(!toggledOn);
 
 	// always write the section at the end
 	output.fileStream << LINE_SECTION_BEGIN << "\n";
@@ -516,7 +1065,7 @@ void M4Revolution::toggleFullScreen(std::ifstream &inputFileStream) {
 	toggleLog("Full Screen", toggledOn);
 }
 
-void M4Revolution::toggleCameraInertia(std::fstream &fileStream) {
+void M4Revolution::toggleCameraInertia(std::fstream &fileStream, std::optional<bool> toggledOnOptional) {
 	static constexpr size_t COMPUTE_MOVE_VECTOR_SIZE = 13;
 
 	static constexpr std::array<unsigned char, COMPUTE_MOVE_VECTOR_SIZE> COMPUTE_MOVE_VECTOR_ON = {
@@ -533,24 +1082,24 @@ void M4Revolution::toggleCameraInertia(std::fstream &fileStream) {
 		0x0C
 	};
 
-	// default value is the offset as of the latest Steam version
-	unsigned long computeMoveVectorOffset = 0x000109C0;
+	Work::Edit edit(fileStream, Work::Output::M4_THOR_PATH);
+
+	PortableExecutable::Offset computeMoveVectorOffset = 0;
 
-	#ifdef WINDOWS
-	while (!getDLLExportRVA(
-		"m4_thor_rd.dll",
-		"?ComputeMoveVector@COrientationUpdateManager@thor@@AAE?AVVector3@ubi@@M@Z",
-		computeMoveVectorOffset
-	)) {
-		RETRY_ERR(Work::Output::FILE_RETRY);
-	}
-	#endif
+	{
+		const PortableExecutable PORTABLE_EXECUTABLE(fileStream);
 
-	Work::Edit edit(fileStream, Work::Output::M4_THOR_PATH);
+		PortableExecutable::RVA computeMoveVectorRVA = 0;
 
-	#ifdef WINDOWS
-	computeMoveVectorOffset = getOffsetFromRVA(fileStream, computeMoveVectorOffset);
-	#endif
+		if (!PORTABLE_EXECUTABLE.getExportRVA(
+			"?ComputeMoveVector@COrientationUpdateManager@thor@@AAE?AVVector3@ubi@@M@Z",
+			computeMoveVectorRVA
+		)) {
+			throw Aborted("Compute Move Vector not found. Restoring the backup or reinstalling the game may fix this problem.");
+		}
+
+		computeMoveVectorOffset = PORTABLE_EXECUTABLE.getOffsetFromRVA(computeMoveVectorRVA);
+	}
 
 	fileStream.seekg(computeMoveVectorOffset);
 
@@ -574,7 +1123,7 @@ void M4Revolution::toggleCameraInertia(std::fstream &fileStream) {
 	std::thread copyThread(Work::Edit::copyThread, std::ref(edit));
 
 	// toggle happens here
-	toggledOn = !toggledOn;
+	toggledOn = toggledOnOptional.value_or(!toggledOn);
 
 	edit.apply(copyThread,
 		
@@ -597,11 +1146,11 @@ void M4Revolution::toggleCameraInertia(std::fstream &fileStream) {
 	toggleLog("Camera Inertia", toggledOn);
 }
 
-void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream) {
+void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream, std::optional<unsigned long> timeOptional) {
 	static const std::string Name = "Sound Fade Out Time";
 
-	static constexpr unsigned long MIN = 0;
-	static constexpr unsigned long MAX = 1000;
+	static constexpr unsigned long MIN = SOUND_FADE_OUT_TIME_MIN;
+	static constexpr unsigned long MAX = SOUND_FADE_OUT_TIME_MAX;
 
 	static constexpr unsigned char FADE_OUT_SOUND = 0x68;
 	static constexpr size_t FADE_OUT_SOUND_SIZE = sizeof(FADE_OUT_SOUND);
@@ -612,23 +1161,24 @@ void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream) {
 		0x8B, 0xCE, 0xFF, 0x15
 	};
 
-	unsigned long fadeOutSoundOffset = 0x00010720;
-
-	#ifdef WINDOWS
-	while (!getDLLExportRVA(
-		"m4_ai_global_rd.dll",
-		"?FadeOutSound@AiSndTransition@ai@@AAEXKKK@Z",
-		fadeOutSoundOffset
-	)) {
-		RETRY_ERR(Work::Output::FILE_RETRY);
-	}
-	#endif
-
 	Work::Edit edit(fileStream, Work::Output::M4_AI_GLOBAL_PATH);
 
-	#ifdef WINDOWS
-	fadeOutSoundOffset = getOffsetFromRVA(fileStream, fadeOutSoundOffset);
-	#endif
+	PortableExecutable::Offset fadeOutSoundOffset = 0;
+
+	{
+		const PortableExecutable PORTABLE_EXECUTABLE(fileStream);
+
+		PortableExecutable::RVA fadeOutSoundRVA = 0;
+
+		if (!PORTABLE_EXECUTABLE.getExportRVA(
+			"?FadeOutSound@AiSndTransition@ai@@AAEXKKK@Z",
+			fadeOutSoundRVA
+		)) {
+			throw Aborted("Fade Out Sound not found. Restoring the backup or reinstalling the game may fix this problem.");
+		}
+
+		fadeOutSoundOffset = PORTABLE_EXECUTABLE.getOffsetFromRVA(fadeOutSoundRVA);
+	}
 
 	static constexpr unsigned long FADE_OUT_SOUND_OFFSET = 0x0000005E;
 
@@ -638,7 +1188,8 @@ void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream) {
 	unsigned char fadeOutSound = 0;
 	readStream(fileStream, &fadeOutSound, FADE_OUT_SOUND_SIZE);
 
-	unsigned long time = 0;
+	// this is a DWORD in the game, so it must not be an unsigned long, which is 64-bit on other platforms
+	uint32_t time = 0;
 	readStream(fileStream, &time, sizeof(time));
 
 	std::array<unsigned char, FADE_OUT_SOUND2_SIZE> fadeOutSound2 = {};
@@ -659,10 +1210,14 @@ void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream) {
 
 	std::thread copyThread(Work::Edit::copyThread, std::ref(edit));
 
-	outputStringStream.str("");
-	Work::Edit::outputNew(outputStringStream, Name);
+	if (timeOptional.has_value()) {
+		time = (uint32_t)timeOptional.value();
+	} else {
+		outputStringStream.str("");
+		Work::Edit::outputNew(outputStringStream, Name);
 
-	time = consoleLongUnsigned(outputStringStream.str().c_str(), MIN, MAX);
+		time = (uint32_t)consoleLongUnsigned(outputStringStream.str().c_str(), MIN, MAX);
+	}
 
 	edit.apply(copyThread,
 	
@@ -688,10 +1243,10 @@ void M4Revolution::editSoundFadeOutTime(std::fstream &fileStream) {
 	});
 }
 
-void M4Revolution::editTransitionTime(std::fstream &fileStream) {
-	Work::Edit edit(fileStream, Work::Output::DATA_PATH);
+void M4Revolution::editTransitionTime(std::fstream &fileStream, const std::filesystem::path &path, std::optional<float> timeOptional, bool backup) {
+	Work::Edit edit(fileStream, path, backup);
 
-	AI::editF32(edit, TRANSITION_FADE_PATH_VECTOR, "Transition Time", "m_fadingTime", 0.0f, 500.0f);
+	AI::editF32(edit, TRANSITION_FADE_PATH_VECTOR, "Transition Time", "m_fadingTime", TRANSITION_TIME_MIN, TRANSITION_TIME_MAX, timeOptional);
 }
 
 #ifdef WINDOWS
@@ -722,9 +1277,70 @@ Ubi::BigFile::File M4Revolution::createInputFile(std::istream &inputStream) {
 	return inputFile;
 }
 
-void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface, bool hasAlpha) {
-	const Work::Convert::Configuration &configuration = convert.configuration;
+Work::Convert::Extent M4Revolution::getMaxExtent(const Work::Convert::Configuration &configuration, int width, int height, int depth) {
+	Work::Convert::Extent maxExtent = clamp((Work::Convert::Extent)width, configuration.minTextureWidth, configuration.maxTextureWidth);
+	maxExtent = __max(clamp((Work::Convert::Extent)height, configuration.minTextureHeight, configuration.maxTextureHeight), maxExtent);
+	return __max(clamp((Work::Convert::Extent)depth, configuration.minVolumeExtent, configuration.maxVolumeExtent), maxExtent);
+}
+
+#ifdef RESAMPLE_ENABLED
+bool M4Revolution::getResizeExtent(Work::Convert::Extent maxExtent, int &width, int &height) {
+	// this matches what nvtt does for RoundMode_None: only ever shrink, keeping the aspect ratio
+	Work::Convert::Extent extent = (Work::Convert::Extent)__max(width, height);
+
+	if (extent <= maxExtent) {
+		return false;
+	}
+
+	width = __max((int)(((size_t)width * maxExtent) / extent), 1);
+	height = __max((int)(((size_t)height * maxExtent) / extent), 1);
+	return true;
+}
+
+void M4Revolution::resizeSurface(nvtt::Surface &surface, Work::Convert::Extent maxExtent) {
+	static constexpr int CHANNELS = 4;
+	static constexpr int DEPTH = 1;
+
+	int width = surface.width();
+	int height = surface.height();
+	int resizeWidth = width;
+	int resizeHeight = height;
+
+	if (!getResizeExtent(maxExtent, resizeWidth, resizeHeight)) {
+		return;
+	}
+
+	// the surface is stored as one plane of floats per channel, which are each resized on their own
+	const size_t RESIZE_CHANNEL_SIZE = (size_t)resizeWidth * (size_t)resizeHeight;
 
+	std::unique_ptr<float[]> resizePointer = makeUniqueArray<float>(RESIZE_CHANNEL_SIZE * CHANNELS);
+
+	// const, so that getting the channels doesn't make a copy of the surface
+	const nvtt::Surface &constSurface = surface;
+
+	for (int i = 0; i < CHANNELS; i++) {
+		Resample::resize(
+			constSurface.channel(i), width, height, width * sizeof(float),
+			resizePointer.get() + RESIZE_CHANNEL_SIZE * i, resizeWidth, resizeHeight, resizeWidth * sizeof(float)
+		);
+	}
+
+	float* resizeChannelPointer = resizePointer.get();
+
+	if (!surface.setImage(
+		nvtt::InputFormat_RGBA_32F,
+		resizeWidth, resizeHeight, DEPTH,
+		resizeChannelPointer,
+		resizeChannelPointer + RESIZE_CHANNEL_SIZE,
+		resizeChannelPointer + RESIZE_CHANNEL_SIZE * 2,
+		resizeChannelPointer + RESIZE_CHANNEL_SIZE * 3
+	)) {
+		throw std::runtime_error("failed to set surface image");
+	}
+}
+#endif
+
+void M4Revolution::fitSurface(Work::Convert &convert, nvtt::Surface &surface) {
 	#ifdef EXTENTS_MAKE_POWER_OF_TWO
 	#ifdef TO_NEXT_POWER_OF_TWO
 	static constexpr nvtt::RoundMode ROUND_MODE = nvtt::RoundMode_ToNextPowerOfTwo;
@@ -736,22 +1352,42 @@ void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface
 	#endif
 
 	static constexpr nvtt::ResizeFilter RESIZE_FILTER = nvtt::ResizeFilter_Triangle;
-	static constexpr int MIPMAP_COUNT = 1;
-
-	const nvtt::Context &context = convert.context;
-
-	Work::Convert::Extent width = clamp((Work::Convert::Extent)surface.width(), configuration.minTextureWidth, configuration.maxTextureWidth);
-	Work::Convert::Extent height = clamp((Work::Convert::Extent)surface.height(), configuration.minTextureHeight, configuration.maxTextureHeight);
-	Work::Convert::Extent depth = clamp((Work::Convert::Extent)surface.depth(), configuration.minVolumeExtent, configuration.maxVolumeExtent);
 
-	Work::Convert::Extent maxExtent = __max(width, height);
-	maxExtent = __max(depth, maxExtent);
+	Work::Convert::Extent maxExtent = getMaxExtent(convert.configuration, surface.width(), surface.height(), surface.depth());
 
 	#ifdef EXTENTS_MAKE_SQUARE
 	surface.resize_make_square(maxExtent, ROUND_MODE, RESIZE_FILTER);
 	#else
+	#ifdef RESAMPLE_ENABLED
+	// nvtt weights the colours by alpha when resizing transparent surfaces, which ours doesn't do
+	// otherwise it's the same shape of triangle filter, just faster (see Resample.h for how it differs)
+	if (surface.depth() == 1 && surface.alphaMode() != nvtt::AlphaMode_Transparency) {
+		resizeSurface(surface, maxExtent);
+	} else {
+		surface.resize((int)maxExtent, ROUND_MODE, RESIZE_FILTER);
+	}
+	#else
 	surface.resize((int)maxExtent, ROUND_MODE, RESIZE_FILTER);
 	#endif
+	#endif
+}
+
+void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface, bool hasAlpha) {
+	static constexpr int MIPMAP_COUNT = 1;
+
+	// each of the other profiles is fit from its own copy of the surface, because fitting it changes it
+	for (
+		auto profileConvertPointerVectorIterator = convert.profileConvertPointerVector.begin();
+		profileConvertPointerVectorIterator != convert.profileConvertPointerVector.end();
+		profileConvertPointerVectorIterator++
+	) {
+		nvtt::Surface profileSurface = surface;
+		convertSurface(**profileConvertPointerVectorIterator, profileSurface, hasAlpha);
+	}
+
+	const nvtt::Context &context = convert.context;
+
+	fitSurface(convert, surface);
 
 	Ubi::BigFile::File &file = convert.file;
 
@@ -789,35 +1425,177 @@ void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface
 
 	file.size = outputHandler.size;
 
-	// this will wake up the output thread to tell it we have no more data to add
+	// this will wake up the output stage to tell it we have no more data to add
 	// and to move on to the next FileTask
 	fileTask.complete();
 }
 
-void M4Revolution::convertImageStandardWorkCallback(Work::Convert* convertPointer) {
-	SCOPE_EXIT {
-		delete convertPointer;
-	};
+#ifdef STRIPES_ENABLED
+bool M4Revolution::isStripes(int width, int height) {
+	// surfaces are four floats per pixel, so past this size
+	// having one of them (and its resized copy) on every thread adds up quick
+	static constexpr size_t STRIPES_MIN_PIXELS = 0x100000;
 
-	Work::Convert &convert = *convertPointer;
+	return (size_t)width * (size_t)height > STRIPES_MIN_PIXELS;
+}
+
+void M4Revolution::convertStripes(Work::Convert &convert, unsigned char* imagePointer, int width, int height, size_t stride, bool hasAlpha) {
+	if (!imagePointer) {
+		throw std::invalid_argument("imagePointer must not be nullptr");
+	}
+
+	// the image is only ever resized into a new buffer, so the other profiles can be converted from it too
+	for (
+		auto profileConvertPointerVectorIterator = convert.profileConvertPointerVector.begin();
+		profileConvertPointerVectorIterator != convert.profileConvertPointerVector.end();
+		profileConvertPointerVectorIterator++
+	) {
+		convertStripes(**profileConvertPointerVectorIterator, imagePointer, width, height, stride, hasAlpha);
+	}
+
+	// this must be a multiple of the block size
+	// so that every stripe begins on a new row of blocks
+	static constexpr int STRIPE_HEIGHT = 64;
+	static constexpr int DEPTH = 1;
+	static constexpr int ARRAY_SIZE = 1;
+	static constexpr int MIPMAP_COUNT = 1;
+	static constexpr int MIPMAP = 0;
+	static constexpr int FACE = 0;
+	static constexpr size_t BYTES = 4;
+
+	const nvtt::Context &context = convert.context;
+
+	// the image is still only the eight bit image at this point, so we resize it before it becomes a surface
+	std::unique_ptr<unsigned char[]> resizeImagePointer = nullptr;
+
+	int resizeWidth = width;
+	int resizeHeight = height;
+
+	if (getResizeExtent(getMaxExtent(convert.configuration, width, height, DEPTH), resizeWidth, resizeHeight)) {
+		const size_t RESIZE_STRIDE = (size_t)resizeWidth * BYTES;
+
+		resizeImagePointer = makeUniqueArray<unsigned char>(RESIZE_STRIDE * (size_t)resizeHeight);
+
+		Resample::resize(
+			imagePointer, width, height, stride,
+			resizeImagePointer.get(), resizeWidth, resizeHeight, RESIZE_STRIDE,
+			(int)BYTES
+		);
+
+		imagePointer = resizeImagePointer.get();
+		width = resizeWidth;
+		height = resizeHeight;
+		stride = RESIZE_STRIDE;
+	}
+
+	Ubi::BigFile::File &file = convert.file;
+
+	const nvtt::CompressionOptions &compressionOptions = M4Revolution::COMPRESSION_OPTIONS.get(
+		file, width, height, DEPTH, hasAlpha);
+
+	nvtt::OutputOptions outputOptions;
+	outputOptions.setContainer(nvtt::Container_DDS);
+
+	Work::FileTask &fileTask = *convert.fileTaskPointer;
+
+	OutputHandler outputHandler(fileTask);
+	outputOptions.setOutputHandler(&outputHandler);
+
+	ErrorHandler errorHandler;
+	outputOptions.setErrorHandler(&errorHandler);
+
+	if (!context.outputHeader(nvtt::TextureType_2D, width, height, DEPTH, ARRAY_SIZE, MIPMAP_COUNT,
+		false, compressionOptions, outputOptions)) {
+		throw std::runtime_error("failed to output context header");
+	}
+
+	// nvtt expects the rows to be tightly packed
+	// so if they aren't, each stripe is packed into this buffer first
+	size_t rowSize = (size_t)width * BYTES;
+	std::unique_ptr<unsigned char[]> stripePointer = nullptr;
+
+	if (stride != rowSize) {
+		stripePointer = makeUniqueArray<unsigned char>(rowSize * STRIPE_HEIGHT);
+	}
+
+	// the blocks are output in rows, top to bottom
+	// so compressing the image one stripe at a time results in the same data as compressing it all at once
+	// except only a stripe worth of surface ever exists at a time
 	nvtt::Surface surface;
-	bool hasAlpha = true;
+
+	for (int y = 0; y < height; y += STRIPE_HEIGHT) {
+		int stripeHeight = __min(height - y, STRIPE_HEIGHT);
+		unsigned char* stripeImagePointer = imagePointer + ((size_t)y * stride);
+
+		if (stripePointer) {
+			for (int i = 0; i < stripeHeight; i++) {
+				memcpy(stripePointer.get() + ((size_t)i * rowSize), stripeImagePointer + ((size_t)i * stride), rowSize);
+			}
+
+			stripeImagePointer = stripePointer.get();
+		}
+
+		if (!surface.setImage(nvtt::InputFormat::InputFormat_BGRA_8UB, width, stripeHeight, DEPTH, stripeImagePointer)) {
+			throw std::runtime_error("failed to set surface image");
+		}
+
+		if (!context.compress(surface, FACE, MIPMAP, compressionOptions, outputOptions) || !errorHandler.result) {
+			throw std::runtime_error("failed to compress context");
+		}
+	}
+
+	file.size = outputHandler.size;
+
+	// this will wake up the output stage to tell it we have no more data to add
+	// and to move on to the next FileTask
+	fileTask.complete();
+}
+#endif
+
+bool M4Revolution::convertImageStandardWorkCallback(Work::Convert &convert, nvtt::Surface &surface, bool &hasAlpha) {
+	#ifdef STRIPES_ENABLED
+	{
+		int width = 0;
+		int height = 0;
+		bool info = true;
+
+		// nvtt supports formats M4Image doesn't, so this is allowed to fail
+		try {
+			M4Image::getInfo(convert.dataPointer.get(), convert.file.size, nullptr, &hasAlpha, nullptr, &width, &height);
+		} catch (...) {
+			info = false;
+		}
+
+		if (info && isStripes(width, height)) {
+			static constexpr size_t BYTES = 4;
+
+			size_t stride = (size_t)width * BYTES;
+			std::unique_ptr<unsigned char[]> imagePointer = makeUniqueArray<unsigned char>(stride * (size_t)height);
+
+			{
+				M4Image m4Image(width, height, stride, M4Image::COLOR_FORMAT::BGRA, imagePointer.get());
+				m4Image.load(convert.dataPointer.get(), convert.file.size);
+			}
+
+			// we don't need the compressed data anymore, so let it go early
+			convert.dataPointer = nullptr;
+
+			convertStripes(convert, imagePointer.get(), width, height, stride, hasAlpha);
+			return false;
+		}
+	}
+	#endif
 
 	if (!surface.loadFromMemory(convert.dataPointer.get(), convert.file.size, &hasAlpha)) {
 		throw std::runtime_error("failed to load surface from memory");
 	}
 
-	// when this unlocks one line later, the output thread will begin waiting on data
-	convertSurface(convert, surface, hasAlpha);
+	convert.dataPointer = nullptr;
+	return true;
 }
 
-void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
-	SCOPE_EXIT {
-		delete convertPointer;
-	};
-
-	Work::Convert &convert = *convertPointer;
-	nvtt::Surface surface;
+bool M4Revolution::convertImageZAPWorkCallback(Work::Convert &convert, nvtt::Surface &surface, bool &hasAlpha) {
+	hasAlpha = true;
 
 	{
 		zap_byte_t* image = nullptr;
@@ -839,6 +1617,15 @@ void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
 			}
 		};
 
+		#ifdef STRIPES_ENABLED
+		if (isStripes(width, height)) {
+			convert.dataPointer = nullptr;
+
+			convertStripes(convert, image, width, height, stride, hasAlpha);
+			return false;
+		}
+		#endif
+
 		static constexpr int DEPTH = 1;
 
 		if (!surface.setImage(nvtt::InputFormat::InputFormat_BGRA_8UB, width, height, DEPTH, image)) {
@@ -846,20 +1633,176 @@ void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
 		}
 	}
 
-	// when this unlocks one line later, the output thread will begin waiting on data
-	convertSurface(convert, surface, true);
+	convert.dataPointer = nullptr;
+	return true;
 }
 
-void M4Revolution::convertFileWorkCallback(Work::Convert* convertPointer) noexcept {
-	convertPointer->fileWorkCallback(convertPointer);
+void M4Revolution::convertFileWorkCallback(Work::Convert &convert) noexcept {
+	nvtt::Surface surface;
+	bool hasAlpha = true;
+
+	// if this returns false, the file was already converted in stripes
+	if (!convert.fileWorkCallback(convert, surface, hasAlpha)) {
+		return;
+	}
+
+	// the output stage writes the data as this adds it
+	convertSurface(convert, surface, hasAlpha);
 }
 
-#ifdef MULTITHREADED
-VOID CALLBACK M4Revolution::convertFileProc(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work) {
-	Work::Convert* convertPointer = (Work::Convert*)parameter;
-	convertFileWorkCallback(convertPointer);
+void M4Revolution::convertBatchWorkCallback(Work::ConvertBatch &convertBatch) noexcept {
+	static constexpr int MIPMAP_COUNT = 1;
+	static constexpr int MIPMAP = 0;
+	static constexpr int FACE = 0;
+
+	// each image still gets its own header and output, so it is written to its own FileTask
+	struct Image : NonCopyable {
+		Work::Convert &convert;
+		nvtt::Surface surface;
+		bool hasAlpha = true;
+		const nvtt::CompressionOptions* compressionOptionsPointer = nullptr;
+
+		nvtt::OutputOptions outputOptions;
+		OutputHandler outputHandler;
+		ErrorHandler errorHandler;
+
+		Image(Work::Convert &convert)
+			: convert(convert),
+			outputHandler(*convert.fileTaskPointer) {
+			outputOptions.setContainer(nvtt::Container_DDS);
+			outputOptions.setOutputHandler(&outputHandler);
+			outputOptions.setErrorHandler(&errorHandler);
+		}
+	};
+
+	using ImagePointerVector = std::vector<std::unique_ptr<Image>>;
+
+	Work::ConvertBatch::ConvertPointerVector &convertPointerVector = convertBatch.convertPointerVector;
+	ImagePointerVector imagePointerVector = {};
+
+	// all the images are loaded first, so that the ones with the same compression options can be compressed at once
+	for (
+		auto convertPointerVectorIterator = convertPointerVector.begin();
+		convertPointerVectorIterator != convertPointerVector.end();
+		convertPointerVectorIterator++
+	) {
+		Work::Convert &convert = **convertPointerVectorIterator;
+		std::unique_ptr<Image> imagePointer = std::make_unique<Image>(convert);
+		Image &image = *imagePointer;
+
+		// if this returns false, the file was already converted in stripes
+		if (!convert.fileWorkCallback(convert, image.surface, image.hasAlpha)) {
+			continue;
+		}
+
+		ImagePointerVector::size_type images = imagePointerVector.size();
+		imagePointerVector.push_back(std::move(imagePointer));
+
+		// the other profiles each get their own copy of the surface, before it's fit to this one
+		for (
+			auto profileConvertPointerVectorIterator = convert.profileConvertPointerVector.begin();
+			profileConvertPointerVectorIterator != convert.profileConvertPointerVector.end();
+			profileConvertPointerVectorIterator++
+		) {
+			std::unique_ptr<Image> profileImagePointer = std::make_unique<Image>(**profileConvertPointerVectorIterator);
+			profileImagePointer->surface = image.surface;
+			profileImagePointer->hasAlpha = image.hasAlpha;
+			imagePointerVector.push_back(std::move(profileImagePointer));
+		}
+
+		for (
+			auto imagePointerVectorIterator = imagePointerVector.begin() + images;
+			imagePointerVectorIterator != imagePointerVector.end();
+			imagePointerVectorIterator++
+		) {
+			Image &fitImage = **imagePointerVectorIterator;
+			Work::Convert &fitConvert = fitImage.convert;
+
+			fitSurface(fitConvert, fitImage.surface);
+
+			// must be called here after we've modified the surface
+			fitImage.compressionOptionsPointer = &M4Revolution::COMPRESSION_OPTIONS.get(
+				fitConvert.file, fitImage.surface, fitImage.hasAlpha);
+
+			if (!fitConvert.context.outputHeader(fitImage.surface, MIPMAP_COUNT, *fitImage.compressionOptionsPointer, fitImage.outputOptions)) {
+				throw std::runtime_error("failed to output context header");
+			}
+		}
+	}
+
+	// there are only ever a few different compression options, so this won't loop many times
+	for (
+		auto imagePointerVectorIterator = imagePointerVector.begin();
+		imagePointerVectorIterator != imagePointerVector.end();
+		imagePointerVectorIterator++
+	) {
+		Image &image = **imagePointerVectorIterator;
+		const nvtt::CompressionOptions* compressionOptionsPointer = image.compressionOptionsPointer;
+
+		// if this is null, the image was already compressed with a previous batch list
+		if (!compressionOptionsPointer) {
+			continue;
+		}
+
+		nvtt::BatchList batchList;
+
+		for (
+			auto batchImagePointerVectorIterator = imagePointerVectorIterator;
+			batchImagePointerVectorIterator != imagePointerVector.end();
+			batchImagePointerVectorIterator++
+		) {
+			Image &batchImage = **batchImagePointerVectorIterator;
+
+			if (batchImage.compressionOptionsPointer != compressionOptionsPointer) {
+				continue;
+			}
+
+			batchList.Append(&batchImage.surface, FACE, MIPMAP, &batchImage.outputOptions);
+			batchImage.compressionOptionsPointer = nullptr;
+		}
+
+		if (!image.convert.context.compress(batchList, *compressionOptionsPointer)) {
+			throw std::runtime_error("failed to compress context");
+		}
+	}
+
+	for (
+		auto imagePointerVectorIterator = imagePointerVector.begin();
+		imagePointerVectorIterator != imagePointerVector.end();
+		imagePointerVectorIterator++
+	) {
+		Image &image = **imagePointerVectorIterator;
+
+		if (!image.errorHandler.result) {
+			throw std::runtime_error("failed to compress context");
+		}
+
+		image.convert.file.size = image.outputHandler.size;
+
+		// this will wake up the output stage to tell it we have no more data to add
+		// and to move on to the next FileTask
+		image.convert.fileTaskPointer->complete();
+	}
+}
+
+Work::Coroutine M4Revolution::convertCoroutine(Work::ConvertChannel &convertChannel) {
+	for (;;) {
+		// when the channel is closed, every file has been read
+		std::optional<Work::ConvertVariant> convertVariantOptional = co_await convertChannel.pop();
+
+		if (!convertVariantOptional.has_value()) {
+			break;
+		}
+
+		Work::ConvertVariant &convertVariant = convertVariantOptional.value();
+
+		if (std::holds_alternative<Work::ConvertBatch::Pointer>(convertVariant)) {
+			convertBatchWorkCallback(*std::get<Work::ConvertBatch::Pointer>(convertVariant));
+		} else {
+			convertFileWorkCallback(*std::get<std::unique_ptr<Work::Convert>>(convertVariant));
+		}
+	}
 }
-#endif
 
 bool M4Revolution::outputBigFiles(Work::Output &output, std::streamoff bigFileInputOffset, Work::Tasks &tasks) {
 	std::streamoff &currentBigFileInputOffset = output.currentBigFileInputOffset;
@@ -969,37 +1912,16 @@ bool M4Revolution::outputBigFiles(Work::Output &output, std::streamoff bigFileIn
 	return true;
 }
 
-void M4Revolution::outputData(std::ostream &outputStream, Work::FileTask &fileTask, bool &yield) {
-	Work::Data::Queue dataQueue = {};
-
-	for (;;) {
-		// copy out the queue
-		// this is fast since data is just a struct with a number and pointer
-		// (this is several times faster than holding the lock while writing)
-		{
-			Work::Data::QueueLock lock = fileTask.lock(yield);
-			Work::Data::Queue &queue = lock.get();
-
-			if (queue.empty()) {
-				continue;
-			}
-
-			dataQueue = queue;
-			queue = {};
-		}
-
-		while (!dataQueue.empty()) {
-			Work::Data &data = dataQueue.front();
+void M4Revolution::outputData(std::ostream &outputStream, const Work::Data &data,
+	Hash* hashPointer, std::ostream* cacheOutputStreamPointer) {
+	writeStream(outputStream, data.pointer.get(), (std::streamsize)data.size);
 
-			// a null pointer signals that the file is complete
-			if (!data.pointer) {
-				return;
-			}
-
-			writeStream(outputStream, data.pointer.get(), (std::streamsize)data.size);
+	if (hashPointer) {
+		hashPointer->update(data.pointer.get(), data.size);
+	}
 
-			dataQueue.pop();
-		}
+	if (cacheOutputStreamPointer) {
+		writeStream(*cacheOutputStreamPointer, data.pointer.get(), (std::streamsize)data.size);
 	}
 }
 
@@ -1036,191 +1958,200 @@ void M4Revolution::outputFiles(Work::Output &output, Work::FileTask::FileVariant
 	}
 }
 
-void M4Revolution::outputThread(Work::Tasks &tasks, bool &yield) {
-	Work::Output output;
-
-	Work::FileTask::PointerQueue fileTaskPointerQueue = {};
+Work::Coroutine M4Revolution::outputCoroutine(Work::Tasks &tasks, const char* fileName, Work::Manifest* manifestPointer, std::ostream* cacheOutputStreamPointer) {
+	Work::Output output(fileName);
 
 	for (;;) {
-		// copy out the queue
-		// (this is fast because it's just a queue of pointers, much faster than holding the lock while writing)
-		{
-			Work::FileTask::PointerQueueLock fileLock = tasks.fileLock(yield);
-			Work::FileTask::PointerQueue &queue = fileLock.get();
+		std::optional<Work::FileTask::Pointer> fileTaskPointerOptional = co_await tasks.fileChannel.pop();
 
-			if (queue.empty()) {
-				if (yield) {
-					continue;
-				}
+		if (!fileTaskPointerOptional.has_value()) {
+			// this would mean we made it to the end, but didn't write all the filesystems somehow
+			throw std::logic_error("fileTaskPointerOptional must have a value until the end");
+		}
 
-				// this would mean we made it to the end, but didn't write all the filesystems somehow
-				throw std::logic_error("queue must not be empty if yield is false");
-			}
+		Work::FileTask &fileTask = *fileTaskPointerOptional.value();
 
-			fileTaskPointerQueue = queue;
-			queue = {};
+		// if this returns false it means we're done
+		if (!outputBigFiles(output, fileTask.getOwnerBigFileInputOffset(), tasks)) {
+			co_return;
 		}
 
-		while (!fileTaskPointerQueue.empty()) {
-			Work::FileTask &fileTask = *fileTaskPointerQueue.front();
-
-			// if this returns false it means we're done
-			if (!outputBigFiles(output, fileTask.getOwnerBigFileInputOffset(), tasks)) {
-				return;
-			}
+		Work::FileTask::FileVariant fileVariant = fileTask.getFileVariant();
 
-			outputData(output.fileStream, fileTask, yield);
+		// if the file must start on a boundary, leave a gap before it
+		// (this can only be done here, because only we know where the file will end up)
+		if (std::holds_alternative<Ubi::BigFile::File*>(fileVariant)) {
+			Ubi::BigFile::File &file = *std::get<Ubi::BigFile::File*>(fileVariant);
 
-			Work::FileTask::FileVariant fileVariant = fileTask.getFileVariant();
-			outputFiles(output, fileVariant);
+			if (file.alignment) {
+				std::streamoff offset = output.fileStream.tellp();
+				Ubi::BigFile::File::Size padding = (Ubi::BigFile::File::Size)((file.alignment - (offset % file.alignment)) % file.alignment);
 
-			fileTaskPointerQueue.pop();
+				output.fileStream.seekp((std::streamoff)padding, std::ofstream::cur);
+				file.padding += padding;
+			}
 		}
-	}
-}
-
-#ifdef WINDOWS
-bool M4Revolution::getDLLExportRVA(const char* libFileName, const char* procName, unsigned long &dllExportRVA) {
-	std::ostringstream outputStringStream;
-	outputStringStream.exceptions(std::ostringstream::badbit);
-	outputStringStream << "GetDLLExportRVA " << std::quoted(libFileName) << " " << std::quoted(procName);
-
-	const std::string &str = outputStringStream.str();
 
-	size_t commandLineSize = str.size() + 1;
-	std::unique_ptr<CHAR[]> commandLinePointer = makeUniqueArray<CHAR>(commandLineSize);
-	CHAR* commandLine = commandLinePointer.get();
+		// in deterministic or incremental mode, converted files are hashed for the manifest
+		// and in incremental mode, they are also put in the cache for next time
+		bool manifest = manifestPointer && fileTask.sourceOptional.has_value();
+		std::streamoff slot = manifest && cacheOutputStreamPointer ? (std::streamoff)cacheOutputStreamPointer->tellp() : -1;
 
-	crtErr(strncpy_s(
-		commandLine, commandLineSize,
-		str.c_str(), commandLineSize
-	));
+		Hash hash;
+		Hash* hashPointer = manifest ? &hash : nullptr;
+		std::ostream* fileCacheOutputStreamPointer = manifest ? cacheOutputStreamPointer : nullptr;
 
-	PROCESS_INFORMATION processInformation = {};
-	HANDLE &process = processInformation.hProcess;
-	HANDLE &thread = processInformation.hThread;
+		// the data channel is closed once the file is complete
+		for (;;) {
+			std::optional<Work::Data> dataOptional = co_await fileTask.pop();
 
-	SCOPE_EXIT {
-		osErr(closeProcess(process));
-	};
-
-	SCOPE_EXIT {
-		osErr(closeThread(thread));
-	};
+			if (!dataOptional.has_value()) {
+				break;
+			}
 
-	static constexpr DWORD BUFFER_SIZE = sizeof("0x00000000");
-	CHAR buffer[BUFFER_SIZE] = "";
+			outputData(output.fileStream, dataOptional.value(), hashPointer, fileCacheOutputStreamPointer);
+		}
 
-	{
-		HANDLE stdoutReadPipe = NULL;
+		tasks.conversionStall += fileTask.getStalls().pop;
 
-		SCOPE_EXIT {
-			osErr(closeHandle(stdoutReadPipe));
-		};
+		if (manifest) {
+			// converted files always have a singular file
+			const Ubi::BigFile::File &file = *std::get<Ubi::BigFile::File*>(fileVariant);
+			const Work::Source &source = fileTask.sourceOptional.value();
 
-		{
-			HANDLE stdoutWritePipe = NULL;
-
-			SCOPE_EXIT {
-				osErr(closeHandle(stdoutWritePipe));
-			};
+			manifestPointer->entryMap.insert({
+				Work::Manifest::getKey(source),
+				{
+					source,
+					file.size,
+					hash.get(),
+					slot,
+					file.nameOptional.value_or("")
+				}
+			});
+		}
 
-			SECURITY_ATTRIBUTES securityAttributes = {};
-			securityAttributes.nLength = sizeof(securityAttributes);
-			securityAttributes.bInheritHandle = TRUE;
+		outputFiles(output, fileVariant);
+	}
+}
 
-			osErr(CreatePipe(&stdoutReadPipe, &stdoutWritePipe, &securityAttributes, BUFFER_SIZE - 1));
-			osErr(SetHandleInformation(stdoutReadPipe, HANDLE_FLAG_INHERIT, 0));
+void M4Revolution::verifyManifest(const Work::Manifest &manifest) {
+	std::ifstream inputFileStream(Work::Manifest::PATH);
 
-			STARTUPINFO startupInfo = {};
-			startupInfo.cb = sizeof(startupInfo);
-			startupInfo.dwFlags = STARTF_USESTDHANDLES;
-			startupInfo.hStdOutput = stdoutWritePipe;
+	// there won't be one the first time, which is fine
+	if (!inputFileStream.is_open()) {
+		return;
+	}
 
-			osErr(CreateProcessA(NULL, commandLine, NULL, NULL, TRUE, 0, NULL,
-				EXEDIR, &startupInfo, &processInformation)
-				&& process
-				&& thread);
-		}
+	std::optional<Work::Manifest> previousManifestOptional = std::nullopt;
 
-		DWORD numberOfBytesRead = 0;
-		readPipePartial(stdoutReadPipe, buffer, BUFFER_SIZE - 1, numberOfBytesRead);
+	try {
+		previousManifestOptional.emplace(inputFileStream);
+	} catch (const std::invalid_argument &ex) {
+		consoleLog(ex.what(), 2);
+		consoleLog("The previous manifest is invalid, so the output could not be verified.", 2);
+		return;
 	}
 
-	// max so we don't hang forever in the worst case
-	static constexpr DWORD MILLISECONDS = 10000;
-
-	DWORD wait = WaitForSingleObject(process, MILLISECONDS);
-	osErr(wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED);
+	const Work::Manifest &previousManifest = previousManifestOptional.value();
 
-	size_t size = stringToLong(buffer, dllExportRVA);
+	// a different configuration will (rightly) give a different output
+	if (previousManifest.configuration != manifest.configuration) {
+		consoleLog("The previous manifest used a different configuration, so the output could not be verified.", 2);
+		return;
+	}
 
-	if (!size) {
-		DWORD exitCode = 0;
+	size_t verified = 0;
+	size_t mismatched = 0;
 
-		osErr(GetExitCodeProcess(process, &exitCode));
-		SetLastError(exitCode);
-	}
-	return (bool)size;
-}
+	for (
+		auto entryMapIterator = manifest.entryMap.begin();
+		entryMapIterator != manifest.entryMap.end();
+		entryMapIterator++
+	) {
+		// only files converted from exactly the same input can be expected to have the same output
+		// (which is what the entries are keyed on)
+		auto previousEntryMapIterator = previousManifest.entryMap.find(entryMapIterator->first);
 
-unsigned long M4Revolution::getOffsetFromRVA(std::istream &inputStream, unsigned long rva) {
-	std::streampos position = inputStream.tellg();
+		if (previousEntryMapIterator == previousManifest.entryMap.end()) {
+			continue;
+		}
 
-	SCOPE_EXIT {
-		inputStream.seekg(position);
-	};
+		const Work::Manifest::Entry &entry = entryMapIterator->second;
+		const Work::Manifest::Entry &previousEntry = previousEntryMapIterator->second;
 
-	inputStream.seekg(0);
+		if (entry.size == previousEntry.size && entry.hash == previousEntry.hash) {
+			verified++;
+			continue;
+		}
 
-	IMAGE_DOS_HEADER imageDosHeader = {};
-	readStream(inputStream, &imageDosHeader, sizeof(imageDosHeader));
+		mismatched++;
 
-	if (imageDosHeader.e_magic != IMAGE_DOS_SIGNATURE) {
-		throw std::invalid_argument("e_magic must be IMAGE_DOS_SIGNATURE");
+		std::ostringstream outputStringStream;
+		outputStringStream << "The output of \"" << entry.name << "\" does not match the previous manifest.";
+		consoleLog(outputStringStream.str().c_str(), true, false, true);
 	}
 
-	inputStream.seekg(imageDosHeader.e_lfanew);
-
-	// we assume 32-bit for now so we will never read past the end of the header
-	IMAGE_NT_HEADERS32 imageNtHeaders32 = {};
-	readStream(inputStream, &imageNtHeaders32, sizeof(imageNtHeaders32));
+	std::ostringstream outputStringStream;
+	outputStringStream << verified << " converted files matched the previous manifest, and " << mismatched << " did not.";
+	consoleLog(outputStringStream.str().c_str(), 2, false, mismatched);
+}
 
-	if (imageNtHeaders32.Signature != IMAGE_NT_SIGNATURE) {
-		throw std::invalid_argument("Signature must be IMAGE_NT_SIGNATURE");
-	}
+void M4Revolution::writeManifest(const Work::Manifest &manifest) {
+	std::ofstream outputFileStream;
+	outputFileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	outputFileStream.open(Work::Manifest::PATH, std::ofstream::trunc);
 
-	IMAGE_FILE_HEADER &imageFileHeader = imageNtHeaders32.FileHeader;
+	manifest.write(outputFileStream);
+}
 
-	inputStream.seekg(imageDosHeader.e_lfanew);
+uint32_t M4Revolution::getMaxThreads(uint32_t maxThreads) {
+	if (maxThreads) {
+		return maxThreads;
+	}
 
-	// the IMAGE_NT_HEADERS32 struct is designed such that the offset
-	// of the optional header will always be the same regardless
-	// of PE32 or PE32+, so using offsetof like this is safe
-	size_t imageNtHeadersSize = offsetof(IMAGE_NT_HEADERS32, OptionalHeader)
-		+ imageFileHeader.SizeOfOptionalHeader
-		+ ((size_t)imageFileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER));
+	// chosen so that if you have a quad core there will still be
+	// at least two threads for other system stuff
+	// (meanwhile, barely affecting even more powerful processors)
+	static constexpr unsigned int RESERVED_THREADS = 2;
 
-	std::unique_ptr<char[]> imageNtHeadersPointer = makeUniqueArray<char>(imageNtHeadersSize);
+	unsigned int processors = std::thread::hardware_concurrency();
 
-	PIMAGE_NT_HEADERS32 imageNtHeaders32Pointer = (PIMAGE_NT_HEADERS32)imageNtHeadersPointer.get();
-	readStream(inputStream, imageNtHeaders32Pointer, (std::streamsize)imageNtHeadersSize);
+	// can't use max because this is unsigned
+	return processors > RESERVED_THREADS
+		? processors - RESERVED_THREADS : 1;
+}
 
-	return imageNtHeaders32Pointer->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC
-		? getOffsetFromRVA((PIMAGE_NT_HEADERS64)imageNtHeaders32Pointer, rva)
-		: getOffsetFromRVA((PIMAGE_NT_HEADERS32)imageNtHeaders32Pointer, rva);
+void M4Revolution::replaceCache() {
+	// the old manifest must never be used with the new cache
+	// so it is removed first, and the new one is written only after the cache is replaced
+	std::filesystem::remove(Work::Manifest::PATH);
+	std::filesystem::rename(Work::Cache::OUTPUT_PATH, Work::Cache::PATH);
 }
-#endif
 
 M4Revolution::M4Revolution(
 	const std::filesystem::path &path,
 	bool logFileNames,
+	bool logStalls,
 	bool disableHardwareAcceleration,
+	bool deterministic,
+	bool incremental,
 	uint32_t maxThreads,
-	Work::FileTask::PointerQueue::size_type maxFileTasks,
-	std::optional<Work::Convert::Configuration> configurationOptional
+	Work::FileTask::Channel::Size maxFileTasks,
+	uint32_t maxOutputThreads,
+	std::optional<Work::Convert::Configuration> configurationOptional,
+	const Work::Layout &layout
 )
-	: logFileNames(logFileNames) {
+	: logFileNames(logFileNames),
+	logStalls(logStalls),
+	deterministic(deterministic),
+	incremental(incremental),
+	maxThreads(getMaxThreads(maxThreads)),
+	maxOutputThreads(maxOutputThreads),
+	maxFileTasks(maxFileTasks ? maxFileTasks : DEFAULT_MAX_FILE_TASKS),
+	tasks(this->maxFileTasks),
+	convertChannel(this->maxThreads),
+	layout(layout) {
 	// decimal points are really just to indicate integer vs. float
 	// I doubt anyone cares about seeing more than one in this application
 	// this is intentionally not done for std::cin (might have weird side effects)
@@ -1230,34 +2161,9 @@ M4Revolution::M4Revolution(
 	// here we make the path lexically normal just so that it displays nice
 	Work::Output::findInstallPath(path.lexically_normal());
 
-	context.enableCudaAcceleration(!disableHardwareAcceleration);
-
-	#ifdef MULTITHREADED
-	pool = CreateThreadpool(NULL);
-	osErr(pool);
-
-	if (!maxThreads) {
-		// chosen so that if you have a quad core there will still be
-		// at least two threads for other system stuff
-		// (meanwhile, barely affecting even more powerful processors)
-		static constexpr DWORD RESERVED_THREADS = 2;
-
-		SYSTEM_INFO systemInfo = {};
-		GetSystemInfo(&systemInfo);
-
-		// can't use max because this is unsigned
-		maxThreads = systemInfo.dwNumberOfProcessors > RESERVED_THREADS
-			? systemInfo.dwNumberOfProcessors - RESERVED_THREADS : 1;
-	}
-
-	SetThreadpoolThreadMaximum(pool, maxThreads);
-	osErr(SetThreadpoolThreadMinimum(pool, 1));
-	#endif
-
-	// the number 216 was chosen for being the standard number of tiles in a cube
-	static constexpr Work::FileTask::PointerQueue::size_type DEFAULT_MAX_FILE_TASKS = 216;
-
-	this->maxFileTasks = maxFileTasks ? maxFileTasks : DEFAULT_MAX_FILE_TASKS;
+	// the output may be different depending on if it was converted by CUDA or not
+	// so in deterministic mode, we always take the same path (the CPU one)
+	context.enableCudaAcceleration(!disableHardwareAcceleration && !deterministic);
 
 	if (configurationOptional.has_value()) {
 		configuration = configurationOptional.value();
@@ -1297,48 +2203,55 @@ M4Revolution::~M4Revolution() {
 	destroy();
 }
 
-void M4Revolution::toggleFullScreen() {
+void M4Revolution::toggleFullScreen(std::optional<bool> toggledOnOptional) {
 	{
 		std::ifstream inputFileStream(Work::Output::USER_PREFERENCE_PATH,
 			std::ifstream::in, _SH_DENYWR);
 
 		Log log("Toggling Full Screen", &inputFileStream);
 
-		OPERATION_EXCEPTION_RETRY_ERR(toggleFullScreen(inputFileStream),
+		OPERATION_EXCEPTION_RETRY_ERR(toggleFullScreen(inputFileStream, toggledOnOptional),
 			std::system_error, Work::Output::FILE_RETRY);
 	}
 
 	Work::Backup::create(Work::Output::USER_PREFERENCE_PATH.string().c_str());
 }
 
-void M4Revolution::toggleCameraInertia() {
+void M4Revolution::toggleCameraInertia(std::optional<bool> toggledOnOptional) {
 	std::fstream fileStream;
 
 	Log log("Toggling Camera Inertia", &fileStream);
 
-	OPERATION_EXCEPTION_RETRY_ERR(toggleCameraInertia(fileStream),
+	OPERATION_EXCEPTION_RETRY_ERR(toggleCameraInertia(fileStream, toggledOnOptional),
 		std::system_error, Work::Output::FILE_RETRY);
 }
 
-void M4Revolution::editSoundFadeOutTime() {
+void M4Revolution::editSoundFadeOutTime(std::optional<unsigned long> timeOptional) {
 	std::fstream fileStream;
 
 	Log log("Editing Sound Fade Out Time", &fileStream);
 
-	OPERATION_EXCEPTION_RETRY_ERR(editSoundFadeOutTime(fileStream),
+	OPERATION_EXCEPTION_RETRY_ERR(editSoundFadeOutTime(fileStream, timeOptional),
 		std::system_error, Work::Output::FILE_RETRY);
 }
 
-void M4Revolution::editTransitionTime() {
+void M4Revolution::editTransitionTime(std::optional<float> timeOptional) {
 	std::fstream fileStream;
 
 	Log log("Editing Transition Time", &fileStream);
 
-	OPERATION_EXCEPTION_RETRY_ERR(editTransitionTime(fileStream),
+	OPERATION_EXCEPTION_RETRY_ERR(editTransitionTime(fileStream, Work::Output::DATA_PATH, timeOptional),
 		std::system_error, Work::Output::FILE_RETRY);
 }
 
-void M4Revolution::fixLoading() {
+void M4Revolution::fixLoading(std::optional<float> transitionTimeOptional) {
+	// in deterministic or incremental mode, the output stage fills this in as it writes the converted files
+	std::optional<Work::Manifest> manifestOptional = std::nullopt;
+
+	if (deterministic || incremental) {
+		manifestOptional.emplace(configuration);
+	}
+
 	{
 		std::ifstream inputFileStream;
 		inputFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -1352,7 +2265,7 @@ void M4Revolution::fixLoading() {
 
 		Log log("Fixing Loading, this may take several minutes", &inputFileStream, inputFile.size, logFileNames, true);
 
-		// to avoid a sharing violation this must happen first before creating the output thread
+		// to avoid a sharing violation this must happen first before creating the output stage
 		// as they will both write to the same temporary file
 		#ifdef WINDOWS
 		OPERATION_EXCEPTION_RETRY_ERR(
@@ -1361,8 +2274,49 @@ void M4Revolution::fixLoading() {
 		);
 		#endif
 
-		bool yield = true;
-		std::thread outputThread(M4Revolution::outputThread, std::ref(tasks), std::ref(yield));
+		// in incremental mode, the files that haven't changed since last time are copied from the old cache
+		// and every converted file (changed or not) is put in the new one
+		std::ofstream cacheOutputFileStream;
+
+		if (incremental) {
+			loadCache();
+
+			cacheOutputFileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+			OPERATION_EXCEPTION_RETRY_ERR(
+				cacheOutputFileStream.open(Work::Cache::OUTPUT_PATH, std::ofstream::binary | std::ofstream::trunc, _SH_DENYRW),
+				std::ofstream::failure, Work::Output::FILE_RETRY
+			);
+		}
+
+		// whatever is left over if we stop early must not be picked up next time
+		SCOPE_EXIT {
+			tasks.clear();
+			convertChannel.clear();
+			convertBatchPointer = nullptr;
+		};
+
+		// the output stage must be destroyed last, in case we stop early
+		// (the converters may still be writing to it until the convert stage is destroyed)
+		Work::Stage outputStage(1);
+		Work::Stage convertStage(maxThreads);
+
+		// the converters that are still running when we stop early finish the file they're on
+		// but there is no reason for them to start on the ones after it
+		SCOPE_EXIT {
+			convertChannel.clear();
+		};
+
+		outputStage.spawn(outputCoroutine(
+			tasks,
+			Work::Output::FILE_NAME,
+			manifestOptional.has_value() ? &manifestOptional.value() : nullptr,
+			incremental ? &cacheOutputFileStream : nullptr
+		));
+
+		for (uint32_t i = 0; i < maxThreads; i++) {
+			convertStage.spawn(convertCoroutine(convertChannel));
+		}
 
 		try {
 			fixLoading(inputFileStream, inputFileStream.tellg(), inputFile, log);
@@ -1374,16 +2328,194 @@ void M4Revolution::fixLoading() {
 
 		log.finishing();
 
-		// necessary to wake up the output thread one last time at the end
+		convertChannel.close();
+		convertStage.join();
+
+		// necessary to wake up the output stage one last time at the end
 		Work::FileTask::Pointer fileTaskPointer = std::make_shared<Work::FileTask>(-1, &inputFile);
 		fileTaskPointer->complete();
-		tasks.fileLock().get().push(fileTaskPointer);
+		tasks.fileChannel.push(fileTaskPointer);
+
+		outputStage.join();
+
+		if (logStalls) {
+			Log::stalls(convertChannel);
+			Log::stalls(Work::Output::FILE_NAME, tasks);
+		}
+
+		if (cacheOptional.has_value()) {
+			std::ostringstream outputStringStream;
+			outputStringStream << cacheOptional.value().reused << " unchanged files were copied from the cache instead of converted.";
+			consoleLog(outputStringStream.str().c_str(), 2);
+
+			cacheOptional = std::nullopt;
+		}
+	}
 
-		yield = false;
-		outputThread.join();
+	// the transition time is edited in the output, before it replaces the original
+	// so that the original only needs to be read and backed up once
+	if (transitionTimeOptional.has_value()) {
+		std::fstream fileStream;
+
+		Log log("Editing Transition Time", &fileStream);
+
+		OPERATION_EXCEPTION_RETRY_ERR(editTransitionTime(fileStream, Work::Output::FILE_NAME, transitionTimeOptional, false),
+			std::system_error, Work::Output::FILE_RETRY);
 	}
 
 	Work::Backup::create(Work::Output::DATA_PATH.string().c_str());
+
+	if (manifestOptional.has_value()) {
+		const Work::Manifest &manifest = manifestOptional.value();
+
+		if (deterministic) {
+			verifyManifest(manifest);
+		}
+
+		if (incremental) {
+			OPERATION_EXCEPTION_RETRY_ERR(replaceCache(),
+				std::filesystem::filesystem_error, Work::Output::FILE_RETRY);
+		}
+
+		OPERATION_EXCEPTION_RETRY_ERR(writeManifest(manifest),
+			std::ofstream::failure, Work::Output::FILE_RETRY);
+	}
+}
+
+void M4Revolution::fixLoadingProfiles(const Work::Convert::ConfigurationVector &configurationVector) {
+	if (configurationVector.empty()) {
+		throw std::invalid_argument("configurationVector must not be empty");
+	}
+
+	// the first profile is converted with the usual configuration and tasks, and the others with their own
+	// the outputs are written next to the original instead of replacing it, so nothing is backed up
+	const Work::Convert::Configuration CONFIGURATION = configuration;
+
+	SCOPE_EXIT {
+		profilePointerVector.clear();
+		configuration = CONFIGURATION;
+	};
+
+	configuration = configurationVector.front();
+
+	static constexpr Profile::Number NUMBER = 1;
+
+	{
+		std::ifstream inputFileStream;
+		inputFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+		OPERATION_EXCEPTION_RETRY_ERR(
+			inputFileStream.open(Work::Output::DATA_PATH, std::ifstream::binary, _SH_DENYWR),
+			std::ifstream::failure, Work::Output::FILE_RETRY
+		);
+
+		Ubi::BigFile::File inputFile = createInputFile(inputFileStream);
+
+		Log log("Fixing Loading for Profiles, this may take several minutes", &inputFileStream, inputFile.size, logFileNames, true);
+
+		for (
+			auto configurationVectorIterator = configurationVector.begin() + 1;
+			configurationVectorIterator != configurationVector.end();
+			configurationVectorIterator++
+		) {
+			profilePointerVector.push_back(std::make_unique<Profile>(
+				*configurationVectorIterator, inputFile, (Profile::Number)(NUMBER + profilePointerVector.size() + 1), maxFileTasks));
+		}
+
+		SCOPE_EXIT {
+			tasks.clear();
+			convertChannel.clear();
+			convertBatchPointer = nullptr;
+		};
+
+		// each output is written by its own coroutine, and by default each of them gets its own thread
+		// (they're only ever waiting on the disk, or on the converters)
+		size_t outputs = profilePointerVector.size() + 1;
+		size_t outputThreads = maxOutputThreads ? __min((size_t)maxOutputThreads, outputs) : outputs;
+
+		Work::Stage outputStage(outputThreads);
+		Work::Stage convertStage(maxThreads);
+
+		SCOPE_EXIT {
+			convertChannel.clear();
+		};
+
+		outputStage.spawn(outputCoroutine(tasks, Work::Output::FILE_NAME, nullptr, nullptr));
+
+		for (
+			auto profilePointerVectorIterator = profilePointerVector.begin();
+			profilePointerVectorIterator != profilePointerVector.end();
+			profilePointerVectorIterator++
+		) {
+			Profile &profile = **profilePointerVectorIterator;
+			outputStage.spawn(outputCoroutine(profile.tasks, profile.outputFileName.c_str(), nullptr, nullptr));
+		}
+
+		for (uint32_t i = 0; i < maxThreads; i++) {
+			convertStage.spawn(convertCoroutine(convertChannel));
+		}
+
+		try {
+			fixLoading(inputFileStream, inputFileStream.tellg(), inputFile, log);
+		} catch (const std::system_error&) {
+			throw Aborted("Fixing Loading for Profiles failed due to a system error.");
+		} catch (const std::invalid_argument&) {
+			throw Aborted("Fixing Loading for Profiles failed due to an invalid argument.");
+		}
+
+		log.finishing();
+
+		convertChannel.close();
+		convertStage.join();
+
+		// necessary to wake up the output stage one last time at the end
+		Work::FileTask::Pointer fileTaskPointer = std::make_shared<Work::FileTask>(-1, &inputFile);
+		fileTaskPointer->complete();
+		tasks.fileChannel.push(fileTaskPointer);
+
+		for (
+			auto profilePointerVectorIterator = profilePointerVector.begin();
+			profilePointerVectorIterator != profilePointerVector.end();
+			profilePointerVectorIterator++
+		) {
+			Profile &profile = **profilePointerVectorIterator;
+
+			Work::FileTask::Pointer profileFileTaskPointer = std::make_shared<Work::FileTask>(-1, profile.inputFilePointer.get());
+			profileFileTaskPointer->complete();
+			profile.tasks.fileChannel.push(profileFileTaskPointer);
+		}
+
+		outputStage.join();
+
+		if (logStalls) {
+			Log::stalls(convertChannel);
+			Log::stalls(Work::Output::FILE_NAME, tasks);
+
+			for (
+				auto profilePointerVectorIterator = profilePointerVector.begin();
+				profilePointerVectorIterator != profilePointerVector.end();
+				profilePointerVectorIterator++
+			) {
+				Profile &profile = **profilePointerVectorIterator;
+				Log::stalls(profile.outputFileName.c_str(), profile.tasks);
+			}
+		}
+	}
+
+	// here I use std::filesystem::rename because I do want to overwrite the outputs from last time
+	OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(Work::Output::FILE_NAME, Profile::getPath(NUMBER)),
+		std::filesystem::filesystem_error, Work::Output::FILE_RETRY);
+
+	for (
+		auto profilePointerVectorIterator = profilePointerVector.begin();
+		profilePointerVectorIterator != profilePointerVector.end();
+		profilePointerVectorIterator++
+	) {
+		const Profile &profile = **profilePointerVectorIterator;
+
+		OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(profile.outputFileName, profile.path),
+			std::filesystem::filesystem_error, Work::Output::FILE_RETRY);
+	}
 }
 
 void M4Revolution::restoreBackup() {
@@ -1398,7 +2530,7 @@ void M4Revolution::restoreBackup() {
 	) {
 		// we assume these files will stick around until after the yes or no prompt
 		// it should cause an error if they don't
-		if (std::filesystem::is_regular_file(Work::Backup::getPath(infoMapIterator->second.path))) {
+		if (Work::Backup::exists(infoMapIterator->second.path)) {
 			filePath |= infoMapIterator->first;
 		}
 	}
@@ -1420,4 +2552,26 @@ void M4Revolution::restoreBackup() {
 			Work::Backup::restore(infoMapIterator->second.path);
 		}
 	}
+}
+
+void M4Revolution::apply(const Batch &batch) {
+	// every operation here is on a different file, except for Fix Loading and Transition Time
+	// which fixLoading does together
+	if (batch.fullScreenOptional.has_value()) {
+		toggleFullScreen(batch.fullScreenOptional);
+	}
+
+	if (batch.cameraInertiaOptional.has_value()) {
+		toggleCameraInertia(batch.cameraInertiaOptional);
+	}
+
+	if (batch.soundFadeOutTimeOptional.has_value()) {
+		editSoundFadeOutTime(batch.soundFadeOutTimeOptional);
+	}
+
+	if (batch.fixLoading) {
+		fixLoading(batch.transitionTimeOptional);
+	} else if (batch.transitionTimeOptional.has_value()) {
+		editTransitionTime(batch.transitionTimeOptional);
+	}
 }
\ No newline at end of file
@@ -10,6 +10,16 @@
 #define TO_NEXT_POWER_OF_TWO
 #endif
 
+// large images are compressed in stripes so they never need to fit in a surface all at once
+// and images are only ever shrunk, so we can resize them ourselves instead of nvtt doing it
+// (neither can be done if nvtt needs the whole surface to make it square or power of two)
+#ifndef EXTENTS_MAKE_SQUARE
+#ifndef EXTENTS_MAKE_POWER_OF_TWO
+#define STRIPES_ENABLED
+#define RESAMPLE_ENABLED
+#endif
+#endif
+
 class M4Revolution : NonCopyable {
 	private:
 	void destroy();
@@ -25,8 +35,12 @@ class M4Revolution : NonCopyable {
 		int files = 0;
 		int filesCopying = 0;
 
+		static long long getMilliseconds(Work::Stalls::Clock::duration duration);
+
 		public:
 		static void replaced(const std::string &file);
+		static void stalls(Work::ConvertChannel &convertChannel);
+		static void stalls(const char* fileName, Work::Tasks &tasks);
 
 		Log(
 			const std::string &title,
@@ -51,6 +65,11 @@ class M4Revolution : NonCopyable {
 
 		public:
 		CompressionOptions();
+
+		const nvtt::CompressionOptions &get(
+			const Ubi::BigFile::File &file, int width, int height, int depth, bool hasAlpha
+		) const;
+
 		const nvtt::CompressionOptions &get(
 			const Ubi::BigFile::File &file, const nvtt::Surface &surface, bool hasAlpha
 		) const;
@@ -76,18 +95,70 @@ class M4Revolution : NonCopyable {
 	};
 
 	bool logFileNames = false;
+	bool logStalls = false;
+	bool deterministic = false;
+	bool incremental = false;
 
 	nvtt::Context context;
 
-	#ifdef MULTITHREADED
-	PTP_POOL pool = NULL;
-	#endif
+	// the number 216 was chosen for being the standard number of tiles in a cube
+	static constexpr Work::FileTask::Channel::Size DEFAULT_MAX_FILE_TASKS = 216;
 
-	Work::FileTask::PointerQueue::size_type maxFileTasks = 0;
+	// Fix Loading is split into stages, each with its own number of threads
+	// the input is read on the calling thread (it's one stream, read from beginning to end)
+	// then the files are converted on the convert stage, and written (in order) on the output stage
+	uint32_t maxThreads = 0;
+	uint32_t maxOutputThreads = 0;
+	Work::FileTask::Channel::Size maxFileTasks = 0;
 	Work::Convert::Configuration configuration;
-	Work::Tasks tasks = {};
+	Work::Tasks tasks;
+
+	// only as many files wait to be converted as there are converters, so none of them sit idle while the next is read
+	// (the output stage can only write them in order anyway, so the rest of the input is read as they are taken)
+	Work::ConvertChannel convertChannel;
+	Work::ConvertBatch::Pointer convertBatchPointer = nullptr;
+	std::optional<Work::Cache> cacheOptional = std::nullopt;
+
+	// the paths of the files in the BigFiles being fixed, only kept if there's a trace to find them in
+	using LayoutPathMap = std::unordered_map<const Ubi::BigFile::File*, std::string>;
+	using LayoutGroupVector = std::vector<Ubi::BigFile::File::PointerSetMap::iterator>;
+
+	Work::Layout layout = {};
+	LayoutPathMap layoutPathMap = {};
 
-	void waitFiles(Work::FileTask::PointerQueue::size_type fileTasks);
+	// when fixing loading for several profiles at once, each profile after the first has one of these
+	// the BigFiles are read again into its own copy of them (because the sizes of the converted files differ)
+	// and it has its own output coroutine, writing to its own output
+	struct Profile : NonCopyable {
+		using FilePointerMap = std::unordered_map<const Ubi::BigFile::File*, Ubi::BigFile::File::Pointer>;
+		using Number = unsigned int;
+
+		Work::Convert::Configuration configuration = {};
+		Work::Tasks tasks;
+
+		std::string outputFileName = "";
+		std::filesystem::path path = {};
+
+		Ubi::BigFile::File::Pointer inputFilePointer = nullptr;
+
+		// the files in the BigFiles being fixed, to this profile's copy of them
+		FilePointerMap filePointerMap = {};
+
+		static std::filesystem::path getPath(Number number);
+
+		Profile(const Work::Convert::Configuration &configuration, const Ubi::BigFile::File &inputFile, Number number,
+			Work::FileTask::Channel::Size maxFileTasks);
+		void mapFiles(const Ubi::BigFile::Directory &directory, const Ubi::BigFile::Directory &profileDirectory);
+		void mapFiles(const Ubi::BigFile::File::PointerVector &filePointerVector, const Ubi::BigFile::File::PointerVector &profileFilePointerVector);
+		Ubi::BigFile::File::Pointer getFilePointer(const Ubi::BigFile::File &file) const;
+		Ubi::BigFile::File::PointerVectorPointer getFilePointerVectorPointer(const Ubi::BigFile::File::PointerVector &filePointerVector) const;
+	};
+
+	using ProfilePointerVector = std::vector<std::unique_ptr<Profile>>;
+
+	ProfilePointerVector profilePointerVector = {};
+
+	void pushFileTask(Work::Tasks &tasks, const Work::FileTask::Pointer &fileTaskPointer);
 
 	void copyFiles(
 		std::istream &inputStream,
@@ -112,6 +183,9 @@ class M4Revolution : NonCopyable {
 		Log &log
 	);
 
+	void convertBatch();
+	void loadCache();
+
 	void stepFile(
 		Ubi::BigFile::File::Size inputOffset,
 		Ubi::BigFile::File::Size &inputFileOffset,
@@ -120,76 +194,56 @@ class M4Revolution : NonCopyable {
 		Log &log
 	);
 
+	void getLayoutPaths(const Ubi::BigFile::Directory &directory, std::string path);
+	Work::Layout::Rank getLayoutRank(const Ubi::BigFile::File::PointerSet &filePointerSet) const;
+
+	void layOut(
+		const Ubi::BigFile::File &file,
+		const Ubi::BigFile::Directory &directory,
+		Ubi::BigFile::File::PointerSetMap &filePointerSetMap,
+		LayoutGroupVector &layoutGroupVector
+	);
+
 	void fixLoading(std::istream &inputStream,
 		const std::streampos &ownerBigFileInputPosition, Ubi::BigFile::File &file, Log &log);
 
 	static const Ubi::BigFile::Path::Vector TRANSITION_FADE_PATH_VECTOR;
 	static const CompressionOptions COMPRESSION_OPTIONS;
 
-	static void toggleFullScreen(std::ifstream &inputFileStream);
-	static void toggleCameraInertia(std::fstream &fileStream);
-	static void editSoundFadeOutTime(std::fstream &fileStream);
-	static void editTransitionTime(std::fstream &fileStream);
+	static void toggleFullScreen(std::ifstream &inputFileStream, std::optional<bool> toggledOnOptional);
+	static void toggleCameraInertia(std::fstream &fileStream, std::optional<bool> toggledOnOptional);
+	static void editSoundFadeOutTime(std::fstream &fileStream, std::optional<unsigned long> timeOptional);
+	static void editTransitionTime(std::fstream &fileStream, const std::filesystem::path &path,
+		std::optional<float> timeOptional, bool backup = true);
 	#ifdef WINDOWS
 	static void replaceGfxTools();
 	#endif
 	static Ubi::BigFile::File createInputFile(std::istream &inputStream);
+	static Work::Convert::Extent getMaxExtent(const Work::Convert::Configuration &configuration, int width, int height, int depth);
+	#ifdef RESAMPLE_ENABLED
+	static bool getResizeExtent(Work::Convert::Extent maxExtent, int &width, int &height);
+	static void resizeSurface(nvtt::Surface &surface, Work::Convert::Extent maxExtent);
+	#endif
+	static void fitSurface(Work::Convert &convert, nvtt::Surface &surface);
 	static void convertSurface(Work::Convert &convert, nvtt::Surface &surface, bool hasAlpha);
-	static void convertImageStandardWorkCallback(Work::Convert* convertPointer);
-	static void convertImageZAPWorkCallback(Work::Convert* convertPointer);
-	static void convertFileWorkCallback(Work::Convert* convertPointer) noexcept;
-	#ifdef MULTITHREADED
-	static VOID CALLBACK convertFileProc(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work);
+	#ifdef STRIPES_ENABLED
+	static bool isStripes(int width, int height);
+	static void convertStripes(Work::Convert &convert, unsigned char* imagePointer, int width, int height, size_t stride, bool hasAlpha);
 	#endif
+	static bool convertImageStandardWorkCallback(Work::Convert &convert, nvtt::Surface &surface, bool &hasAlpha);
+	static bool convertImageZAPWorkCallback(Work::Convert &convert, nvtt::Surface &surface, bool &hasAlpha);
+	static void convertFileWorkCallback(Work::Convert &convert) noexcept;
+	static void convertBatchWorkCallback(Work::ConvertBatch &convertBatch) noexcept;
+	static Work::Coroutine convertCoroutine(Work::ConvertChannel &convertChannel);
 	static bool outputBigFiles(Work::Output &output, std::streamoff bigFileInputOffset, Work::Tasks &tasks);
-	static void outputData(std::ostream &outputStream, Work::FileTask &fileTask, bool &yield);
+	static void outputData(std::ostream &outputStream, const Work::Data &data,
+		Hash* hashPointer = nullptr, std::ostream* cacheOutputStreamPointer = nullptr);
 	static void outputFiles(Work::Output &output, Work::FileTask::FileVariant &fileVariant);
-	static void outputThread(Work::Tasks &tasks, bool &yield);
-	#ifdef WINDOWS
-	static bool getDLLExportRVA(const char* libFileName, const char* procName, unsigned long &dllExportRVA);
-
-	template <typename IMAGE_NT_HEADERSXX>
-	static unsigned long getOffsetFromRVA(IMAGE_NT_HEADERSXX* imageNtHeadersPointer, unsigned long rva) {
-		if (!imageNtHeadersPointer) {
-			throw std::invalid_argument("imageNtHeadersPointer must not be NULL");
-		}
-		
-		IMAGE_NT_HEADERSXX &imageNtHeaders = *imageNtHeadersPointer;
-
-		if (imageNtHeaders.Signature != IMAGE_NT_SIGNATURE) {
-			throw std::invalid_argument("Signature must be IMAGE_NT_SIGNATURE");
-		}
-
-		// if it's in the PE header, the RVA is equivalent to the offset
-		if (rva < imageNtHeaders.OptionalHeader.SizeOfHeaders) {
-			return rva;
-		}
-
-		PIMAGE_SECTION_HEADER imageSectionHeaderPointer = (PIMAGE_SECTION_HEADER)(imageNtHeadersPointer + 1);
-
-		for (WORD i = 0; i < imageNtHeaders.FileHeader.NumberOfSections; i++) {
-			IMAGE_SECTION_HEADER &imageSectionHeader = *imageSectionHeaderPointer++;
-
-			// test the RVA falls within the section's virtual memory
-			if (rva - imageSectionHeader.VirtualAddress >= imageSectionHeader.Misc.VirtualSize) {
-				continue;
-			}
-
-			// now turn it into the offset
-			rva += imageSectionHeader.PointerToRawData - imageSectionHeader.VirtualAddress;
-
-			// test the offset falls within initialized data
-			if (rva - imageSectionHeader.PointerToRawData >= imageSectionHeader.SizeOfRawData) {
-				throw std::invalid_argument("rva must not point to uninitialized data");
-			}
-			return rva;
-		}
-
-		throw std::out_of_range("rva out of bounds");
-	}
-
-	static unsigned long getOffsetFromRVA(std::istream &inputStream, unsigned long rva);
-	#endif
+	static Work::Coroutine outputCoroutine(Work::Tasks &tasks, const char* fileName, Work::Manifest* manifestPointer, std::ostream* cacheOutputStreamPointer);
+	static void verifyManifest(const Work::Manifest &manifest);
+	static void writeManifest(const Work::Manifest &manifest);
+	static void replaceCache();
+	static uint32_t getMaxThreads(uint32_t maxThreads);
 
 	public:
 	class Aborted : public std::logic_error {
@@ -198,20 +252,42 @@ class M4Revolution : NonCopyable {
 		}
 	};
 
+	static constexpr unsigned long SOUND_FADE_OUT_TIME_MIN = 0;
+	static constexpr unsigned long SOUND_FADE_OUT_TIME_MAX = 1000;
+	static constexpr float TRANSITION_TIME_MIN = 0.0f;
+	static constexpr float TRANSITION_TIME_MAX = 500.0f;
+
+	// the operations to perform all at once, without asking (for the --apply argument)
+	// these are the values to set, so they are not toggles
+	struct Batch {
+		std::optional<bool> fullScreenOptional = std::nullopt;
+		std::optional<bool> cameraInertiaOptional = std::nullopt;
+		std::optional<unsigned long> soundFadeOutTimeOptional = std::nullopt;
+		std::optional<float> transitionTimeOptional = std::nullopt;
+		bool fixLoading = false;
+	};
+
 	M4Revolution(
 		const std::filesystem::path &path,
 		bool logFileNames = false,
+		bool logStalls = false,
 		bool disableHardwareAcceleration = false,
+		bool deterministic = false,
+		bool incremental = false,
 		uint32_t maxThreads = 0,
-		Work::FileTask::PointerQueue::size_type maxFileTasks = 0,
-		std::optional<Work::Convert::Configuration> configurationOptional = std::nullopt
+		Work::FileTask::Channel::Size maxFileTasks = 0,
+		uint32_t maxOutputThreads = 0,
+		std::optional<Work::Convert::Configuration> configurationOptional = std::nullopt,
+		const Work::Layout &layout = {}
 	);
 	
 	~M4Revolution();
-	void toggleFullScreen();
-	void toggleCameraInertia();
-	void editSoundFadeOutTime();
-	void editTransitionTime();
-	void fixLoading();
+	void toggleFullScreen(std::optional<bool> toggledOnOptional = std::nullopt);
+	void toggleCameraInertia(std::optional<bool> toggledOnOptional = std::nullopt);
+	void editSoundFadeOutTime(std::optional<unsigned long> timeOptional = std::nullopt);
+	void editTransitionTime(std::optional<float> timeOptional = std::nullopt);
+	void fixLoading(std::optional<float> transitionTimeOptional = std::nullopt);
+	void fixLoadingProfiles(const Work::Convert::ConfigurationVector &configurationVector);
 	void restoreBackup();
+	void apply(const Batch &batch);
 };
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "pch.h"
+#include "PortableExecutable.h"
+
+static constexpr uint16_t DOS_SIGNATURE = 0x5A4D; // MZ
+static constexpr uint32_t NT_SIGNATURE = 0x00004550; // PE\0\0
+
+static constexpr uint16_t NT_OPTIONAL_HDR32_MAGIC = 0x10B;
+static constexpr uint16_t NT_OPTIONAL_HDR64_MAGIC = 0x20B;
+
+// these are the offsets of the fields we need, from the start of their structures
+// (which are the same as the Windows SDK's, we just can't use those off of Windows)
+static constexpr size_t DOS_HEADER_E_LFANEW = 0x3C;
+
+static constexpr size_t NT_HEADERS_FILE_HEADER = 0x04;
+static constexpr size_t NT_HEADERS_OPTIONAL_HEADER = 0x18;
+
+static constexpr size_t FILE_HEADER_NUMBER_OF_SECTIONS = 0x02;
+static constexpr size_t FILE_HEADER_SIZE_OF_OPTIONAL_HEADER = 0x10;
+
+static constexpr size_t OPTIONAL_HEADER_SIZE_OF_HEADERS = 0x3C;
+
+// only the data directories are in a different place for PE32+, because ImageBase is bigger
+static constexpr size_t OPTIONAL_HEADER32_NUMBER_OF_RVA_AND_SIZES = 0x5C;
+static constexpr size_t OPTIONAL_HEADER32_DATA_DIRECTORY = 0x60;
+static constexpr size_t OPTIONAL_HEADER64_NUMBER_OF_RVA_AND_SIZES = 0x6C;
+static constexpr size_t OPTIONAL_HEADER64_DATA_DIRECTORY = 0x70;
+
+static constexpr uint32_t DIRECTORY_ENTRY_EXPORT = 0;
+static constexpr size_t DATA_DIRECTORY_SIZE = 0x08;
+
+static constexpr size_t SECTION_HEADER_VIRTUAL_SIZE = 0x08;
+static constexpr size_t SECTION_HEADER_VIRTUAL_ADDRESS = 0x0C;
+static constexpr size_t SECTION_HEADER_SIZE_OF_RAW_DATA = 0x10;
+static constexpr size_t SECTION_HEADER_POINTER_TO_RAW_DATA = 0x14;
+static constexpr size_t SECTION_HEADER_SIZE = 0x28;
+
+static constexpr size_t EXPORT_DIRECTORY_NUMBER_OF_FUNCTIONS = 0x14;
+static constexpr size_t EXPORT_DIRECTORY_NUMBER_OF_NAMES = 0x18;
+static constexpr size_t EXPORT_DIRECTORY_ADDRESS_OF_FUNCTIONS = 0x1C;
+static constexpr size_t EXPORT_DIRECTORY_ADDRESS_OF_NAMES = 0x20;
+static constexpr size_t EXPORT_DIRECTORY_ADDRESS_OF_NAME_ORDINALS = 0x24;
+static constexpr size_t EXPORT_DIRECTORY_SIZE = 0x28;
+
+PortableExecutable::PortableExecutable(std::istream &inputStream) {
+	std::streampos position = inputStream.tellg();
+
+	SCOPE_EXIT {
+		inputStream.seekg(position);
+	};
+
+	inputStream.seekg(0, std::ios::end);
+	size = (size_t)inputStream.tellg();
+	inputStream.seekg(0);
+
+	pointer = makeUniqueArray<unsigned char>(size);
+	readStream(inputStream, pointer.get(), (std::streamsize)size);
+
+	if (read<uint16_t>(0) != DOS_SIGNATURE) {
+		throw std::invalid_argument("e_magic must be IMAGE_DOS_SIGNATURE");
+	}
+
+	size_t ntHeadersOffset = read<uint32_t>(DOS_HEADER_E_LFANEW);
+
+	if (read<uint32_t>(ntHeadersOffset) != NT_SIGNATURE) {
+		throw std::invalid_argument("Signature must be IMAGE_NT_SIGNATURE");
+	}
+
+	size_t fileHeaderOffset = ntHeadersOffset + NT_HEADERS_FILE_HEADER;
+	size_t optionalHeaderOffset = ntHeadersOffset + NT_HEADERS_OPTIONAL_HEADER;
+
+	numberOfSections = read<uint16_t>(fileHeaderOffset + FILE_HEADER_NUMBER_OF_SECTIONS);
+	sectionHeadersOffset = optionalHeaderOffset + read<uint16_t>(fileHeaderOffset + FILE_HEADER_SIZE_OF_OPTIONAL_HEADER);
+
+	// make sure all the section headers are here now, so getOffsetFromRVA doesn't need to
+	if (numberOfSections) {
+		read<uint32_t>(sectionHeadersOffset + ((size_t)numberOfSections * SECTION_HEADER_SIZE) - sizeof(uint32_t));
+	}
+
+	sizeOfHeaders = read<RVA>(optionalHeaderOffset + OPTIONAL_HEADER_SIZE_OF_HEADERS);
+
+	size_t numberOfRvaAndSizesOffset = 0;
+	size_t dataDirectoryOffset = 0;
+
+	switch (read<uint16_t>(optionalHeaderOffset)) {
+		case NT_OPTIONAL_HDR32_MAGIC:
+		numberOfRvaAndSizesOffset = optionalHeaderOffset + OPTIONAL_HEADER32_NUMBER_OF_RVA_AND_SIZES;
+		dataDirectoryOffset = optionalHeaderOffset + OPTIONAL_HEADER32_DATA_DIRECTORY;
+		break;
+		case NT_OPTIONAL_HDR64_MAGIC:
+		numberOfRvaAndSizesOffset = optionalHeaderOffset + OPTIONAL_HEADER64_NUMBER_OF_RVA_AND_SIZES;
+		dataDirectoryOffset = optionalHeaderOffset + OPTIONAL_HEADER64_DATA_DIRECTORY;
+		break;
+		default:
+		throw std::invalid_argument("Magic must be IMAGE_NT_OPTIONAL_HDR32_MAGIC or IMAGE_NT_OPTIONAL_HDR64_MAGIC");
+	}
+
+	// a file with no exports is still valid, there just won't be anything to find
+	if (read<uint32_t>(numberOfRvaAndSizesOffset) <= DIRECTORY_ENTRY_EXPORT) {
+		return;
+	}
+
+	size_t exportDataDirectoryOffset = dataDirectoryOffset + (DIRECTORY_ENTRY_EXPORT * DATA_DIRECTORY_SIZE);
+	exportDirectoryRVA = read<RVA>(exportDataDirectoryOffset);
+	exportDirectorySize = read<RVA>(exportDataDirectoryOffset + sizeof(RVA));
+}
+
+bool PortableExecutable::getExportRVA(const char* name, RVA &rva) const {
+	if (!name) {
+		throw std::invalid_argument("name must not be NULL");
+	}
+
+	if (!exportDirectoryRVA) {
+		return false;
+	}
+
+	size_t exportDirectoryOffset = getOffsetFromRVA(exportDirectoryRVA, EXPORT_DIRECTORY_SIZE);
+
+	uint32_t numberOfFunctions = read<uint32_t>(exportDirectoryOffset + EXPORT_DIRECTORY_NUMBER_OF_FUNCTIONS);
+	uint32_t numberOfNames = read<uint32_t>(exportDirectoryOffset + EXPORT_DIRECTORY_NUMBER_OF_NAMES);
+
+	if (!numberOfFunctions || !numberOfNames) {
+		return false;
+	}
+
+	size_t addressOfFunctionsOffset = getOffsetFromRVA(
+		read<RVA>(exportDirectoryOffset + EXPORT_DIRECTORY_ADDRESS_OF_FUNCTIONS),
+		(size_t)numberOfFunctions * sizeof(RVA)
+	);
+
+	size_t addressOfNamesOffset = getOffsetFromRVA(
+		read<RVA>(exportDirectoryOffset + EXPORT_DIRECTORY_ADDRESS_OF_NAMES),
+		(size_t)numberOfNames * sizeof(RVA)
+	);
+
+	size_t addressOfNameOrdinalsOffset = getOffsetFromRVA(
+		read<RVA>(exportDirectoryOffset + EXPORT_DIRECTORY_ADDRESS_OF_NAME_ORDINALS),
+		(size_t)numberOfNames * sizeof(uint16_t)
+	);
+
+	// the name pointer table is sorted (so that the loader can do this too)
+	size_t low = 0;
+	size_t high = numberOfNames;
+
+	while (low < high) {
+		size_t middle = low + ((high - low) / 2);
+
+		int comparison = strcmp(name, readString(getOffsetFromRVA(read<RVA>(addressOfNamesOffset + (middle * sizeof(RVA))))));
+
+		if (comparison < 0) {
+			high = middle;
+			continue;
+		}
+
+		if (comparison > 0) {
+			low = middle + 1;
+			continue;
+		}
+
+		uint16_t ordinal = read<uint16_t>(addressOfNameOrdinalsOffset + (middle * sizeof(uint16_t)));
+
+		if (ordinal >= numberOfFunctions) {
+			throw std::out_of_range("ordinal out of bounds");
+		}
+
+		RVA functionRVA = read<RVA>(addressOfFunctionsOffset + ((size_t)ordinal * sizeof(RVA)));
+
+		// a forwarder is the name of an export in another DLL, not code that's in this one
+		if (functionRVA - exportDirectoryRVA < exportDirectorySize) {
+			throw std::invalid_argument("export must not be forwarded");
+		}
+
+		rva = functionRVA;
+		return true;
+	}
+	return false;
+}
+
+PortableExecutable::Offset PortableExecutable::getOffsetFromRVA(RVA rva) const {
+	return getOffsetFromRVA(rva, 0);
+}
+
+const char* PortableExecutable::readString(size_t offset) const {
+	if (offset >= size) {
+		throw std::out_of_range("offset out of bounds");
+	}
+
+	const char* str = (const char*)pointer.get() + offset;
+
+	if (!memchr(str, 0, size - offset)) {
+		throw std::out_of_range("str must be null terminated");
+	}
+	return str;
+}
+
+PortableExecutable::Offset PortableExecutable::getOffsetFromRVA(RVA rva, size_t size) const {
+	// if it's in the PE header, the RVA is equivalent to the offset
+	if (rva < sizeOfHeaders) {
+		if (size > sizeOfHeaders - rva) {
+			throw std::out_of_range("rva out of bounds");
+		}
+		return rva;
+	}
+
+	size_t sectionHeaderOffset = sectionHeadersOffset;
+
+	for (uint16_t i = 0; i < numberOfSections; i++) {
+		RVA virtualSize = read<RVA>(sectionHeaderOffset + SECTION_HEADER_VIRTUAL_SIZE);
+		RVA virtualAddress = read<RVA>(sectionHeaderOffset + SECTION_HEADER_VIRTUAL_ADDRESS);
+		uint32_t sizeOfRawData = read<uint32_t>(sectionHeaderOffset + SECTION_HEADER_SIZE_OF_RAW_DATA);
+		uint32_t pointerToRawData = read<uint32_t>(sectionHeaderOffset + SECTION_HEADER_POINTER_TO_RAW_DATA);
+
+		sectionHeaderOffset += SECTION_HEADER_SIZE;
+
+		// test the RVA falls within the section's virtual memory
+		if (rva - virtualAddress >= virtualSize) {
+			continue;
+		}
+
+		// now turn it into the offset
+		RVA sectionRVA = rva - virtualAddress;
+
+		// test the offset (and everything after it that was asked for) falls within initialized data
+		if (sectionRVA >= sizeOfRawData || size > sizeOfRawData - sectionRVA) {
+			throw std::invalid_argument("rva must not point to uninitialized data");
+		}
+		return pointerToRawData + sectionRVA;
+	}
+
+	throw std::out_of_range("rva out of bounds");
+}
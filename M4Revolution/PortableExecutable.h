@@ -0,0 +1,49 @@
+#pragma once
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// reads the exports of a PE32 or PE32+ file (like the game's DLLs) without loading it
+// so it works the same on any platform, and for any version of the game
+// the file is read into one buffer up front, then every lookup is done in that buffer
+class PortableExecutable : NonCopyable {
+	public:
+	using RVA = uint32_t;
+	using Offset = uint32_t;
+
+	PortableExecutable(std::istream &inputStream);
+
+	// names are looked up exactly as exported (so decorated C++ names must be decorated)
+	// returns false if there is no such export
+	bool getExportRVA(const char* name, RVA &rva) const;
+	Offset getOffsetFromRVA(RVA rva) const;
+
+	private:
+	template <typename Value>
+	Value read(size_t offset) const {
+		if (offset > size || size - offset < sizeof(Value)) {
+			throw std::out_of_range("offset out of bounds");
+		}
+
+		// PE files are little endian, and so are all the platforms we build for
+		Value value = 0;
+		memcpy(&value, pointer.get() + offset, sizeof(value));
+		return value;
+	}
+
+	const char* readString(size_t offset) const;
+	Offset getOffsetFromRVA(RVA rva, size_t size) const;
+
+	std::unique_ptr<unsigned char[]> pointer = nullptr;
+	size_t size = 0;
+
+	RVA sizeOfHeaders = 0;
+	size_t sectionHeadersOffset = 0;
+	uint16_t numberOfSections = 0;
+
+	RVA exportDirectoryRVA = 0;
+	RVA exportDirectorySize = 0;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define SIMD_X86
+	#include <immintrin.h>
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+	#define SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+// MSVC lets any function use any instruction set, but GCC and Clang
+// need to be told which functions are allowed to (so they can be dispatched at runtime)
+#if defined(SIMD_X86) && defined(__GNUC__)
+	#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+	#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define SIMD_TARGET_SSE41
+	#define SIMD_TARGET_AVX2
+#endif
+
+namespace SIMD {
+	// these are in order, so a level also supports everything before it
+	// (except NEON, which is on a different architecture altogether)
+	enum struct Level {
+		NONE,
+		SSE41,
+		AVX2,
+		NEON
+	};
+
+	#ifdef SIMD_X86
+	inline void cpuid(int leaf, int subleaf, int (&registers)[4]) {
+		#ifdef _MSC_VER
+		__cpuidex(registers, leaf, subleaf);
+		#else
+		unsigned int eax = 0;
+		unsigned int ebx = 0;
+		unsigned int ecx = 0;
+		unsigned int edx = 0;
+
+		if (!__get_cpuid_count((unsigned int)leaf, (unsigned int)subleaf, &eax, &ebx, &ecx, &edx)) {
+			eax = 0;
+			ebx = 0;
+			ecx = 0;
+			edx = 0;
+		}
+
+		registers[0] = (int)eax;
+		registers[1] = (int)ebx;
+		registers[2] = (int)ecx;
+		registers[3] = (int)edx;
+		#endif
+	}
+
+	inline unsigned long long xgetbv(unsigned int index) {
+		#ifdef _MSC_VER
+		return _xgetbv(index);
+		#else
+		unsigned int eax = 0;
+		unsigned int edx = 0;
+		__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+		return ((unsigned long long)edx << 32) | eax;
+		#endif
+	}
+	#endif
+
+	inline Level detectLevel() {
+		#ifdef SIMD_NEON
+		// NEON is mandatory on ARM64
+		return Level::NEON;
+		#elif defined(SIMD_X86)
+		static constexpr int LEAF_MAX = 0;
+		static constexpr int LEAF_FEATURES = 1;
+		static constexpr int LEAF_EXTENDED_FEATURES = 7;
+
+		static constexpr int REGISTER_EAX = 0;
+		static constexpr int REGISTER_EBX = 1;
+		static constexpr int REGISTER_ECX = 2;
+
+		static constexpr int ECX_SSE41 = 1 << 19;
+		static constexpr int ECX_OSXSAVE = 1 << 27;
+		static constexpr int ECX_AVX = 1 << 28;
+		static constexpr int EBX_AVX2 = 1 << 5;
+
+		// the OS must save the XMM and YMM registers on a context switch for AVX to be usable
+		static constexpr unsigned long long XCR0_XMM_YMM = 0x6;
+
+		int registers[4] = {};
+		cpuid(LEAF_MAX, 0, registers);
+
+		int leafMax = registers[REGISTER_EAX];
+
+		if (leafMax < LEAF_FEATURES) {
+			return Level::NONE;
+		}
+
+		cpuid(LEAF_FEATURES, 0, registers);
+
+		int ecx = registers[REGISTER_ECX];
+
+		if (!(ecx & ECX_SSE41)) {
+			return Level::NONE;
+		}
+
+		if (leafMax < LEAF_EXTENDED_FEATURES
+			|| !(ecx & ECX_OSXSAVE)
+			|| !(ecx & ECX_AVX)
+			|| (xgetbv(0) & XCR0_XMM_YMM) != XCR0_XMM_YMM) {
+			return Level::SSE41;
+		}
+
+		cpuid(LEAF_EXTENDED_FEATURES, 0, registers);
+		return (registers[REGISTER_EBX] & EBX_AVX2) ? Level::AVX2 : Level::SSE41;
+		#else
+		return Level::NONE;
+		#endif
+	}
+
+	// detected once, when we're loaded
+	// (the benchmarks define SIMD_LEVEL to build a copy for each level, to compare them)
+	#ifdef SIMD_LEVEL
+	inline const Level LEVEL = Level::SIMD_LEVEL;
+	#else
+	inline const Level LEVEL = detectLevel();
+	#endif
+}
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "Stage.h"
+
+namespace Work {
+	static thread_local Stage* currentStagePointer = nullptr;
+
+	void Stalls::add(Clock::duration &duration, const Clock::time_point &begin) {
+		duration += Clock::now() - begin;
+	}
+
+	void Coroutine::FinalAwaiter::await_suspend(Handle handle) noexcept {
+		handle.promise().stagePointer->finish(handle);
+	}
+
+	Coroutine::Coroutine(Handle handle) noexcept
+		: handle(handle) {
+	}
+
+	Coroutine::Coroutine(Coroutine &&coroutine) noexcept
+		: handle(std::exchange(coroutine.handle, nullptr)) {
+	}
+
+	// if it was never spawned, it never started
+	Coroutine::~Coroutine() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	Stage::Stage(size_t threads) {
+		threads = __max(threads, (size_t)1);
+
+		for (size_t i = 0; i < threads; i++) {
+			threadVector.emplace_back(&Stage::thread, this);
+		}
+	}
+
+	Stage::~Stage() {
+		stop();
+
+		// these are all waiting on a channel, for something that will never come
+		// (destroying them takes them out of the channel, so they won't be resumed later)
+		for (
+			auto handleAddressSetIterator = handleAddressSet.begin();
+			handleAddressSetIterator != handleAddressSet.end();
+			handleAddressSetIterator++
+		) {
+			std::coroutine_handle<>::from_address(*handleAddressSetIterator).destroy();
+		}
+	}
+
+	void Stage::spawn(Coroutine coroutine) {
+		Coroutine::Handle handle = std::exchange(coroutine.handle, nullptr);
+		handle.promise().stagePointer = this;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			handleAddressSet.insert(handle.address());
+		}
+
+		post(handle);
+	}
+
+	void Stage::join() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			joinConditionVariable.wait(lock, [&] {
+				return handleAddressSet.empty();
+			});
+		}
+
+		stop();
+	}
+
+	void Stage::post(std::coroutine_handle<> handle) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			handleQueue.push(handle);
+		}
+
+		conditionVariable.notify_one();
+	}
+
+	Stage* Stage::getCurrent() {
+		return currentStagePointer;
+	}
+
+	void Stage::finish(Coroutine::Handle handle) {
+		void* handleAddress = handle.address();
+		handle.destroy();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		handleAddressSet.erase(handleAddress);
+
+		if (handleAddressSet.empty()) {
+			joinConditionVariable.notify_all();
+		}
+	}
+
+	// the threads finish whatever has already been posted to them first
+	void Stage::stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		conditionVariable.notify_all();
+
+		for (
+			auto threadVectorIterator = threadVector.begin();
+			threadVectorIterator != threadVector.end();
+			threadVectorIterator++
+		) {
+			if (threadVectorIterator->joinable()) {
+				threadVectorIterator->join();
+			}
+		}
+	}
+
+	void Stage::thread() {
+		currentStagePointer = this;
+
+		for (;;) {
+			std::coroutine_handle<> handle = nullptr;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+
+				conditionVariable.wait(lock, [&] {
+					return stopping || !handleQueue.empty();
+				});
+
+				if (handleQueue.empty()) {
+					return;
+				}
+
+				handle = handleQueue.front();
+				handleQueue.pop();
+			}
+
+			handle.resume();
+		}
+	}
+}
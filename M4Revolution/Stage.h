@@ -0,0 +1,321 @@
+#pragma once
+#include <coroutine>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+namespace Work {
+	class Stage;
+
+	// how long the stages on either side of a channel spent waiting on each other, to find which one is holding up the rest
+	struct Stalls {
+		using Clock = std::chrono::steady_clock;
+
+		// the stage before the channel waiting to push, because the channel was full (so the stage after it is behind)
+		Clock::duration push = {};
+
+		// the stage after the channel waiting to pop, because the channel was empty (so the stage before it is behind)
+		Clock::duration pop = {};
+
+		static void add(Clock::duration &duration, const Clock::time_point &begin);
+	};
+
+	// a coroutine that is run on a Stage, from when it's spawned there until it returns
+	// nothing waits on one directly, Stage::join waits on all of them at once
+	class Coroutine : NonCopyable {
+		public:
+		struct promise_type;
+		using Handle = std::coroutine_handle<promise_type>;
+
+		struct FinalAwaiter {
+			bool await_ready() noexcept {
+				return false;
+			}
+
+			void await_suspend(Handle handle) noexcept;
+
+			void await_resume() noexcept {
+			}
+		};
+
+		struct promise_type {
+			Stage* stagePointer = nullptr;
+
+			Coroutine get_return_object() noexcept {
+				return Coroutine(Handle::from_promise(*this));
+			}
+
+			// it only starts once it's spawned on a stage
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			FinalAwaiter final_suspend() noexcept {
+				return {};
+			}
+
+			void return_void() noexcept {
+			}
+
+			// like the threads these replaced, an exception getting out of one ends the program
+			// (the stages on either side of it would wait on it forever otherwise)
+			void unhandled_exception() noexcept {
+				std::terminate();
+			}
+		};
+
+		Coroutine(Coroutine &&coroutine) noexcept;
+		~Coroutine();
+
+		private:
+		friend Stage;
+
+		explicit Coroutine(Handle handle) noexcept;
+
+		Handle handle = nullptr;
+	};
+
+	// a set number of threads, that the coroutines spawned on it take turns running on
+	// so the number of threads is how many of them can be running at once
+	// a coroutine waiting on a channel gives up its thread until it can carry on, and then carries on on the same stage
+	class Stage : NonCopyable {
+		public:
+		Stage(size_t threads);
+
+		// if there are still coroutines waiting on a channel, they are destroyed without finishing
+		// (so if the stages before this one might have stopped early, they must be destroyed before this one)
+		~Stage();
+
+		void spawn(Coroutine coroutine);
+
+		// waits for every coroutine spawned here to return, then stops the threads
+		void join();
+
+		// resumes a coroutine on one of this stage's threads
+		void post(std::coroutine_handle<> handle);
+
+		// the stage of the calling thread, or nullptr if it isn't a stage's thread
+		static Stage* getCurrent();
+
+		private:
+		friend Coroutine::FinalAwaiter;
+
+		void finish(Coroutine::Handle handle);
+		void stop();
+		void thread();
+
+		std::mutex mutex = {};
+		std::condition_variable conditionVariable = {};
+		std::condition_variable joinConditionVariable = {};
+		std::queue<std::coroutine_handle<>> handleQueue = {};
+		// the addresses of the coroutines spawned here that haven't returned yet
+		std::unordered_set<void*> handleAddressSet = {};
+		bool stopping = false;
+
+		// must be last, so everything it uses is there before it starts
+		std::vector<std::thread> threadVector = {};
+	};
+
+	// a queue from one stage to the next, which holds up the stage before it once there are capacity values in it
+	// values are popped by coroutines, which give up their thread until there is one
+	// and pushed by threads, which block if it's full (because the one reading the input isn't a coroutine)
+	template <typename T> class Channel : NonCopyable {
+		public:
+		using Size = size_t;
+
+		static constexpr Size CAPACITY_MAX = SIZE_MAX;
+
+		class PopAwaiter : NonCopyable {
+			public:
+			PopAwaiter(Channel &channel)
+				: channel(channel) {
+			}
+
+			// if this coroutine is destroyed while waiting, it must not be resumed later
+			~PopAwaiter() {
+				if (suspended) {
+					channel.unlink(*this);
+				}
+			}
+
+			bool await_ready() noexcept {
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) {
+				std::lock_guard<std::mutex> lock(channel.mutex);
+
+				if (channel.take(valueOptional) || channel.closed) {
+					return false;
+				}
+
+				stagePointer = Stage::getCurrent();
+
+				if (!stagePointer) {
+					throw std::logic_error("stagePointer must not be nullptr");
+				}
+
+				this->handle = handle;
+				begin = Stalls::Clock::now();
+				suspended = true;
+				waiting = true;
+
+				channel.popAwaiterDeque.push_back(this);
+				return true;
+			}
+
+			// std::nullopt if the channel was closed, and there's nothing left in it
+			std::optional<T> await_resume() {
+				return std::move(valueOptional);
+			}
+
+			private:
+			friend Channel;
+
+			Channel &channel;
+			std::optional<T> valueOptional = std::nullopt;
+			std::coroutine_handle<> handle = nullptr;
+			Stage* stagePointer = nullptr;
+			Stalls::Clock::time_point begin = {};
+			bool suspended = false;
+
+			// only touched with the channel's mutex held
+			bool waiting = false;
+		};
+
+		Channel(Size capacity = CAPACITY_MAX)
+			: capacity(__max(capacity, (Size)1)) {
+		}
+
+		PopAwaiter pop() {
+			return PopAwaiter(*this);
+		}
+
+		// blocks while the channel is full
+		void push(T value) {
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (closed) {
+				throw std::logic_error("channel must not be closed");
+			}
+
+			Stalls::Clock::time_point begin = {};
+			bool pushWaited = false;
+
+			for (;;) {
+				// if a coroutine is already waiting, it gets this directly
+				if (!popAwaiterDeque.empty()) {
+					resume(std::move(value));
+					break;
+				}
+
+				if (valueDeque.size() < capacity) {
+					valueDeque.push_back(std::move(value));
+					break;
+				}
+
+				if (!pushWaited) {
+					begin = Stalls::Clock::now();
+					pushWaited = true;
+				}
+
+				pushWaiting++;
+
+				conditionVariable.wait(lock, [&] {
+					return valueDeque.size() < capacity || !popAwaiterDeque.empty();
+				});
+
+				pushWaiting--;
+			}
+
+			if (pushWaited) {
+				Stalls::add(stalls.push, begin);
+			}
+		}
+
+		// whether push would block
+		// (only meaningful to the thread pushing, because only it can make the channel more full)
+		bool full() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return popAwaiterDeque.empty() && valueDeque.size() >= capacity;
+		}
+
+		// there will be nothing more pushed, so the coroutines waiting get std::nullopt
+		// (after whatever is already in the channel)
+		void close() {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			closed = true;
+
+			while (!popAwaiterDeque.empty()) {
+				resume(std::nullopt);
+			}
+		}
+
+		// throws out what's left in the channel (if a stage stopped early) so it can be used again
+		void clear() {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			valueDeque.clear();
+			closed = false;
+			stalls = {};
+		}
+
+		Stalls getStalls() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return stalls;
+		}
+
+		private:
+		// these must be called with the mutex held
+		bool take(std::optional<T> &valueOptional) {
+			if (valueDeque.empty()) {
+				return false;
+			}
+
+			valueOptional.emplace(std::move(valueDeque.front()));
+			valueDeque.pop_front();
+
+			if (pushWaiting) {
+				conditionVariable.notify_one();
+			}
+			return true;
+		}
+
+		void resume(std::optional<T> valueOptional) {
+			PopAwaiter &popAwaiter = *popAwaiterDeque.front();
+			popAwaiterDeque.pop_front();
+
+			popAwaiter.valueOptional = std::move(valueOptional);
+			popAwaiter.waiting = false;
+
+			Stalls::add(stalls.pop, popAwaiter.begin);
+			popAwaiter.stagePointer->post(popAwaiter.handle);
+		}
+
+		void unlink(PopAwaiter &popAwaiter) {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (popAwaiter.waiting) {
+				popAwaiterDeque.erase(std::find(popAwaiterDeque.begin(), popAwaiterDeque.end(), &popAwaiter));
+				popAwaiter.waiting = false;
+			}
+		}
+
+		Size capacity = CAPACITY_MAX;
+
+		std::mutex mutex = {};
+		std::condition_variable conditionVariable = {};
+		std::deque<T> valueDeque = {};
+		std::deque<PopAwaiter*> popAwaiterDeque = {};
+		size_t pushWaiting = 0;
+		bool closed = false;
+		Stalls stalls = {};
+	};
+}
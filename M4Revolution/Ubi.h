@@ -236,6 +236,9 @@ namespace Ubi {
 			// the effective size of the file's padding (not stored to the file, used temporarily by the output thread)
 			Size padding = 0;
 
+			// if not zero, the output thread starts the file on a boundary of this size (also not stored to the file)
+			Size alignment = 0;
+
 			// used for water slices
 			// if this file is a layer, layerInformationPointer is non-zero and
 			// points to the layer information, and layerMapIterator is an iterator
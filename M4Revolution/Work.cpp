@@ -117,30 +117,28 @@ namespace Work {
 	FileTask::FileTask(std::streamoff ownerBigFileInputOffset,
 		Ubi::BigFile::File* filePointer)
 		: ownerBigFileInputOffset(ownerBigFileInputOffset),
-		fileVariant(filePointer),
-		event(true) {
+		fileVariant(filePointer) {
 	}
 
 	FileTask::FileTask(std::streamoff ownerBigFileInputOffset,
 		Ubi::BigFile::File::PointerVectorPointer &filePointerVectorPointer)
 		: ownerBigFileInputOffset(ownerBigFileInputOffset),
-		fileVariant(filePointerVectorPointer),
-		event(true) {
+		fileVariant(filePointerVectorPointer) {
 	}
 
-	// called in order to lock the data queue so we can add new data
-	// the Lock class ensures the output thread will automatically
-	// wake up to write it after we add the new data
-	Data::QueueLock FileTask::lock(bool &yield) {
-		return Data::QueueLock(event, queue, yield);
+	// called to add new data, which wakes up the output stage to write it
+	// (if it's already waiting on this file)
+	void FileTask::push(const Data &data) {
+		channel.push(data);
 	}
 
-	Data::QueueLock FileTask::lock() {
-		bool yield = false;
-		return lock(yield);
+	Data::Channel::PopAwaiter FileTask::pop() {
+		return channel.pop();
 	}
 
-	void FileTask::copy(std::istream &inputStream, std::streamsize count) {
+	// the same data is also added to fileTaskPointerVector, so it only needs to be read once
+	// (it isn't completed here, each one must still be completed after)
+	void FileTask::copy(std::istream &inputStream, std::streamsize count, const PointerVector &fileTaskPointerVector) {
 		if (!count) {
 			return;
 		}
@@ -162,7 +160,16 @@ namespace Work {
 					break;
 				}
 
-				lock().get().emplace((size_t)gcountRead, pointer);
+				Data data((size_t)gcountRead, pointer);
+				push(data);
+
+				for (
+					auto fileTaskPointerVectorIterator = fileTaskPointerVector.begin();
+					fileTaskPointerVectorIterator != fileTaskPointerVector.end();
+					fileTaskPointerVectorIterator++
+				) {
+					(*fileTaskPointerVectorIterator)->push(data);
+				}
 			}
 
 			if (count != -1) {
@@ -181,9 +188,9 @@ namespace Work {
 		}
 	}
 
-	// called to signal to the output thread that we are done adding new data
+	// called to signal to the output stage that we are done adding new data
 	void FileTask::complete() {
-		lock().get().emplace();
+		channel.close();
 	}
 
 	std::streamoff FileTask::getOwnerBigFileInputOffset() {
@@ -194,9 +201,13 @@ namespace Work {
 		return fileVariant;
 	}
 
-	Tasks::Tasks()
+	Stalls FileTask::getStalls() {
+		return channel.getStalls();
+	}
+
+	Tasks::Tasks(FileTask::Channel::Size maxFileTasks)
 		: bigFileEvent(true),
-		fileEvent(true) {
+		fileChannel(maxFileTasks) {
 	}
 
 	BigFileTask::PointerMapLock Tasks::bigFileLock(bool &yield) {
@@ -208,13 +219,10 @@ namespace Work {
 		return bigFileLock(yield);
 	}
 
-	FileTask::PointerQueueLock Tasks::fileLock(bool &yield) {
-		return FileTask::PointerQueueLock(fileEvent, fileTaskPointerQueue, yield);
-	}
-
-	FileTask::PointerQueueLock Tasks::fileLock() {
-		bool yield = false;
-		return fileLock(yield);
+	void Tasks::clear() {
+		bigFileLock().get().clear();
+		fileChannel.clear();
+		conversionStall = {};
 	}
 
 	Convert::Convert(
@@ -227,6 +235,162 @@ namespace Work {
 		file(file) {
 	}
 
+	void Layout::readTrace(std::istream &traceInputStream) {
+		std::string line = "";
+		Rank rank = traceRankMap.size();
+
+		while (std::getline(traceInputStream, line)) {
+			// the trace may have been written on Windows
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+
+			if (line.empty()) {
+				continue;
+			}
+
+			// only the first time a path was read counts
+			if (traceRankMap.try_emplace(line, rank).second) {
+				rank++;
+			}
+		}
+	}
+
+	bool Layout::isOrdered() const {
+		return groupFaces || !traceRankMap.empty();
+	}
+
+	const std::filesystem::path Manifest::PATH = GAMEDATABINDIR "/M4Revolution.manifest";
+	const char* Manifest::HEADER = "M4Revolution Manifest 1";
+
+	Manifest::Manifest(const Convert::Configuration &configuration)
+		: configuration(configuration) {
+	}
+
+	Manifest::Manifest(std::istream &inputStream) {
+		std::string line = "";
+
+		if (!std::getline(inputStream, line) || line != HEADER) {
+			throw std::invalid_argument("header must be valid");
+		}
+
+		if (!(inputStream
+			>> configuration.minTextureWidth
+			>> configuration.maxTextureWidth
+			>> configuration.minTextureHeight
+			>> configuration.maxTextureHeight
+			>> configuration.minVolumeExtent
+			>> configuration.maxVolumeExtent)) {
+			throw std::invalid_argument("configuration must be valid");
+		}
+
+		Entry entry = {};
+
+		while (inputStream
+			>> entry.source.offset
+			>> entry.source.size
+			>> std::hex >> entry.source.hash >> std::dec
+			>> entry.size
+			>> std::hex >> entry.hash >> std::dec
+			>> entry.slot) {
+			// the name is the rest of the line (it may have spaces in it, or be empty)
+			std::getline(inputStream, entry.name);
+
+			if (!entry.name.empty() && entry.name.front() == ' ') {
+				entry.name.erase(0, 1);
+			}
+
+			entryMap.insert({ getKey(entry.source), entry });
+		}
+
+		// if we stopped before the end, there was something there that wasn't an entry
+		if (!inputStream.eof()) {
+			throw std::invalid_argument("entries must be valid");
+		}
+	}
+
+	void Manifest::write(std::ostream &outputStream) const {
+		outputStream << HEADER << "\n";
+
+		outputStream << configuration.minTextureWidth
+			<< " " << configuration.maxTextureWidth
+			<< " " << configuration.minTextureHeight
+			<< " " << configuration.maxTextureHeight
+			<< " " << configuration.minVolumeExtent
+			<< " " << configuration.maxVolumeExtent << "\n";
+
+		for (
+			auto entryMapIterator = entryMap.begin();
+			entryMapIterator != entryMap.end();
+			entryMapIterator++
+		) {
+			const Entry &entry = entryMapIterator->second;
+
+			outputStream << entry.source.offset
+				<< " " << entry.source.size
+				<< " " << std::hex << entry.source.hash << std::dec
+				<< " " << entry.size
+				<< " " << std::hex << entry.hash << std::dec
+				<< " " << entry.slot
+				<< " " << entry.name << "\n";
+		}
+	}
+
+	Manifest::Key Manifest::getKey(const Source &source) {
+		return { source.size, source.hash };
+	}
+
+	const std::filesystem::path Cache::PATH = GAMEDATABINDIR "/M4Revolution.cache";
+	const std::filesystem::path Cache::OUTPUT_PATH = GAMEDATABINDIR "/M4Revolution.cache.tmp";
+
+	Cache::Cache(std::istream &manifestInputStream, const Convert::Configuration &configuration)
+		: manifest(manifestInputStream) {
+		// files converted with a different configuration can't be reused
+		if (manifest.configuration != configuration) {
+			throw std::invalid_argument("configuration must match the manifest");
+		}
+
+		fileStream.open(PATH, std::ifstream::binary);
+
+		if (!fileStream.is_open()) {
+			throw std::runtime_error("failed to open cache");
+		}
+
+		fileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+		fileStream.seekg(0, std::ifstream::end);
+		fileSize = fileStream.tellg();
+	}
+
+	const Manifest::Entry* Cache::find(const Source &source) const {
+		const Manifest::Entry* entryPointer = nullptr;
+
+		// the file must be exactly the same as last time (wherever it is now)
+		auto entryMapRange = manifest.entryMap.equal_range(Manifest::getKey(source));
+
+		for (
+			auto entryMapIterator = entryMapRange.first;
+			entryMapIterator != entryMapRange.second;
+			entryMapIterator++
+		) {
+			const Manifest::Entry &entry = entryMapIterator->second;
+
+			// and its output must actually be in the cache (in case it was cut off somehow)
+			if (entry.slot < 0 || entry.slot + (std::streamoff)entry.size > fileSize) {
+				continue;
+			}
+
+			entryPointer = &entry;
+
+			// if the file is in the input more than once, any copy will do, because they were converted from the same input
+			// but the one that was at the same offset is preferred
+			if (entry.source.offset == source.offset) {
+				break;
+			}
+		}
+		return entryPointer;
+	}
+
 	const char* Output::FILE_NAME = "~M4R.tmp"; // must be an 8.3 filename
 	const char* Output::FILE_RETRY = "The game files could not be accessed. Please ensure the game is not open while using this tool. If this error is occuring and the game is not open, you may be out of disk space, or you may need to run this tool as admin.";
 
@@ -286,23 +450,24 @@ namespace Work {
 		return true;
 	}
 
-	Output::Output(bool binary) {
+	Output::Output(const char* fileName, bool binary)
+		: fileName(fileName) {
 		// without this remove first it may crash trying to open a hidden file
 		// (I mean, this isn't atomic so that can happen anyway but at least it's not our fault then)
 		// this is just a temp file so deleting it should be fine
-		std::filesystem::remove(FILE_NAME);
+		std::filesystem::remove(fileName);
 
 		fileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-		fileStream.open(FILE_NAME, std::ofstream::trunc | (std::ofstream::binary * binary), _SH_DENYRW);
+		fileStream.open(fileName, std::ofstream::trunc | (std::ofstream::binary * binary), _SH_DENYRW);
 
 		#ifdef WINDOWS
-		setFileAttributeHidden(true, FILE_NAME);
+		setFileAttributeHidden(true, fileName);
 		#endif
 	}
 
 	Output::~Output() {
 		#ifdef WINDOWS
-		setFileAttributeHidden(false, FILE_NAME);
+		setFileAttributeHidden(false, fileName);
 		#endif
 	}
 
@@ -324,11 +489,45 @@ namespace Work {
 			return result;
 		}
 
+		static constexpr char JOURNAL_SIGNATURE[] = "M4RJ";
+		static constexpr size_t JOURNAL_SIGNATURE_SIZE = sizeof(JOURNAL_SIGNATURE) - 1;
+
+		struct JournalHeader {
+			uint64_t size = 0;
+			Hash::Value hash = 0;
+		};
+
+		struct JournalEntry {
+			uint64_t offset = 0;
+			uint64_t count = 0;
+		};
+
 		void log() {
 			consoleLog("A backup has been created.", 2);
 		}
 
+		Hash::Value getHash(std::istream &inputStream) {
+			Hash hash;
+			inputStream.seekg(0);
+
+			copyStreamToWriteDestination(
+				inputStream,
+
+				[&hash](void* buffer, std::streamsize count) {
+					hash.update(buffer, (size_t)count);
+				}
+			);
+			return hash.get();
+		}
+
 		void create(const char* fileName) {
+			// the file is about to be replaced, so if all it has is a journal, it is restored first
+			// that way, the backup is still the original file
+			if (!std::filesystem::is_regular_file(getPath(fileName))
+				&& std::filesystem::is_regular_file(getJournalPath(fileName))) {
+				restoreJournal(fileName);
+			}
+
 			bool createdNew = rename(fileName, getPath(fileName).string().c_str());
 
 			// here I use std::filesystem::rename because I do want to overwrite the file if it exists
@@ -340,12 +539,6 @@ namespace Work {
 			}
 		}
 
-		void createOutput(const char* fileName) {
-			if (rename(Output::FILE_NAME, getPath(fileName).string().c_str())) {
-				log();
-			}
-		}
-
 		void createEmpty(const std::filesystem::path &path) {
 			const std::filesystem::path backupPath = getPath(path);
 
@@ -374,15 +567,141 @@ namespace Work {
 		}
 
 		void restore(const std::filesystem::path &path) {
+			if (!std::filesystem::is_regular_file(getPath(path))) {
+				restoreJournal(path);
+				return;
+			}
+
 			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(getPath(path), path),
 				std::filesystem::filesystem_error, Output::FILE_RETRY);
 
 			deleteEmpty(path);
+
+			// the full backup is the original file, so a journal would only be redundant
+			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::remove(getJournalPath(path)),
+				std::filesystem::filesystem_error, Output::FILE_RETRY);
+		}
+
+		bool exists(const std::filesystem::path &path) {
+			return std::filesystem::is_regular_file(getPath(path))
+				|| std::filesystem::is_regular_file(getJournalPath(path));
 		}
 
 		std::filesystem::path getPath(std::filesystem::path path) {
 			return path.replace_extension("bak");
 		}
+
+		void writeJournalHeader(std::istream &inputStream, std::ostream &outputStream) {
+			JournalHeader journalHeader = {};
+
+			inputStream.seekg(0, std::istream::end);
+			journalHeader.size = (uint64_t)inputStream.tellg();
+			journalHeader.hash = getHash(inputStream);
+
+			writeStream(outputStream, JOURNAL_SIGNATURE, JOURNAL_SIGNATURE_SIZE);
+			writeStream(outputStream, &journalHeader, sizeof(journalHeader));
+		}
+
+		void createJournalOutput(const std::filesystem::path &path) {
+			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(Output::FILE_NAME, getJournalPath(path)),
+				std::filesystem::filesystem_error, Output::FILE_RETRY);
+
+			log();
+		}
+
+		void writeJournal(std::istream &inputStream, const std::filesystem::path &path, std::streamoff offset, std::streamsize count) {
+			std::ofstream outputFileStream;
+			outputFileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+			OPERATION_EXCEPTION_RETRY_ERR(outputFileStream.open(getJournalPath(path), std::ofstream::binary | std::ofstream::app),
+				std::ofstream::failure, Output::FILE_RETRY);
+
+			JournalEntry journalEntry = {};
+			journalEntry.offset = (uint64_t)offset;
+			journalEntry.count = (uint64_t)count;
+
+			// read it all first, so an entry is never only partly written
+			std::string str = "";
+			inputStream.seekg(offset);
+			copyStreamToString(inputStream, str, count);
+
+			if ((std::streamsize)str.length() != count) {
+				throw std::out_of_range("offset out of bounds");
+			}
+
+			writeStream(outputFileStream, &journalEntry, sizeof(journalEntry));
+			writeStream(outputFileStream, str.c_str(), count);
+		}
+
+		void restoreJournal(const std::filesystem::path &path) {
+			const std::filesystem::path JOURNAL_PATH = getJournalPath(path);
+
+			{
+				std::ifstream inputFileStream;
+				inputFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+				OPERATION_EXCEPTION_RETRY_ERR(inputFileStream.open(JOURNAL_PATH, std::ifstream::binary),
+					std::ifstream::failure, Output::FILE_RETRY);
+
+				char signature[JOURNAL_SIGNATURE_SIZE] = {};
+				readStream(inputFileStream, signature, JOURNAL_SIGNATURE_SIZE);
+
+				if (memcmp(signature, JOURNAL_SIGNATURE, JOURNAL_SIGNATURE_SIZE)) {
+					throw std::invalid_argument("signature must be JOURNAL_SIGNATURE");
+				}
+
+				JournalHeader journalHeader = {};
+				readStream(inputFileStream, &journalHeader, sizeof(journalHeader));
+
+				// the entries are all read first, because they must be written back last to first
+				Edit::CodeVector codeVector = {};
+
+				while (inputFileStream.peek() != std::ifstream::traits_type::eof()) {
+					JournalEntry journalEntry = {};
+					readStream(inputFileStream, &journalEntry, sizeof(journalEntry));
+
+					Edit::Code &code = codeVector.emplace_back();
+					code.offset = (std::streamoff)journalEntry.offset;
+					code.str.resize((std::string::size_type)journalEntry.count);
+					readStream(inputFileStream, code.str.data(), (std::streamsize)journalEntry.count);
+				}
+
+				std::fstream fileStream;
+				fileStream.exceptions(std::fstream::failbit | std::fstream::badbit);
+
+				OPERATION_EXCEPTION_RETRY_ERR(fileStream.open(path, std::fstream::binary | std::fstream::in | std::fstream::out, _SH_DENYRW),
+					std::fstream::failure, Output::FILE_RETRY);
+
+				fileStream.seekg(0, std::fstream::end);
+
+				if ((uint64_t)fileStream.tellg() != journalHeader.size) {
+					throw std::invalid_argument("size must match the journal");
+				}
+
+				for (
+					Edit::CodeVector::reverse_iterator codeVectorIterator = codeVector.rbegin();
+					codeVectorIterator != codeVector.rend();
+					codeVectorIterator++
+				) {
+					fileStream.seekp(codeVectorIterator->offset);
+
+					const std::string &str = codeVectorIterator->str;
+					writeStream(fileStream, str.c_str(), (std::streamsize)str.length());
+				}
+
+				// if this doesn't match, the file was changed by something other than us, so the journal is kept
+				if (getHash(fileStream) != journalHeader.hash) {
+					throw std::invalid_argument("hash must match the journal");
+				}
+			}
+
+			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::remove(JOURNAL_PATH),
+				std::filesystem::filesystem_error, Output::FILE_RETRY);
+		}
+
+		std::filesystem::path getJournalPath(std::filesystem::path path) {
+			return path.replace_extension("jnl");
+		}
 	}
 
 	void Edit::copyThread(Edit &edit) {
@@ -390,15 +709,15 @@ namespace Work {
 		std::optional<Output> outputOptional = std::nullopt;
 
 		if (!edit.copied) {
-			// check if the file exists, if it doesn't create a backup
+			// check if the backup exists, if it doesn't start a journal
+			// (only the bytes we overwrite are backed up, instead of copying what may be gigabytes of file)
 			// note this is not a TOCTOU bug, fileStream already has an exclusive lock
 			// on this file, unless it is inaccessible
-			// in which case we'll error out on copyStream (as we should)
-			if (!std::filesystem::is_regular_file(Backup::getPath(edit.path))) {
+			// in which case we'll error out on writeJournalHeader (as we should)
+			if (edit.backup && !Backup::exists(edit.path)) {
 				outputOptional.emplace();
 
-				fileStream.seekg(0);
-				copyStream(fileStream, outputOptional.value().fileStream);
+				Backup::writeJournalHeader(fileStream, outputOptional.value().fileStream);
 			}
 
 			edit.copied = true;
@@ -406,16 +725,29 @@ namespace Work {
 
 		edit.event.wait(true);
 
-		// this happens after the wait because createOutput logs stuff
+		// this happens after the wait because createJournalOutput logs stuff
 		// we don't want it to interfere with the logging on the main thread
 		if (outputOptional.has_value()) {
 			outputOptional = std::nullopt;
 
-			Backup::createOutput(edit.path.string().c_str());
+			Backup::createJournalOutput(edit.path);
 		}
 
 		CodeVector &codeVector = edit.codeVector;
 
+		// the old bytes are all in the journal before any of them are overwritten
+		// (if there is a full backup instead, there is no journal to add to)
+		if (edit.backup && std::filesystem::is_regular_file(Backup::getJournalPath(edit.path))) {
+			for (
+				auto codeVectorIterator = codeVector.begin();
+				codeVectorIterator != codeVector.end();
+				codeVectorIterator++
+			) {
+				Backup::writeJournal(fileStream, edit.path,
+					codeVectorIterator->offset, (std::streamsize)codeVectorIterator->str.length());
+			}
+		}
+
 		for (
 			auto codeVectorIterator = codeVector.begin();
 			codeVectorIterator != codeVector.end();
@@ -428,9 +760,10 @@ namespace Work {
 		}
 	}
 
-	Edit::Edit(std::fstream &fileStream, const std::filesystem::path &path)
+	Edit::Edit(std::fstream &fileStream, const std::filesystem::path &path, bool backup)
 		: fileStream(fileStream),
-		path(path) {
+		path(path),
+		backup(backup) {
 		fileStream.clear();
 		fileStream.exceptions(std::fstream::failbit | std::fstream::badbit);
 
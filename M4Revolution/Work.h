@@ -1,23 +1,22 @@
 #pragma once
 #include "Ubi.h"
+#include "Hash.h"
+#include "Stage.h"
 #include <mutex>
 #include <condition_variable>
 #include <vector>
 #include <queue>
 #include <atomic>
 #include <unordered_map>
+#include <map>
+#include <thread>
+#include <chrono>
 #include <filesystem>
 #include <nvtt/nvtt.h>
 
 #define GAMEDATABINDIR "data"
 #define EXEDIR "bin"
 
-#ifdef WINDOWS
-	#define MULTITHREADED
-#else
-	#define SINGLETHREADED
-#endif
-
 namespace Work {
 	// a "signal the other thread to wake up and do stuff" class (similar to SetEvent)
 	class Event : NonCopyable {
@@ -67,8 +66,7 @@ namespace Work {
 	// a "packet" type structure representing some data (not necessarily an entire file)
 	struct Data {
 		using Pointer = std::shared_ptr<unsigned char[]>;
-		using Queue = std::queue<Data>;
-		using QueueLock = Lock<Queue>;
+		using Channel = Work::Channel<Data>;
 
 		size_t size = 0;
 		Pointer pointer = nullptr;
@@ -96,7 +94,7 @@ namespace Work {
 		using PointerMap = std::unordered_map<std::streamoff, Pointer>;
 		using PointerMapLock = Lock<PointerMap>;
 
-		// outputOffset is set by the output thread, and later used by it so it knows where to jump back
+		// outputOffset is set by the output stage, and later used by it so it knows where to jump back
 		std::streamoff outputOffset = -1;
 		Ubi::BigFile::File::PointerVector::size_type filesWritten = 0;
 
@@ -114,43 +112,55 @@ namespace Work {
 		Ubi::BigFile::Pointer getBigFilePointer() const;
 	};
 
+	// where a converted file came from in the input, and what it was
+	// (so that it can be recognized if it is converted again later)
+	struct Source {
+		std::streamoff offset = -1;
+		Ubi::BigFile::File::Size size = 0;
+		Hash::Value hash = 0;
+	};
+
 	// FileTask (must be written in order)
 	class FileTask {
 		public:
 		using Pointer = std::shared_ptr<FileTask>;
-		using PointerQueue = std::queue<Pointer>;
-		using PointerQueueLock = Lock<PointerQueue>;
+		using Channel = Work::Channel<Pointer>;
+		using PointerVector = std::vector<Pointer>;
 		using FileVariant = std::variant<Ubi::BigFile::File::PointerVectorPointer, Ubi::BigFile::File*>;
 
 		private:
-		// this needs its own queue, because
+		// this needs its own channel, because
 		// different files will be converted at the same time, each with their own FileTask
-		// (in the FileTask queue)
+		// (in the FileTask channel)
 		// but they need to be written in order
-		// so other FileTasks will be having their queues populated
-		// but the output thread must not progress until the first FileTask in queue is completed
+		// so other FileTasks will be having their channels filled
+		// but the output stage must not progress until the first FileTask in the channel is completed
 		// (because it can't know what its final size will be, and therefore the next offset to go to)
-		// once at the end of the data queue, the output thread will check if completed is true
-		// if it's false, it'll wait on more data again, otherwise it'll move to the next FileTask
-		// the output thread will check if the next file in the queue has a lesser value for bigFileInputPosition
+		// once the data channel is closed, the output stage will move to the next FileTask
+		// the output stage will check if the next file in the channel has a lesser value for bigFileInputPosition
 		// and if so, the corresponding BigFile(s) in the task vector are considered completed and are written
+		// (the data channel isn't bounded, because it's filled by converters, which must never wait on the output stage)
 		std::streamoff ownerBigFileInputOffset = -1;
 		FileVariant fileVariant = {};
-		Event event;
-		Data::Queue queue = {};
+		Data::Channel channel;
 
 		public:
+		// set only if this is a converted file that the output stage should hash
+		// (it must be set before the FileTask is added to the channel)
+		std::optional<Source> sourceOptional = std::nullopt;
+
 		FileTask(std::streamoff ownerBigFileInputOffset, Ubi::BigFile::File* filePointer);
 		FileTask(std::streamoff ownerBigFileInputOffset, Ubi::BigFile::File::PointerVectorPointer &filePointerVectorPointer);
-		Data::QueueLock lock(bool &yield);
-		Data::QueueLock lock();
-		void copy(std::istream &inputStream, std::streamsize count);
+		void push(const Data &data);
+		Data::Channel::PopAwaiter pop();
+		void copy(std::istream &inputStream, std::streamsize count, const PointerVector &fileTaskPointerVector = {});
 		void complete();
+		Stalls getStalls();
 		std::streamoff getOwnerBigFileInputOffset();
 		FileVariant getFileVariant();
 	};
 
-	// Tasks (to be performed by the output thread)
+	// Tasks (to be performed by the output stage)
 	class Tasks {
 		private:
 		// the list of BigFileTasks must be a vector, because
@@ -159,23 +169,29 @@ namespace Work {
 		Event bigFileEvent;
 		BigFileTask::PointerMap bigFileTaskPointerMap = {};
 
-		// the list of FileTasks must be a queue, because
+		public:
+		// the list of FileTasks must be a channel, because
 		// they must be written in order, start to finish
 		// regardless of the order the data becomes available in
-		Event fileEvent;
-		FileTask::PointerQueue fileTaskPointerQueue = {};
+		// it's bounded so the input isn't read too far ahead of the output (to prevent running out of memory)
+		FileTask::Channel fileChannel;
 
-		public:
-		Tasks();
+		// the output stage waiting on the data of a file, which is almost always one still being converted
+		Stalls::Clock::duration conversionStall = {};
+
+		Tasks(FileTask::Channel::Size maxFileTasks);
 		BigFileTask::PointerMapLock bigFileLock(bool &yield);
 		BigFileTask::PointerMapLock bigFileLock();
-		FileTask::PointerQueueLock fileLock(bool &yield);
-		FileTask::PointerQueueLock fileLock();
+
+		// throws out anything left over (if Fix Loading stopped early) so they can be used again
+		void clear();
 	};
 
 	struct Convert {
 		using Extent = unsigned long;
-		using FileWorkCallback = void(*)(Work::Convert* convertPointer);
+
+		// loads the file into the surface, or returns false if the file was converted some other way already
+		using FileWorkCallback = bool(*)(Work::Convert &convert, nvtt::Surface &surface, bool &hasAlpha);
 
 		struct Configuration {
 			Extent minTextureWidth = 1;
@@ -184,8 +200,13 @@ namespace Work {
 			Extent maxTextureHeight = 1024;
 			Extent minVolumeExtent = 1;
 			Extent maxVolumeExtent = 1024;
+
+			bool operator==(const Configuration &configuration) const = default;
 		};
 
+		using ConfigurationVector = std::vector<Configuration>;
+		using PointerVector = std::vector<std::unique_ptr<Convert>>;
+
 		FileWorkCallback fileWorkCallback = 0;
 
 		const Configuration &configuration;
@@ -196,6 +217,10 @@ namespace Work {
 		FileTask::Pointer fileTaskPointer = nullptr;
 		Data::Pointer dataPointer = nullptr;
 
+		// the same file for each of the other profiles, if there are any
+		// (it's only read and decoded once, then it's resized and compressed again for each of these)
+		PointerVector profileConvertPointerVector = {};
+
 		Convert(
 			const Configuration &configuration,
 			const nvtt::Context &context,
@@ -203,8 +228,100 @@ namespace Work {
 		);
 	};
 
+	// small files are converted together in batches, so they don't each need their own work
+	// (each one still has its own FileTask, so they are output in order)
+	struct ConvertBatch {
+		using Pointer = std::unique_ptr<ConvertBatch>;
+		using ConvertPointerVector = std::vector<std::unique_ptr<Convert>>;
+
+		ConvertPointerVector convertPointerVector = {};
+		Ubi::BigFile::File::Size size = 0;
+	};
+
+	// a single file or a batch, waiting to be converted
+	using ConvertVariant = std::variant<std::unique_ptr<Convert>, ConvertBatch::Pointer>;
+	using ConvertChannel = Channel<ConvertVariant>;
+
+	// the order the files in each BigFile are put in the output
+	// by default, it's the same as the input, but it can be changed so
+	// that the files the game reads together are together on the disk
+	struct Layout {
+		using Rank = size_t;
+		using RankMap = std::map<std::string, Rank, IgnoreCaseComparer>;
+
+		// large images start on a boundary of this size
+		static constexpr Ubi::BigFile::File::Size ALIGNMENT = 0x1000;
+		static constexpr Ubi::BigFile::File::Size ALIGNMENT_SIZE_MIN = 0x10000;
+
+		// the slices of each face of a cube (and their masks) are put together, row by row
+		bool groupFaces = false;
+
+		// large images are aligned to ALIGNMENT
+		bool alignImages = false;
+
+		// the paths in the order the game first read them, which go first, in that order
+		RankMap traceRankMap = {};
+
+		// reads a trace, which is one path per line (like gamedata/common/common.m4b/common/ai/example.ai)
+		void readTrace(std::istream &traceInputStream);
+		bool isOrdered() const;
+	};
+
+	// the hash of every converted file, written after Fix Loading in deterministic or incremental mode
+	// so the next run can check it got exactly the same output from the same input
+	// (and in incremental mode, where in the cache the output was put)
+	class Manifest {
+		public:
+		struct Entry {
+			Source source = {};
+			Ubi::BigFile::File::Size size = 0;
+			Hash::Value hash = 0;
+			std::streamoff slot = -1;
+			std::string name = "";
+		};
+
+		// the keys are the source size and hash, not the offset, because a patch that changes the size of one file
+		// moves every file after it, and they should still be found
+		// the same file can be in the input more than once, so the offset is kept as a hint of which one it was
+		using Key = std::pair<Ubi::BigFile::File::Size, Hash::Value>;
+		using EntryMap = std::multimap<Key, Entry>;
+
+		static const std::filesystem::path PATH;
+
+		Convert::Configuration configuration = {};
+		EntryMap entryMap = {};
+
+		Manifest(const Convert::Configuration &configuration);
+		Manifest(std::istream &inputStream);
+		void write(std::ostream &outputStream) const;
+
+		static Key getKey(const Source &source);
+
+		private:
+		static const char* HEADER;
+	};
+
+	// the converted files from the last time Fix Loading was run in incremental mode
+	// files that haven't changed since then are copied from here instead of being converted again
+	class Cache : NonCopyable {
+		private:
+		std::streamoff fileSize = 0;
+
+		public:
+		static const std::filesystem::path PATH;
+		static const std::filesystem::path OUTPUT_PATH;
+
+		Manifest manifest;
+		std::ifstream fileStream = {};
+		Manifest::EntryMap::size_type reused = 0;
+
+		Cache(std::istream &manifestInputStream, const Convert::Configuration &configuration);
+		const Manifest::Entry* find(const Source &source) const;
+	};
+
 	struct Output {
 		std::ofstream fileStream = {};
+		const char* fileName = FILE_NAME;
 
 		std::streamoff currentBigFileInputOffset = -1;
 		BigFileTask::Pointer bigFileTaskPointer = nullptr;
@@ -240,17 +357,26 @@ namespace Work {
 		static void findInstallPath(const std::filesystem::path &path);
 		static bool setPath(const std::filesystem::path &path);
 
-		Output(bool binary = true);
+		Output(const char* fileName = FILE_NAME, bool binary = true);
 		~Output();
 	};
 
 	namespace Backup {
 		void create(const char* fileName);
-		void createOutput(const char* fileName);
 		void createEmpty(const std::filesystem::path &path);
 		void deleteEmpty(const std::filesystem::path &path);
 		void restore(const std::filesystem::path &path);
+		bool exists(const std::filesystem::path &path);
 		std::filesystem::path getPath(std::filesystem::path path);
+
+		// instead of copying a whole file to back it up before editing a few bytes of it
+		// the bytes that are about to be overwritten are kept in a journal
+		// and written back in reverse order to restore it (then checked against the original size and hash)
+		void writeJournalHeader(std::istream &inputStream, std::ostream &outputStream);
+		void createJournalOutput(const std::filesystem::path &path);
+		void writeJournal(std::istream &inputStream, const std::filesystem::path &path, std::streamoff offset, std::streamsize count);
+		void restoreJournal(const std::filesystem::path &path);
+		std::filesystem::path getJournalPath(std::filesystem::path path);
 	}
 
 	class Edit {
@@ -275,11 +401,13 @@ namespace Work {
 
 		std::fstream &fileStream;
 
-		Edit(std::fstream &fileStream, const std::filesystem::path &path);
+		// backup is false for files that aren't the game's own yet (like the output of Fix Loading)
+		Edit(std::fstream &fileStream, const std::filesystem::path &path, bool backup = true);
 		void apply(std::thread &copyThread, const CodeVector &codeVector);
 
 		private:
 		std::filesystem::path path = {};
+		bool backup = true;
 		CodeVector codeVector = {};
 		Event event;
 		bool copied = false;
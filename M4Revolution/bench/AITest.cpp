@@ -0,0 +1,227 @@
+// checks the AI script index against the regex that editF32 used to search the script with, and times both
+// also checks that getCode only writes values the entry's type can hold, and that they fit
+// build from this folder, in a Visual Studio x64 Native Tools Command Prompt:
+//   cl /std:c++20 /EHsc /O2 /MD /I.. /I..\..\vendor\libzap\include /I..\..\vendor\scope_guard\include
+//     /I..\..\vendor\M4Image\include /I..\..\vendor\nvtt\include
+//     AITest.cpp ..\AI.cpp ..\Locale.cpp ..\StringToNumber.cpp ..\utils.cpp ..\Ubi.cpp ..\Work.cpp ..\Hash.cpp
+// returns zero if every check passed
+#include "../pch.h"
+#include "../AI.h"
+#include <regex>
+#include <chrono>
+#include <iostream>
+
+static bool passed = true;
+
+static void check(bool condition, const char* description) {
+	if (!condition) {
+		std::cout << "FAILED: " << description << std::endl;
+		passed = false;
+	}
+}
+
+// what editF32 did before the index: search from the start of what's left of the script for the next line
+// (this is only right for scripts where every line is a value, because the search is anchored to the start)
+struct RegexEntry {
+	std::string key = "";
+	std::string type = "";
+	std::string value = "";
+	std::streamoff offset = 0;
+};
+
+using RegexEntryVector = std::vector<RegexEntry>;
+
+static RegexEntryVector getRegexEntries(std::string script) {
+	static const std::regex AI_LINE(R"(^(\s*([^\s\(]+)\s*\(\s*([^\s,]+)\s*,\s?)(.*)\)[^\S\n]*(?:\n|$))");
+
+	RegexEntryVector regexEntryVector = {};
+	std::streamoff position = 0;
+	std::smatch matches = {};
+
+	while (std::regex_search(script, matches, AI_LINE) && matches.size() > 4) {
+		regexEntryVector.push_back({
+			matches[2],
+			matches[3],
+			matches[4],
+			position + (std::streamoff)matches.prefix().length() + (std::streamoff)matches[1].length()
+		});
+
+		position += (std::streamoff)matches.prefix().length() + (std::streamoff)matches[0].length();
+		script = matches.suffix();
+	}
+	return regexEntryVector;
+}
+
+// every kind of spacing the regex allows, so that both have to agree on where the values are
+static std::string getScript(size_t lines, unsigned int seed) {
+	static const char* TYPES[] = { "f32", "s32", "u8", "string" };
+	static const char* SPACES[] = { "", " ", "  ", "\t" };
+
+	std::string script = "";
+
+	for (size_t i = 0; i < lines; i++) {
+		seed = seed * 1664525 + 1013904223;
+
+		// some keys are repeated, so there are ranges to find
+		script += SPACES[(seed >> 4) & 3];
+		script += "m_key" + std::to_string((seed >> 8) % (lines / 2 + 1));
+		script += SPACES[(seed >> 6) & 3];
+		script += "(";
+		script += SPACES[(seed >> 10) & 3];
+		script += TYPES[(seed >> 12) & 3];
+		script += SPACES[(seed >> 14) & 3];
+		script += ",";
+		script += SPACES[(seed >> 16) & 1];
+		script += std::to_string((seed >> 18) % 1000) + "." + std::to_string((seed >> 22) % 10);
+
+		// padding after the value, which a new value may use
+		script += std::string((seed >> 24) & 7, ' ');
+		script += ")";
+		script += SPACES[(seed >> 27) & 1];
+		script += "\n";
+	}
+	return script;
+}
+
+static void testIndex() {
+	static const size_t LINES = 500;
+
+	for (unsigned int seed = 1; seed <= 20; seed++) {
+		std::string script = getScript(LINES, seed);
+
+		AI::Index index = {};
+		AI::getIndex(script, index);
+
+		RegexEntryVector regexEntryVector = getRegexEntries(script);
+
+		check(regexEntryVector.size() == LINES, "the regex found every line");
+		check(index.size() == regexEntryVector.size(), "the index has an entry for every line the regex found");
+
+		for (
+			RegexEntryVector::iterator regexEntryVectorIterator = regexEntryVector.begin();
+			regexEntryVectorIterator != regexEntryVector.end();
+			regexEntryVectorIterator++
+		) {
+			AI::IndexRange range = AI::findRange(index, regexEntryVectorIterator->key);
+			bool found = false;
+
+			for (AI::Index::const_iterator indexIterator = range.first; indexIterator != range.second; indexIterator++) {
+				const AI::Entry &ENTRY = indexIterator->second;
+
+				if ((std::streamoff)(ENTRY.value.data() - script.data()) == regexEntryVectorIterator->offset) {
+					check(ENTRY.type == regexEntryVectorIterator->type, "the type is the same as the regex's");
+					check(ENTRY.value == regexEntryVectorIterator->value, "the value is the same as the regex's");
+					found = true;
+				}
+			}
+
+			check(found, "the index has the value the regex found, at the same offset");
+		}
+
+		// repeated keys are in the order they're in the script
+		for (AI::Index::const_iterator indexIterator = index.begin(); indexIterator + 1 != index.end(); indexIterator++) {
+			AI::Index::const_iterator nextIndexIterator = indexIterator + 1;
+
+			check(indexIterator->first <= nextIndexIterator->first, "the index is sorted by key");
+
+			if (indexIterator->first == nextIndexIterator->first) {
+				check(indexIterator->second.value.data() < nextIndexIterator->second.value.data(), "repeated keys are in script order");
+			}
+		}
+	}
+}
+
+// lines that aren't values are skipped, instead of ending the search like they did with the regex
+static void testLines() {
+	std::string script =
+		"// comment ( f32 , 1.0 )x\r\n"
+		"\n"
+		"m_fadingTime ( f32 , 2.0    )\r\n"
+		"not a value\n"
+		"m_count(s32,5)\n"
+		"m_fadingTime ( s32 , 3 )\n"
+		"m_name ( string , abc  )\n"
+		"m_fadingTime ( f32 , 9.0 )";
+
+	AI::Index index = {};
+	AI::getIndex(script, index);
+
+	check(index.size() == 5, "every value line is indexed, and nothing else");
+	check(index.capacity() == 8, "the index is only allocated for as many lines as there are");
+
+	check(AI::findRange(index, "m_fadingTime").second - AI::findRange(index, "m_fadingTime").first == 3, "the repeated key has three entries");
+	check(!AI::findEntry(index, "m_missing", AI::TYPE_F32), "a missing key isn't found");
+	check(!AI::findEntry(index, "m_count", AI::TYPE_F32), "a key with another type isn't found");
+
+	const AI::Entry* entryPointer = AI::findEntry(index, "m_fadingTime", AI::TYPE_F32);
+
+	check(entryPointer && entryPointer->value == "2.0    " && entryPointer->width == 3, "the first f32 is found, with its padding");
+
+	entryPointer = AI::findEntry(index, "m_count", "s32");
+
+	check(entryPointer && entryPointer->value == "5" && entryPointer->width == 1, "a value with no space around it is found");
+
+	// the last line has no line break
+	AI::IndexRange range = AI::findRange(index, "m_fadingTime");
+	check(range.first != range.second && (range.second - 1)->second.value == "9.0 ", "the last line is indexed");
+}
+
+static void testCode() {
+	std::string script = "m_a ( f32 , 2.0    )\nm_b ( u8 , 7 )\nm_c ( string , abc  )\n";
+
+	AI::Index index = {};
+	AI::getIndex(script, index);
+
+	const std::streampos POSITION = 100;
+
+	const AI::Entry &A = *AI::findEntry(index, "m_a", AI::TYPE_F32);
+	const AI::Entry &B = *AI::findEntry(index, "m_b", "u8");
+	const AI::Entry &C = *AI::findEntry(index, "m_c", AI::TYPE_STRING);
+
+	Work::Edit::Code code = {};
+
+	check(AI::getCode(script, POSITION, A, 2.5f, code), "a float goes in an f32");
+	check(code.offset == (std::streamoff)POSITION + 12 && code.str == "2.5", "the f32 is written over the value");
+
+	check(AI::getCode(script, POSITION, A, 12.25f, code) && code.str == "12.25", "a longer float uses the padding");
+	check(!AI::getCode(script, POSITION, A, 1234567.0f, code), "a float that doesn't fit is refused");
+	check(!AI::getCode(script, POSITION, A, 2LL, code), "an integer doesn't go in an f32");
+
+	check(AI::getCode(script, POSITION, B, 9LL, code) && code.str == "9", "an integer goes in a u8");
+	check(!AI::getCode(script, POSITION, B, -1LL, code), "a negative integer doesn't go in a u8");
+	check(!AI::getCode(script, POSITION, B, 1.0f, code), "a float doesn't go in a u8");
+
+	check(AI::getCode(script, POSITION, C, std::string("de"), code) && code.str == "de ", "a shorter string is padded to the old width");
+	check(!AI::getCode(script, POSITION, C, std::string("toolong"), code), "a string that doesn't fit is refused");
+}
+
+// finding the last key in the script, the way editF32 used to, against indexing it and looking it up
+static void bench() {
+	static const size_t LINES[] = { 100, 1000, 5000 };
+
+	for (size_t i = 0; i < sizeof(LINES) / sizeof(*LINES); i++) {
+		std::string script = getScript(LINES[i], 1);
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		RegexEntryVector regexEntryVector = getRegexEntries(script);
+		double regexMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		begin = std::chrono::steady_clock::now();
+		AI::Index index = {};
+		AI::getIndex(script, index);
+		AI::findEntry(index, regexEntryVector.back().key, regexEntryVector.back().type);
+		double indexMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		std::cout << LINES[i] << " lines: regex " << regexMilliseconds << " ms, index " << indexMilliseconds << " ms" << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	testIndex();
+	testLines();
+	testCode();
+	bench();
+
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+// checks the stages and channels Fix Loading is run on, with a small pipeline shaped like it
+// files are read in order on the main thread, converted out of order on the convert stage, and written in order on the output stage
+// also checks that pushing to a full channel waits, that closing one wakes up everything waiting on it
+// and that a stage destroyed with coroutines still waiting (as when Fix Loading stops early) doesn't resume them later
+// build from this folder, in a Visual Studio x64 Native Tools Command Prompt:
+//   cl /std:c++20 /EHsc /O2 /MD /I.. /I..\..\vendor\libzap\include /I..\..\vendor\scope_guard\include
+//     StageTest.cpp ..\Stage.cpp ..\Locale.cpp ..\StringToNumber.cpp ..\utils.cpp
+// returns zero if every check passed
+#include "../pch.h"
+#include "../Stage.h"
+#include <atomic>
+#include <iostream>
+
+static bool passed = true;
+
+static void check(bool condition, const char* description) {
+	if (!condition) {
+		std::cout << "FAILED: " << description << std::endl;
+		passed = false;
+	}
+}
+
+// like a FileTask, the output gets the file in order, but its data whenever it's converted
+struct File {
+	using Pointer = std::shared_ptr<File>;
+	using Channel = Work::Channel<Pointer>;
+
+	size_t number = 0;
+	Work::Channel<size_t> dataChannel;
+};
+
+using FileChannel = File::Channel;
+
+static constexpr size_t FILES = 2000;
+static constexpr size_t DATA = 3;
+
+static Work::Coroutine convertCoroutine(FileChannel &convertChannel) {
+	for (;;) {
+		std::optional<File::Pointer> filePointerOptional = co_await convertChannel.pop();
+
+		if (!filePointerOptional.has_value()) {
+			break;
+		}
+
+		File &file = *filePointerOptional.value();
+
+		// so that they finish out of order
+		if (!(file.number % 7)) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+
+		for (size_t i = 0; i < DATA; i++) {
+			file.dataChannel.push(file.number * DATA + i);
+		}
+
+		file.dataChannel.close();
+	}
+}
+
+static Work::Coroutine outputCoroutine(FileChannel &fileChannel, std::vector<size_t> &outputVector) {
+	for (;;) {
+		std::optional<File::Pointer> filePointerOptional = co_await fileChannel.pop();
+
+		if (!filePointerOptional.has_value()) {
+			break;
+		}
+
+		File &file = *filePointerOptional.value();
+
+		for (;;) {
+			std::optional<size_t> dataOptional = co_await file.dataChannel.pop();
+
+			if (!dataOptional.has_value()) {
+				break;
+			}
+
+			outputVector.push_back(dataOptional.value());
+		}
+	}
+}
+
+static void testPipeline() {
+	static const size_t CONVERTERS[] = { 1, 2, 8 };
+	static const FileChannel::Size MAX_FILES[] = { 1, 4, 216 };
+
+	for (size_t i = 0; i < sizeof(CONVERTERS) / sizeof(*CONVERTERS); i++) {
+		for (size_t j = 0; j < sizeof(MAX_FILES) / sizeof(*MAX_FILES); j++) {
+			FileChannel fileChannel(MAX_FILES[j]);
+			FileChannel convertChannel(CONVERTERS[i]);
+			std::vector<size_t> outputVector = {};
+
+			{
+				Work::Stage outputStage(1);
+				Work::Stage convertStage(CONVERTERS[i]);
+
+				outputStage.spawn(outputCoroutine(fileChannel, outputVector));
+
+				for (size_t k = 0; k < CONVERTERS[i]; k++) {
+					convertStage.spawn(convertCoroutine(convertChannel));
+				}
+
+				for (size_t number = 0; number < FILES; number++) {
+					File::Pointer filePointer = std::make_shared<File>();
+					filePointer->number = number;
+
+					fileChannel.push(filePointer);
+					convertChannel.push(filePointer);
+				}
+
+				convertChannel.close();
+				convertStage.join();
+
+				fileChannel.close();
+				outputStage.join();
+			}
+
+			bool ordered = outputVector.size() == FILES * DATA;
+
+			for (size_t k = 0; ordered && k < outputVector.size(); k++) {
+				ordered = outputVector[k] == k;
+			}
+
+			check(ordered, "the output gets every file's data, in the order the files were read");
+		}
+	}
+}
+
+static Work::Coroutine popCoroutine(Work::Channel<int> &channel, std::atomic<int> &popped, std::atomic<int> &closed) {
+	for (;;) {
+		std::optional<int> valueOptional = co_await channel.pop();
+
+		if (!valueOptional.has_value()) {
+			closed++;
+			break;
+		}
+
+		popped += valueOptional.value();
+	}
+}
+
+static void testBounded() {
+	static constexpr Work::Channel<int>::Size CAPACITY = 2;
+
+	Work::Channel<int> channel(CAPACITY);
+	std::atomic<int> pushed = 0;
+
+	std::thread pushThread([&] {
+		for (int i = 0; i < 5; i++) {
+			channel.push(1);
+			pushed++;
+		}
+	});
+
+	// there's nothing popping yet, so only as many as will fit get pushed
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	check(pushed == CAPACITY, "pushing to a full channel waits");
+	check(channel.full(), "the channel is full");
+
+	std::atomic<int> popped = 0;
+	std::atomic<int> closed = 0;
+
+	{
+		Work::Stage stage(1);
+		stage.spawn(popCoroutine(channel, popped, closed));
+
+		pushThread.join();
+		channel.close();
+		stage.join();
+	}
+
+	check(popped == 5, "everything pushed is popped, including what was pushed before the channel was closed");
+	check(closed == 1, "the coroutine is told when the channel is closed");
+	check(channel.getStalls().push > Work::Stalls::Clock::duration::zero(), "the wait to push is counted");
+}
+
+static void testClose() {
+	Work::Channel<int> channel;
+	std::atomic<int> popped = 0;
+	std::atomic<int> closed = 0;
+
+	{
+		Work::Stage stage(4);
+
+		for (int i = 0; i < 8; i++) {
+			stage.spawn(popCoroutine(channel, popped, closed));
+		}
+
+		channel.push(3);
+		channel.close();
+		stage.join();
+	}
+
+	check(popped == 3, "the value pushed is popped by one coroutine");
+	check(closed == 8, "closing the channel wakes up every coroutine waiting on it");
+}
+
+static void testAbort() {
+	Work::Channel<int> channel;
+	std::atomic<int> popped = 0;
+	std::atomic<int> closed = 0;
+
+	{
+		Work::Stage stage(2);
+
+		for (int i = 0; i < 4; i++) {
+			stage.spawn(popCoroutine(channel, popped, closed));
+		}
+
+		channel.push(1);
+
+		// let them all get to waiting on the channel
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	// they were destroyed while waiting, so these must not go to them
+	channel.push(1);
+	channel.close();
+
+	check(popped == 1, "coroutines destroyed while waiting don't get anything pushed after");
+	check(!closed, "coroutines destroyed while waiting aren't told the channel is closed");
+
+	channel.clear();
+	channel.push(2);
+
+	{
+		Work::Stage stage(1);
+		stage.spawn(popCoroutine(channel, popped, closed));
+
+		channel.close();
+		stage.join();
+	}
+
+	check(popped == 3, "a cleared channel can be used again, without what was left in it");
+	check(closed == 1, "a cleared channel can be closed again");
+}
+
+int main(int argc, char** argv) {
+	testPipeline();
+	testBounded();
+	testClose();
+	testAbort();
+
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
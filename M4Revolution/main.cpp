@@ -48,6 +48,90 @@ std::string getAppInstallDir() {
 	return std::filesystem::current_path().string();
 }
 
+bool getToggledOn(const std::string &value, std::optional<bool> &toggledOnOptional) {
+	if (value == "on") {
+		toggledOnOptional = true;
+		return true;
+	}
+
+	if (value == "off") {
+		toggledOnOptional = false;
+		return true;
+	}
+	return false;
+}
+
+// parses a list of operations like "fix-loading,transition-time=250,camera-inertia=off"
+// for the --apply argument
+bool getBatch(const std::string &apply, M4Revolution::Batch &batch) {
+	static const std::string FIX_LOADING = "fix-loading";
+	static const std::string FULL_SCREEN = "full-screen";
+	static const std::string CAMERA_INERTIA = "camera-inertia";
+	static const std::string SOUND_FADE_OUT = "sound-fade-out";
+	static const std::string TRANSITION_TIME = "transition-time";
+
+	static constexpr char SEPARATOR = ',';
+	static constexpr char EQUALS = '=';
+
+	batch = {};
+
+	std::string::size_type begin = 0;
+	std::string::size_type end = 0;
+
+	do {
+		end = apply.find(SEPARATOR, begin);
+
+		const std::string operation = apply.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+		begin = end + 1;
+
+		std::string::size_type equals = operation.find(EQUALS);
+
+		const std::string name = operation.substr(0, equals);
+		const std::string value = equals == std::string::npos ? "" : operation.substr(equals + 1);
+
+		if (name == FIX_LOADING) {
+			if (equals != std::string::npos) {
+				return false;
+			}
+
+			batch.fixLoading = true;
+		} else if (name == FULL_SCREEN) {
+			if (!getToggledOn(value, batch.fullScreenOptional)) {
+				return false;
+			}
+		} else if (name == CAMERA_INERTIA) {
+			if (!getToggledOn(value, batch.cameraInertiaOptional)) {
+				return false;
+			}
+		} else if (name == SOUND_FADE_OUT) {
+			unsigned long time = 0;
+
+			if (value.empty()
+				|| stringToLong(value.c_str(), time, 10) != value.length()
+				|| time < M4Revolution::SOUND_FADE_OUT_TIME_MIN
+				|| time > M4Revolution::SOUND_FADE_OUT_TIME_MAX) {
+				return false;
+			}
+
+			batch.soundFadeOutTimeOptional = time;
+		} else if (name == TRANSITION_TIME) {
+			float time = 0.0f;
+
+			if (value.empty()
+				|| stringToFloat(value.c_str(), time) != value.length()
+				|| time < M4Revolution::TRANSITION_TIME_MIN
+				|| time > M4Revolution::TRANSITION_TIME_MAX) {
+				return false;
+			}
+
+			batch.transitionTimeOptional = time;
+		} else {
+			return false;
+		}
+	} while (end != std::string::npos);
+	return true;
+}
+
 std::optional<bool> performOperation(M4Revolution &m4Revolution) {
 	static constexpr long OPERATION_OPEN_ONLINE_HELP = 1;
 	static constexpr long OPERATION_TOGGLE_FULL_SCREEN = 2;
@@ -123,10 +207,17 @@ int main(int argc, char** argv) {
 
 	std::optional<std::string> pathStringOptional = std::nullopt;
 	bool logFileNames = false;
+	bool logStalls = false;
 	bool disableHardwareAcceleration = false;
+	bool deterministic = false;
+	bool incremental = false;
 	unsigned long maxThreads = 0;
 	unsigned long maxFileTasks = 0;
+	unsigned long maxOutputThreads = 0;
 	std::optional<Work::Convert::Configuration> configurationOptional = std::nullopt;
+	Work::Convert::ConfigurationVector profileConfigurationVector = {};
+	std::optional<M4Revolution::Batch> batchOptional = std::nullopt;
+	Work::Layout layout = {};
 
 	for (int i = MIN_ARGC; i < argc; i++) {
 		arg = std::string(argv[i]);
@@ -138,6 +229,16 @@ int main(int argc, char** argv) {
 			logFileNames = true;
 		} else if (arg == "-nohw" || arg == "--disable-hardware-acceleration") {
 			disableHardwareAcceleration = true;
+		} else if (arg == "-det" || arg == "--deterministic") {
+			deterministic = true;
+		} else if (arg == "-inc" || arg == "--incremental") {
+			incremental = true;
+		} else if (arg == "-gf" || arg == "--group-faces") {
+			layout.groupFaces = true;
+		} else if (arg == "-al" || arg == "--align") {
+			layout.alignImages = true;
+		} else if (arg == "--dev-log-stalls") {
+			logStalls = true;
 		} else if (i < argc2) {
 			if (arg == "-p" || arg == "--path") {
 				pathStringOptional = argv[++i];
@@ -147,12 +248,34 @@ int main(int argc, char** argv) {
 					help();
 					return 1;
 				}
+			} else if (arg == "-tr" || arg == "--trace") {
+				std::ifstream traceInputFileStream(argv[++i]);
+
+				if (!traceInputFileStream.is_open()) {
+					consoleLog("Trace must be a file that exists", 2);
+					help();
+					return 1;
+				}
+
+				layout.readTrace(traceInputFileStream);
+			} else if (arg == "-a" || arg == "--apply") {
+				if (!getBatch(argv[++i], batchOptional.emplace())) {
+					consoleLog("Apply must be a list of valid operations", 2);
+					help();
+					return 1;
+				}
 			} else if (arg == "--dev-max-file-tasks") {
 				if (!stringToLong(argv[++i], maxFileTasks)) {
 					consoleLog("Max File Tasks must be a valid number", 2);
 					help();
 					return 1;
 				}
+			} else if (arg == "--dev-max-output-threads") {
+				if (!stringToLong(argv[++i], maxOutputThreads)) {
+					consoleLog("Max Output Threads must be a valid number", 2);
+					help();
+					return 1;
+				}
 			} else if (i < argc7) {
 				if (arg == "--dev-configuration") {
 					Work::Convert::Configuration &configuration = configurationOptional.emplace();
@@ -167,16 +290,73 @@ int main(int argc, char** argv) {
 						help();
 						return 1;
 					}
+				} else if (arg == "--dev-profile") {
+					Work::Convert::Configuration &configuration = profileConfigurationVector.emplace_back();
+
+					if (!stringToLong(argv[++i], configuration.minTextureWidth)
+						|| !stringToLong(argv[++i], configuration.maxTextureWidth)
+						|| !stringToLong(argv[++i], configuration.minTextureHeight)
+						|| !stringToLong(argv[++i], configuration.maxTextureHeight)
+						|| !stringToLong(argv[++i], configuration.minVolumeExtent)
+						|| !stringToLong(argv[++i], configuration.maxVolumeExtent)) {
+						consoleLog("Profile must be six valid numbers", 2);
+						help();
+						return 1;
+					}
 				}
 			}
 		}
 	}
 
+	// the outputs for profiles are not installed, so there's no manifest or cache to check them against
+	if (!profileConfigurationVector.empty() && (deterministic || incremental)) {
+		consoleLog("Profiles must not be used with Deterministic or Incremental", 2);
+		help();
+		return 1;
+	}
+
 	if (!pathStringOptional.has_value()) {
 		pathStringOptional.emplace(getAppInstallDir());
 	}
 
-	M4Revolution m4Revolution(pathStringOptional.value(), logFileNames, disableHardwareAcceleration, maxThreads, maxFileTasks, configurationOptional);
+	M4Revolution m4Revolution(pathStringOptional.value(), logFileNames, logStalls, disableHardwareAcceleration, deterministic, incremental, maxThreads, maxFileTasks, maxOutputThreads, configurationOptional, layout);
+
+	// with --apply, the operations are all performed without the menu, or asking anything
+	if (batchOptional.has_value()) {
+		try {
+			m4Revolution.apply(batchOptional.value());
+		} catch (const M4Revolution::Aborted &ex) {
+			consoleLog(ex.what(), 2, false, true);
+			return 1;
+		} catch (const std::exception &ex) {
+			consoleLog(ex.what(), 2);
+
+			consoleLog("The operations have not been performed because an unknown exception occurred.", true, false, true);
+			throw;
+		}
+
+		consoleLog("The operations have been performed.");
+		return 0;
+	}
+
+	// with --dev-profile, Fix Loading is done once for every profile, then it exits
+	if (!profileConfigurationVector.empty()) {
+		try {
+			m4Revolution.fixLoadingProfiles(profileConfigurationVector);
+		} catch (const M4Revolution::Aborted &ex) {
+			consoleLog(ex.what(), 2, false, true);
+			return 1;
+		} catch (const std::exception &ex) {
+			consoleLog(ex.what(), 2);
+
+			consoleLog("The operation has not been performed because an unknown exception occurred.", true, false, true);
+			throw;
+		}
+
+		consoleLog("The operation has been performed.");
+		return 0;
+	}
+
 	std::optional<bool> performedOperationOptional = std::nullopt;
 
 	for(;;) {
@@ -0,0 +1,205 @@
+#include "pch.h"
+#include "DecodeCache.h"
+
+namespace gfx_tools {
+	DecodeCache::Key::Key(
+		Hash::Value hash,
+		RawBuffer::Size rawBufferSize,
+		const L_TCHAR* extension,
+		Dimension width,
+		Dimension height,
+		M4Image::COLOR_FORMAT colorFormat,
+		Size stride
+	)
+		: hash(hash),
+		rawBufferSize(rawBufferSize),
+		extension(extension),
+		width(width),
+		height(height),
+		colorFormat(colorFormat),
+		stride(stride) {
+	}
+
+	bool DecodeCache::Key::operator==(const Key &key) const {
+		return hash == key.hash
+			&& rawBufferSize == key.rawBufferSize
+			&& extension == key.extension
+			&& width == key.width
+			&& height == key.height
+			&& colorFormat == key.colorFormat
+			&& stride == key.stride;
+	}
+
+	size_t DecodeCache::KeyHash::operator()(const Key &key) const {
+		// the raw buffer is already hashed, so this just has to mix in the rest
+		Hash::Value value = key.hash;
+		value ^= (Hash::Value)key.width << 32 | key.height;
+		value ^= (Hash::Value)key.stride << 8 | (Hash::Value)key.colorFormat;
+		return (size_t)(value ^ (value >> 32));
+	}
+
+	DecodeCache::Entry::Entry(const Key &key, const unsigned char* pointer, Size size)
+		: key(key),
+		pointer(new unsigned char[size]),
+		size(size) {
+		memcpy(this->pointer.get(), pointer, size);
+	}
+
+	#ifdef _WIN32
+	// dgVoodoo2 is used by putting its own d3d9.dll next to the game, instead of the one in the system folder
+	static bool isD3D9Wrapped() {
+		HMODULE module = GetModuleHandleA("d3d9.dll");
+
+		if (!module) {
+			return false;
+		}
+
+		char path[MAX_PATH] = "";
+		DWORD pathSize = GetModuleFileNameA(module, path, MAX_PATH);
+
+		if (!pathSize || pathSize >= MAX_PATH) {
+			return false;
+		}
+
+		// we're a 32-bit DLL, so on 64-bit Windows the system folder is SysWOW64 (but it's System32 elsewhere)
+		char systemPath[MAX_PATH] = "";
+		UINT systemPathSize = GetSystemWow64DirectoryA(systemPath, MAX_PATH);
+
+		if (!systemPathSize || systemPathSize >= MAX_PATH) {
+			systemPathSize = GetSystemDirectoryA(systemPath, MAX_PATH);
+
+			if (!systemPathSize || systemPathSize >= MAX_PATH) {
+				return false;
+			}
+		}
+
+		return _strnicmp(path, systemPath, systemPathSize)
+			|| (path[systemPathSize] != '\\' && path[systemPathSize] != '/');
+	}
+	#endif
+
+	static DecodeCache::Size getConfiguredCapacity() {
+		// this is enough for both nodes when going back and forth between two of them
+		// (a node is six 1024x1024 faces at most, which is 24 MB)
+		static constexpr DecodeCache::Size CAPACITY_MAX = 0x3000000;
+
+		#ifdef _WIN32
+		// the GFX_TOOLS_DECODE_CACHE environment variable sets the capacity in megabytes (zero turns the cache off)
+		static constexpr unsigned long MEGABYTES_MAX = 0x400;
+		static constexpr int MEGABYTE_SHIFT = 20;
+
+		char megabytes[16] = "";
+		DWORD megabytesSize = GetEnvironmentVariableA("GFX_TOOLS_DECODE_CACHE", megabytes, sizeof(megabytes));
+
+		if (megabytesSize && megabytesSize < sizeof(megabytes)) {
+			return (DecodeCache::Size)__min(strtoul(megabytes, NULL, 10), MEGABYTES_MAX) << MEGABYTE_SHIFT;
+		}
+
+		// dgVoodoo2 takes a lot of our address space for itself, so there's none to spare for this by default
+		if (isD3D9Wrapped()) {
+			return 0;
+		}
+
+		// this is a 32-bit process and the pool is holding onto buffers as well
+		// so the cache only gets a small share of whatever address space is still free
+		static constexpr DWORDLONG AVAILABLE_VIRTUAL_DIVISOR = 8;
+
+		MEMORYSTATUSEX memoryStatusEx = {};
+		memoryStatusEx.dwLength = sizeof(memoryStatusEx);
+
+		if (!GlobalMemoryStatusEx(&memoryStatusEx)) {
+			return 0;
+		}
+
+		return (DecodeCache::Size)__min((DWORDLONG)CAPACITY_MAX, memoryStatusEx.ullAvailVirtual / AVAILABLE_VIRTUAL_DIVISOR);
+		#else
+		return CAPACITY_MAX;
+		#endif
+	}
+
+	DecodeCache &DecodeCache::get() {
+		// this is sized the first time it's used, when the game is loading textures (so d3d9.dll is loaded by then)
+		static DecodeCache decodeCache(getConfiguredCapacity());
+		return decodeCache;
+	}
+
+	DecodeCache::DecodeCache(Size capacity)
+		: capacity(capacity) {
+		statistics.capacity = capacity;
+	}
+
+	DecodeCache::Size DecodeCache::getCapacity() const {
+		return capacity;
+	}
+
+	bool DecodeCache::copy(const Key &key, unsigned char* pointer, Size size) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		EntryListIteratorMap::iterator entryListIteratorMapIterator = entryListIteratorMap.find(key);
+
+		if (entryListIteratorMapIterator == entryListIteratorMap.end()) {
+			statistics.misses++;
+			return false;
+		}
+
+		EntryList::iterator entryListIterator = entryListIteratorMapIterator->second;
+
+		if (entryListIterator->size != size) {
+			statistics.misses++;
+			return false;
+		}
+
+		memcpy(pointer, entryListIterator->pointer.get(), size);
+
+		// move it to the front, now that it's been used
+		entryList.splice(entryList.begin(), entryList, entryListIterator);
+		statistics.hits++;
+		return true;
+	}
+
+	void DecodeCache::insert(const Key &key, const unsigned char* pointer, Size size) {
+		// don't let one huge image push out everything else
+		if (size > capacity / 2) {
+			return;
+		}
+
+		// the copy is made before taking the lock so other loaders aren't held up by it
+		EntryList insertEntryList = {};
+		insertEntryList.emplace_back(key, pointer, size);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// another thread may have decoded the same image in the meantime
+		if (entryListIteratorMap.find(key) != entryListIteratorMap.end()) {
+			return;
+		}
+
+		while (!entryList.empty() && statistics.size + size > capacity) {
+			Entry &entry = entryList.back();
+			statistics.size -= entry.size;
+			entryListIteratorMap.erase(entry.key);
+			entryList.pop_back();
+			statistics.evictions++;
+		}
+
+		entryList.splice(entryList.begin(), insertEntryList);
+		entryListIteratorMap.insert({ key, entryList.begin() });
+		statistics.size += size;
+	}
+
+	void DecodeCache::clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		entryListIteratorMap.clear();
+		entryList.clear();
+		statistics.size = 0;
+	}
+
+	DecodeCache::Statistics DecodeCache::getStatistics() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Statistics statistics = this->statistics;
+		statistics.entries = entryList.size();
+		return statistics;
+	}
+}
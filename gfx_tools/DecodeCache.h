@@ -0,0 +1,85 @@
+#pragma once
+#include "Hash.h"
+#include "RawBuffer.h"
+#include <M4Image.h>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <memory>
+
+namespace gfx_tools {
+	// remembers the last few LODs that were decoded, for every loader at once
+	// the game decodes the same slices again every time a node is revisited
+	// so going back and forth between two nodes can be a copy instead of a decode
+	// it's sized from the free address space (or the GFX_TOOLS_DECODE_CACHE environment variable) and is off with dgVoodoo2
+	class DecodeCache : NonCopyable {
+		public:
+		using Size = size_t;
+		using Dimension = unsigned long;
+
+		struct Key {
+			Hash::Value hash = 0;
+			RawBuffer::Size rawBufferSize = 0;
+			const L_TCHAR* extension = nullptr;
+			Dimension width = 0;
+			Dimension height = 0;
+			M4Image::COLOR_FORMAT colorFormat = M4Image::COLOR_FORMAT::RGBA;
+			Size stride = 0;
+
+			// the hash is of the raw buffer, which is passed in so that it can be done once per raw buffer
+			Key(
+				Hash::Value hash,
+				RawBuffer::Size rawBufferSize,
+				const L_TCHAR* extension,
+				Dimension width,
+				Dimension height,
+				M4Image::COLOR_FORMAT colorFormat,
+				Size stride
+			);
+
+			bool operator==(const Key &key) const;
+		};
+
+		struct Statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			size_t entries = 0;
+			Size size = 0;
+			Size capacity = 0;
+		};
+
+		static DecodeCache &get();
+
+		DecodeCache(Size capacity);
+		Size getCapacity() const;
+		bool copy(const Key &key, unsigned char* pointer, Size size);
+		void insert(const Key &key, const unsigned char* pointer, Size size);
+		void clear();
+		Statistics getStatistics();
+
+		private:
+		struct KeyHash {
+			size_t operator()(const Key &key) const;
+		};
+
+		struct Entry {
+			Key key;
+			std::unique_ptr<unsigned char[]> pointer = nullptr;
+			Size size = 0;
+
+			Entry(const Key &key, const unsigned char* pointer, Size size);
+		};
+
+		// the front of the list is the most recently used
+		using EntryList = std::list<Entry>;
+		using EntryListIteratorMap = std::unordered_map<Key, EntryList::iterator, KeyHash>;
+
+		const Size capacity = 0;
+
+		std::mutex mutex = {};
+		EntryList entryList = {};
+		EntryListIteratorMap entryListIteratorMap = {};
+		Statistics statistics = {};
+	};
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// a 64-bit hash (XXH64) that can be given data in pieces, like the output thread writes it
+// this is not meant to be secure, only to tell if files are the same as they were before
+class Hash {
+	public:
+	using Value = uint64_t;
+
+	static Value get(const void* pointer, size_t size, Value seed = 0);
+
+	Hash(Value seed = 0);
+	void update(const void* pointer, size_t size);
+	Value get() const;
+
+	private:
+	static constexpr size_t STRIPE_SIZE = 32;
+
+	Value seed = 0;
+	Value accumulators[4] = {};
+	uint64_t size = 0;
+
+	unsigned char stripe[STRIPE_SIZE] = {};
+	size_t stripeSize = 0;
+};
@@ -0,0 +1,610 @@
+#include "pch.h"
+#include "HeightMap.h"
+#include <math.h>
+
+namespace HeightMap {
+	using Dimension = gfx_tools::Dimension;
+	using Stride = gfx_tools::Stride;
+
+	static constexpr size_t DUDV_INPUT_CHANNEL_UV = 0;
+	static constexpr size_t DUDV_INPUT_CHANNEL_LUMINANCE = 3;
+
+	static constexpr size_t DUDV_OUTPUT_CHANNEL_DU = 0;
+	static constexpr size_t DUDV_OUTPUT_CHANNEL_DV = 1;
+	static constexpr size_t DUDV_OUTPUT_CHANNEL_LUMINANCE = 2;
+
+	// the scalar version of the below, also used for the columns the SIMD versions don't do
+	// (in luminance mode, outputColorPointer actually points to a Color32)
+	template<bool luminance>
+	static void convertHeightIntoDuDvBumpColor(
+		const M4Image::Color32 &inputColor,
+		const M4Image::Color32 &inputUColor,
+		const M4Image::Color32 &inputVColor,
+		M4Image::Color16* outputColorPointer
+	) {
+		M4Image::Color16 &outputColor = *outputColorPointer;
+
+		// DU is done last so input and output buffer may be the same
+		outputColor.channels[DUDV_OUTPUT_CHANNEL_DV] = (unsigned char)(inputColor.channels[DUDV_INPUT_CHANNEL_UV]
+			- inputVColor.channels[DUDV_INPUT_CHANNEL_UV]);
+
+		outputColor.channels[DUDV_OUTPUT_CHANNEL_DU] = (unsigned char)(inputColor.channels[DUDV_INPUT_CHANNEL_UV]
+			- inputUColor.channels[DUDV_INPUT_CHANNEL_UV]);
+
+		if constexpr (luminance) {
+			((M4Image::Color32*)outputColorPointer)->channels[DUDV_OUTPUT_CHANNEL_LUMINANCE] =
+				inputColor.channels[DUDV_INPUT_CHANNEL_LUMINANCE];
+		}
+	}
+
+	template<bool luminance>
+	static M4Image::Color16* getDuDvBumpColorPointer(M4Image::Color16* outputPointer, Dimension column) {
+		if constexpr (luminance) {
+			return (M4Image::Color16*)((M4Image::Color32*)outputPointer + column);
+		} else {
+			return outputPointer + column;
+		}
+	}
+
+	template<bool luminance>
+	static Dimension convertHeightMapIntoDuDvBumpMapRowScalar(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputVPointer,
+		M4Image::Color16* outputPointer
+	) {
+		return 0;
+	}
+
+	#ifdef SIMD_X86
+	// gets DU into the first byte and DV into the second byte of each pixel
+	// (the subtraction is done on whole pixels, but only the first channel is kept)
+	SIMD_TARGET_SSE41 static __m128i getDuDvSSE41(const M4Image::Color32* inputPointer, const M4Image::Color32* inputVPointer, __m128i &color) {
+		const __m128i MASK_DU = _mm_set1_epi32(0x000000FF);
+		const __m128i MASK_DV = _mm_set1_epi32(0x0000FF00);
+
+		color = _mm_loadu_si128((const __m128i*)inputPointer);
+		__m128i du = _mm_sub_epi8(color, _mm_loadu_si128((const __m128i*)(inputPointer + 1)));
+		__m128i dv = _mm_sub_epi8(color, _mm_loadu_si128((const __m128i*)inputVPointer));
+
+		return _mm_or_si128(_mm_and_si128(du, MASK_DU), _mm_and_si128(_mm_slli_epi32(dv, 8), MASK_DV));
+	}
+
+	template<bool luminance>
+	SIMD_TARGET_SSE41 static Dimension convertHeightMapIntoDuDvBumpMapRowSSE41(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputVPointer,
+		M4Image::Color16* outputPointer
+	) {
+		static constexpr Dimension STEP = sizeof(__m128i) / sizeof(M4Image::Color32);
+
+		const __m128i MASK_LUMINANCE = _mm_set1_epi32(0x00FF0000);
+		const __m128i MASK_UNUSED = _mm_set1_epi32((int)0xFF000000);
+
+		__m128i colors[2] = {};
+		__m128i duDvs[2] = {};
+
+		Dimension column = 0;
+
+		// two at a time, because without luminance they're packed into one store
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			duDvs[0] = getDuDvSSE41(inputPointer + column, inputVPointer + column, colors[0]);
+			duDvs[1] = getDuDvSSE41(inputPointer + column + STEP, inputVPointer + column + STEP, colors[1]);
+
+			if constexpr (luminance) {
+				// the last channel of the output is left as it was
+				for (Dimension i = 0; i < 2; i++) {
+					__m128i* colorPointer = (__m128i*)((M4Image::Color32*)outputPointer + column + STEP * i);
+
+					_mm_storeu_si128(colorPointer, _mm_or_si128(
+						_mm_or_si128(duDvs[i], _mm_and_si128(_mm_srli_epi32(colors[i], 8), MASK_LUMINANCE)),
+						_mm_and_si128(_mm_loadu_si128(colorPointer), MASK_UNUSED)
+					));
+				}
+			} else {
+				_mm_storeu_si128((__m128i*)(outputPointer + column), _mm_packus_epi32(duDvs[0], duDvs[1]));
+			}
+		}
+		return column;
+	}
+
+	SIMD_TARGET_AVX2 static __m256i getDuDvAVX2(const M4Image::Color32* inputPointer, const M4Image::Color32* inputVPointer, __m256i &color) {
+		const __m256i MASK_DU = _mm256_set1_epi32(0x000000FF);
+		const __m256i MASK_DV = _mm256_set1_epi32(0x0000FF00);
+
+		color = _mm256_loadu_si256((const __m256i*)inputPointer);
+		__m256i du = _mm256_sub_epi8(color, _mm256_loadu_si256((const __m256i*)(inputPointer + 1)));
+		__m256i dv = _mm256_sub_epi8(color, _mm256_loadu_si256((const __m256i*)inputVPointer));
+
+		return _mm256_or_si256(_mm256_and_si256(du, MASK_DU), _mm256_and_si256(_mm256_slli_epi32(dv, 8), MASK_DV));
+	}
+
+	template<bool luminance>
+	SIMD_TARGET_AVX2 static Dimension convertHeightMapIntoDuDvBumpMapRowAVX2(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputVPointer,
+		M4Image::Color16* outputPointer
+	) {
+		static constexpr Dimension STEP = sizeof(__m256i) / sizeof(M4Image::Color32);
+
+		const __m256i MASK_LUMINANCE = _mm256_set1_epi32(0x00FF0000);
+		const __m256i MASK_UNUSED = _mm256_set1_epi32((int)0xFF000000);
+
+		__m256i colors[2] = {};
+		__m256i duDvs[2] = {};
+
+		Dimension column = 0;
+
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			duDvs[0] = getDuDvAVX2(inputPointer + column, inputVPointer + column, colors[0]);
+			duDvs[1] = getDuDvAVX2(inputPointer + column + STEP, inputVPointer + column + STEP, colors[1]);
+
+			if constexpr (luminance) {
+				for (Dimension i = 0; i < 2; i++) {
+					__m256i* colorPointer = (__m256i*)((M4Image::Color32*)outputPointer + column + STEP * i);
+
+					_mm256_storeu_si256(colorPointer, _mm256_or_si256(
+						_mm256_or_si256(duDvs[i], _mm256_and_si256(_mm256_srli_epi32(colors[i], 8), MASK_LUMINANCE)),
+						_mm256_and_si256(_mm256_loadu_si256(colorPointer), MASK_UNUSED)
+					));
+				}
+			} else {
+				// packing works within each half, so the middle quarters need to be swapped back
+				_mm256_storeu_si256((__m256i*)(outputPointer + column),
+					_mm256_permute4x64_epi64(_mm256_packus_epi32(duDvs[0], duDvs[1]), _MM_SHUFFLE(3, 1, 2, 0)));
+			}
+		}
+
+		// the SSE4.1 version can still do some of what is left over
+		return column + convertHeightMapIntoDuDvBumpMapRowSSE41<luminance>(
+			columns - column,
+			inputPointer + column,
+			inputVPointer + column,
+			getDuDvBumpColorPointer<luminance>(outputPointer, column)
+		);
+	}
+	#endif
+
+	#ifdef SIMD_NEON
+	static uint32x4_t getDuDvNEON(const M4Image::Color32* inputPointer, const M4Image::Color32* inputVPointer, uint32x4_t &color) {
+		const uint32x4_t MASK_DU = vdupq_n_u32(0x000000FF);
+		const uint32x4_t MASK_DV = vdupq_n_u32(0x0000FF00);
+
+		uint8x16_t bytes = vld1q_u8((const uint8_t*)inputPointer);
+		uint32x4_t du = vreinterpretq_u32_u8(vsubq_u8(bytes, vld1q_u8((const uint8_t*)(inputPointer + 1))));
+		uint32x4_t dv = vreinterpretq_u32_u8(vsubq_u8(bytes, vld1q_u8((const uint8_t*)inputVPointer)));
+
+		color = vreinterpretq_u32_u8(bytes);
+		return vorrq_u32(vandq_u32(du, MASK_DU), vandq_u32(vshlq_n_u32(dv, 8), MASK_DV));
+	}
+
+	template<bool luminance>
+	static Dimension convertHeightMapIntoDuDvBumpMapRowNEON(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputVPointer,
+		M4Image::Color16* outputPointer
+	) {
+		static constexpr Dimension STEP = sizeof(uint32x4_t) / sizeof(M4Image::Color32);
+
+		const uint32x4_t MASK_LUMINANCE = vdupq_n_u32(0x00FF0000);
+		const uint32x4_t MASK_UNUSED = vdupq_n_u32(0xFF000000);
+
+		uint32x4_t colors[2] = {};
+		uint32x4_t duDvs[2] = {};
+
+		Dimension column = 0;
+
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			duDvs[0] = getDuDvNEON(inputPointer + column, inputVPointer + column, colors[0]);
+			duDvs[1] = getDuDvNEON(inputPointer + column + STEP, inputVPointer + column + STEP, colors[1]);
+
+			if constexpr (luminance) {
+				for (Dimension i = 0; i < 2; i++) {
+					uint32_t* colorPointer = (uint32_t*)((M4Image::Color32*)outputPointer + column + STEP * i);
+
+					vst1q_u32(colorPointer, vorrq_u32(
+						vorrq_u32(duDvs[i], vandq_u32(vshrq_n_u32(colors[i], 8), MASK_LUMINANCE)),
+						vandq_u32(vld1q_u32(colorPointer), MASK_UNUSED)
+					));
+				}
+			} else {
+				vst1q_u16((uint16_t*)(outputPointer + column), vcombine_u16(vmovn_u32(duDvs[0]), vmovn_u32(duDvs[1])));
+			}
+		}
+		return column;
+	}
+	#endif
+
+	template<bool luminance>
+	ConvertHeightMapIntoDuDvBumpMapRow getConvertHeightMapIntoDuDvBumpMapRow(SIMD::Level level) {
+		switch (level) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			return convertHeightMapIntoDuDvBumpMapRowAVX2<luminance>;
+			case SIMD::Level::SSE41:
+			return convertHeightMapIntoDuDvBumpMapRowSSE41<luminance>;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return convertHeightMapIntoDuDvBumpMapRowNEON<luminance>;
+			#endif
+			default:
+			break;
+		}
+		return convertHeightMapIntoDuDvBumpMapRowScalar<luminance>;
+	}
+
+	template<bool luminance>
+	void convertHeightMapIntoDuDvBumpMapColor(
+		Dimension width, Dimension height,
+		M4Image::Color32* inputPointer, Stride inputStride,
+		M4Image::Color16* outputPointer, Stride outputStride,
+		const M4Image::Color32* lastInputVPointer,
+		SIMD::Level level
+	) {
+		if (!width || !height) {
+			return;
+		}
+
+		const ConvertHeightMapIntoDuDvBumpMapRow CONVERT_HEIGHT_MAP_INTO_DUDV_BUMP_MAP_ROW = getConvertHeightMapIntoDuDvBumpMapRow<luminance>(level);
+
+		const Dimension LAST_COLUMN = width - 1;
+		const Dimension LAST_ROW = height - 1;
+
+		const M4Image::Color32* inputVPointer = nullptr;
+		Dimension column = 0;
+
+		for (Dimension row = 0; row <= LAST_ROW; row++) {
+			// inputVPointer should point to the row below (or this one, on the last row)
+			inputVPointer = (row == LAST_ROW)
+				? (lastInputVPointer ? lastInputVPointer : inputPointer)
+				: (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
+
+			column = CONVERT_HEIGHT_MAP_INTO_DUDV_BUMP_MAP_ROW(LAST_COLUMN, inputPointer, inputVPointer, outputPointer);
+
+			for (; column < LAST_COLUMN; column++) {
+				convertHeightIntoDuDvBumpColor<luminance>(
+					inputPointer[column], inputPointer[column + 1], inputVPointer[column],
+					getDuDvBumpColorPointer<luminance>(outputPointer, column)
+				);
+			}
+
+			// the last column uses itself as the pixel one column right
+			convertHeightIntoDuDvBumpColor<luminance>(
+				inputPointer[LAST_COLUMN], inputPointer[LAST_COLUMN], inputVPointer[LAST_COLUMN],
+				getDuDvBumpColorPointer<luminance>(outputPointer, LAST_COLUMN)
+			);
+
+			inputPointer = (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
+			outputPointer = (M4Image::Color16*)((unsigned char*)outputPointer + outputStride);
+		}
+	}
+
+	// the scalar version of the below, also used for the columns the SIMD versions don't do
+	static void convertHeightIntoNormalColor(
+		const M4Image::Color32 &inputColor,
+		const M4Image::Color32 &inputXColor,
+		const M4Image::Color32 &inputYColor,
+		M4Image::Color32 &outputColor,
+		double strength
+	) {
+		static constexpr size_t INPUT_CHANNEL_XY = 0;
+
+		static constexpr size_t OUTPUT_CHANNEL_B = 0;
+		static constexpr size_t OUTPUT_CHANNEL_G = 1;
+		static constexpr size_t OUTPUT_CHANNEL_R = 2;
+		static constexpr size_t OUTPUT_CHANNEL_A = 3;
+
+		static constexpr double MULTIPLIER = 127.0;
+		static constexpr unsigned char BGR_GRAY = 128;
+		static constexpr unsigned char ALPHA_OPAQUE = 255;
+
+		// these specifically need to be signed, we want them to either be negative or positive
+		// (but we only cast to signed char after doing the subtraction, as it's entirely expected this could underflow)
+		double x = strength * (inputXColor.channels[INPUT_CHANNEL_XY] - inputColor.channels[INPUT_CHANNEL_XY]);
+		double y = strength * (inputYColor.channels[INPUT_CHANNEL_XY] - inputColor.channels[INPUT_CHANNEL_XY]);
+		double z = 1.0 / sqrt(x * x + y * y + 1.0) * MULTIPLIER;
+
+		// the input channel must be read before the output is written, in case they are the same buffer
+		outputColor.channels[OUTPUT_CHANNEL_B] = (unsigned char)(BGR_GRAY + (unsigned char)z);
+		outputColor.channels[OUTPUT_CHANNEL_G] = (unsigned char)(BGR_GRAY - (unsigned char)(int)(y * z));
+		outputColor.channels[OUTPUT_CHANNEL_R] = (unsigned char)(BGR_GRAY - (unsigned char)(int)(x * z));
+		outputColor.channels[OUTPUT_CHANNEL_A] = ALPHA_OPAQUE;
+	}
+
+	static Dimension convertHeightMapIntoNormalMapRowScalar(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float strength
+	) {
+		return 0;
+	}
+
+	#ifdef SIMD_X86
+	SIMD_TARGET_SSE41 static void convertHeightIntoNormalColorSSE41(
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		__m128 strength
+	) {
+		const __m128i MASK = _mm_set1_epi32(0xFF);
+		const __m128i BGR_GRAY = _mm_set1_epi32(128);
+		const __m128i ALPHA_OPAQUE = _mm_set1_epi32((int)0xFF000000);
+		const __m128 ONE = _mm_set1_ps(1.0f);
+		const __m128 HALF = _mm_set1_ps(0.5f);
+		const __m128 THREE_HALVES = _mm_set1_ps(1.5f);
+		const __m128 MULTIPLIER = _mm_set1_ps(127.0f);
+
+		// the height is in the first channel of each pixel
+		__m128i height = _mm_and_si128(_mm_loadu_si128((const __m128i*)inputPointer), MASK);
+		__m128i heightX = _mm_and_si128(_mm_loadu_si128((const __m128i*)(inputPointer + 1)), MASK);
+		__m128i heightY = _mm_and_si128(_mm_loadu_si128((const __m128i*)inputYPointer), MASK);
+
+		__m128 x = _mm_mul_ps(strength, _mm_cvtepi32_ps(_mm_sub_epi32(heightX, height)));
+		__m128 y = _mm_mul_ps(strength, _mm_cvtepi32_ps(_mm_sub_epi32(heightY, height)));
+		__m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), ONE);
+
+		__m128 z = _mm_rsqrt_ps(length);
+		z = _mm_mul_ps(z, _mm_sub_ps(THREE_HALVES, _mm_mul_ps(_mm_mul_ps(HALF, length), _mm_mul_ps(z, z))));
+		z = _mm_mul_ps(z, MULTIPLIER);
+
+		__m128i b = _mm_add_epi32(BGR_GRAY, _mm_cvttps_epi32(z));
+		__m128i g = _mm_sub_epi32(BGR_GRAY, _mm_cvttps_epi32(_mm_mul_ps(y, z)));
+		__m128i r = _mm_sub_epi32(BGR_GRAY, _mm_cvttps_epi32(_mm_mul_ps(x, z)));
+
+		__m128i color = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(b, MASK), _mm_slli_epi32(_mm_and_si128(g, MASK), 8)),
+			_mm_or_si128(_mm_slli_epi32(_mm_and_si128(r, MASK), 16), ALPHA_OPAQUE)
+		);
+
+		_mm_storeu_si128((__m128i*)outputPointer, color);
+	}
+
+	SIMD_TARGET_SSE41 static Dimension convertHeightMapIntoNormalMapRowSSE41(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float strength
+	) {
+		static constexpr Dimension STEP = sizeof(__m128i) / sizeof(M4Image::Color32);
+
+		const __m128 STRENGTH = _mm_set1_ps(strength);
+
+		Dimension column = 0;
+
+		// two at a time, so there is something else to do while waiting on the first
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			convertHeightIntoNormalColorSSE41(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+			convertHeightIntoNormalColorSSE41(inputPointer + column + STEP, inputYPointer + column + STEP, outputPointer + column + STEP, STRENGTH);
+		}
+
+		for (; column + STEP <= columns; column += STEP) {
+			convertHeightIntoNormalColorSSE41(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+		}
+		return column;
+	}
+
+	SIMD_TARGET_AVX2 static void convertHeightIntoNormalColorAVX2(
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		__m256 strength
+	) {
+		const __m256i MASK = _mm256_set1_epi32(0xFF);
+		const __m256i BGR_GRAY = _mm256_set1_epi32(128);
+		const __m256i ALPHA_OPAQUE = _mm256_set1_epi32((int)0xFF000000);
+		const __m256 ONE = _mm256_set1_ps(1.0f);
+		const __m256 HALF = _mm256_set1_ps(0.5f);
+		const __m256 THREE_HALVES = _mm256_set1_ps(1.5f);
+		const __m256 MULTIPLIER = _mm256_set1_ps(127.0f);
+
+		__m256i height = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)inputPointer), MASK);
+		__m256i heightX = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(inputPointer + 1)), MASK);
+		__m256i heightY = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)inputYPointer), MASK);
+
+		__m256 x = _mm256_mul_ps(strength, _mm256_cvtepi32_ps(_mm256_sub_epi32(heightX, height)));
+		__m256 y = _mm256_mul_ps(strength, _mm256_cvtepi32_ps(_mm256_sub_epi32(heightY, height)));
+		__m256 length = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), ONE);
+
+		__m256 z = _mm256_rsqrt_ps(length);
+		z = _mm256_mul_ps(z, _mm256_sub_ps(THREE_HALVES, _mm256_mul_ps(_mm256_mul_ps(HALF, length), _mm256_mul_ps(z, z))));
+		z = _mm256_mul_ps(z, MULTIPLIER);
+
+		__m256i b = _mm256_add_epi32(BGR_GRAY, _mm256_cvttps_epi32(z));
+		__m256i g = _mm256_sub_epi32(BGR_GRAY, _mm256_cvttps_epi32(_mm256_mul_ps(y, z)));
+		__m256i r = _mm256_sub_epi32(BGR_GRAY, _mm256_cvttps_epi32(_mm256_mul_ps(x, z)));
+
+		__m256i color = _mm256_or_si256(
+			_mm256_or_si256(_mm256_and_si256(b, MASK), _mm256_slli_epi32(_mm256_and_si256(g, MASK), 8)),
+			_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(r, MASK), 16), ALPHA_OPAQUE)
+		);
+
+		_mm256_storeu_si256((__m256i*)outputPointer, color);
+	}
+
+	SIMD_TARGET_AVX2 static Dimension convertHeightMapIntoNormalMapRowAVX2(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float strength
+	) {
+		static constexpr Dimension STEP = sizeof(__m256i) / sizeof(M4Image::Color32);
+
+		const __m256 STRENGTH = _mm256_set1_ps(strength);
+
+		Dimension column = 0;
+
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			convertHeightIntoNormalColorAVX2(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+			convertHeightIntoNormalColorAVX2(inputPointer + column + STEP, inputYPointer + column + STEP, outputPointer + column + STEP, STRENGTH);
+		}
+
+		for (; column + STEP <= columns; column += STEP) {
+			convertHeightIntoNormalColorAVX2(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+		}
+
+		// the SSE4.1 version can still do some of what is left over
+		return column + convertHeightMapIntoNormalMapRowSSE41(
+			columns - column,
+			inputPointer + column,
+			inputYPointer + column,
+			outputPointer + column,
+			strength
+		);
+	}
+	#endif
+
+	#ifdef SIMD_NEON
+	static void convertHeightIntoNormalColorNEON(
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float32x4_t strength
+	) {
+		const uint32x4_t MASK = vdupq_n_u32(0xFF);
+		const int32x4_t BGR_GRAY = vdupq_n_s32(128);
+		const uint32x4_t ALPHA_OPAQUE = vdupq_n_u32(0xFF000000);
+		const float32x4_t ONE = vdupq_n_f32(1.0f);
+		const float32x4_t MULTIPLIER = vdupq_n_f32(127.0f);
+
+		int32x4_t height = vreinterpretq_s32_u32(vandq_u32(vld1q_u32((const uint32_t*)inputPointer), MASK));
+		int32x4_t heightX = vreinterpretq_s32_u32(vandq_u32(vld1q_u32((const uint32_t*)(inputPointer + 1)), MASK));
+		int32x4_t heightY = vreinterpretq_s32_u32(vandq_u32(vld1q_u32((const uint32_t*)inputYPointer), MASK));
+
+		float32x4_t x = vmulq_f32(strength, vcvtq_f32_s32(vsubq_s32(heightX, height)));
+		float32x4_t y = vmulq_f32(strength, vcvtq_f32_s32(vsubq_s32(heightY, height)));
+		float32x4_t length = vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), ONE);
+
+		// vrsqrtsq_f32 is the Newton-Raphson step: (3 - a * b) / 2
+		float32x4_t z = vrsqrteq_f32(length);
+		z = vmulq_f32(z, vrsqrtsq_f32(vmulq_f32(length, z), z));
+		z = vmulq_f32(z, MULTIPLIER);
+
+		uint32x4_t b = vreinterpretq_u32_s32(vaddq_s32(BGR_GRAY, vcvtq_s32_f32(z)));
+		uint32x4_t g = vreinterpretq_u32_s32(vsubq_s32(BGR_GRAY, vcvtq_s32_f32(vmulq_f32(y, z))));
+		uint32x4_t r = vreinterpretq_u32_s32(vsubq_s32(BGR_GRAY, vcvtq_s32_f32(vmulq_f32(x, z))));
+
+		uint32x4_t color = vorrq_u32(
+			vorrq_u32(vandq_u32(b, MASK), vshlq_n_u32(vandq_u32(g, MASK), 8)),
+			vorrq_u32(vshlq_n_u32(vandq_u32(r, MASK), 16), ALPHA_OPAQUE)
+		);
+
+		vst1q_u32((uint32_t*)outputPointer, color);
+	}
+
+	static Dimension convertHeightMapIntoNormalMapRowNEON(
+		Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float strength
+	) {
+		static constexpr Dimension STEP = sizeof(uint32x4_t) / sizeof(M4Image::Color32);
+
+		const float32x4_t STRENGTH = vdupq_n_f32(strength);
+
+		Dimension column = 0;
+
+		for (; column + STEP * 2 <= columns; column += STEP * 2) {
+			convertHeightIntoNormalColorNEON(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+			convertHeightIntoNormalColorNEON(inputPointer + column + STEP, inputYPointer + column + STEP, outputPointer + column + STEP, STRENGTH);
+		}
+
+		for (; column + STEP <= columns; column += STEP) {
+			convertHeightIntoNormalColorNEON(inputPointer + column, inputYPointer + column, outputPointer + column, STRENGTH);
+		}
+		return column;
+	}
+	#endif
+
+	ConvertHeightMapIntoNormalMapRow getConvertHeightMapIntoNormalMapRow(SIMD::Level level) {
+		switch (level) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			return convertHeightMapIntoNormalMapRowAVX2;
+			case SIMD::Level::SSE41:
+			return convertHeightMapIntoNormalMapRowSSE41;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return convertHeightMapIntoNormalMapRowNEON;
+			#endif
+			default:
+			break;
+		}
+		return convertHeightMapIntoNormalMapRowScalar;
+	}
+
+	void convertHeightMapIntoNormalMapColor(
+		Dimension width, Dimension height,
+		M4Image::Color32* inputPointer, Stride inputStride,
+		M4Image::Color32* outputPointer, Stride outputStride,
+		double strength,
+		const M4Image::Color32* lastInputYPointer,
+		SIMD::Level level
+	) {
+		if (!width || !height) {
+			return;
+		}
+
+		const ConvertHeightMapIntoNormalMapRow CONVERT_HEIGHT_MAP_INTO_NORMAL_MAP_ROW = getConvertHeightMapIntoNormalMapRow(level);
+
+		const Dimension LAST_COLUMN = width - 1;
+		const Dimension LAST_ROW = height - 1;
+
+		const M4Image::Color32* inputYPointer = nullptr;
+		Dimension column = 0;
+
+		for (Dimension row = 0; row <= LAST_ROW; row++) {
+			// inputYPointer should point to the row below (or this one, on the last row)
+			inputYPointer = (row == LAST_ROW)
+				? (lastInputYPointer ? lastInputYPointer : inputPointer)
+				: (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
+
+			column = CONVERT_HEIGHT_MAP_INTO_NORMAL_MAP_ROW(LAST_COLUMN, inputPointer, inputYPointer, outputPointer, (float)strength);
+
+			for (; column < LAST_COLUMN; column++) {
+				convertHeightIntoNormalColor(
+					inputPointer[column], inputPointer[column + 1], inputYPointer[column],
+					outputPointer[column], strength
+				);
+			}
+
+			// the last column uses itself as the pixel one column right
+			convertHeightIntoNormalColor(
+				inputPointer[LAST_COLUMN], inputPointer[LAST_COLUMN], inputYPointer[LAST_COLUMN],
+				outputPointer[LAST_COLUMN], strength
+			);
+
+			inputPointer = (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
+			outputPointer = (M4Image::Color32*)((unsigned char*)outputPointer + outputStride);
+		}
+	}
+
+	template ConvertHeightMapIntoDuDvBumpMapRow getConvertHeightMapIntoDuDvBumpMapRow<false>(SIMD::Level level);
+	template ConvertHeightMapIntoDuDvBumpMapRow getConvertHeightMapIntoDuDvBumpMapRow<true>(SIMD::Level level);
+
+	template void convertHeightMapIntoDuDvBumpMapColor<false>(
+		Dimension width, Dimension height,
+		M4Image::Color32* inputPointer, Stride inputStride,
+		M4Image::Color16* outputPointer, Stride outputStride,
+		const M4Image::Color32* lastInputVPointer,
+		SIMD::Level level
+	);
+
+	template void convertHeightMapIntoDuDvBumpMapColor<true>(
+		Dimension width, Dimension height,
+		M4Image::Color32* inputPointer, Stride inputStride,
+		M4Image::Color16* outputPointer, Stride outputStride,
+		const M4Image::Color32* lastInputVPointer,
+		SIMD::Level level
+	);
+
+}
\ No newline at end of file
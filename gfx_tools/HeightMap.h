@@ -0,0 +1,60 @@
+#pragma once
+#include "main.h"
+#include "SIMD.h"
+#include <M4Image.h>
+
+// the kernels behind ConvertHeightMapIntoDuDvBumpMap and ConvertHeightMapIntoNormalMap
+// each row is converted with AVX2, SSE4.1 or NEON as far as it can be, and the rest is done one pixel at a time
+// the level can be chosen (instead of the CPU's) so that every one of them can be tested against the scalar version
+namespace HeightMap {
+	// like the normal map ones below, the SIMD versions convert as much of a row as they can
+	// and return how many columns they did (columns is never the last column)
+	// they are exact, and keep the same in place semantics as the scalar version:
+	// every load happens before the store that could overwrite it
+	using ConvertHeightMapIntoDuDvBumpMapRow = gfx_tools::Dimension(*)(
+		gfx_tools::Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputVPointer,
+		M4Image::Color16* outputPointer
+	);
+
+	// returns the scalar version (which does nothing) for a level that this build doesn't have
+	template<bool luminance>
+	ConvertHeightMapIntoDuDvBumpMapRow getConvertHeightMapIntoDuDvBumpMapRow(SIMD::Level level);
+
+	// lastInputVPointer is the row below the last row, if there is one
+	// (this is for converting bands of a larger image)
+	// in luminance mode, the output is actually Color32 (XLVU instead of VU)
+	template<bool luminance>
+	void convertHeightMapIntoDuDvBumpMapColor(
+		gfx_tools::Dimension width, gfx_tools::Dimension height,
+		M4Image::Color32* inputPointer, gfx_tools::Stride inputStride,
+		M4Image::Color16* outputPointer, gfx_tools::Stride outputStride,
+		const M4Image::Color32* lastInputVPointer = nullptr,
+		SIMD::Level level = SIMD::LEVEL
+	);
+
+	// the SIMD versions convert as much of a row as they can, and return how many columns they did
+	// columns is never the last column, so the pixel one column right can always be read
+	// they use a float reciprocal square root (with one Newton-Raphson step) instead of doubles
+	// so may be off by one from the scalar version
+	using ConvertHeightMapIntoNormalMapRow = gfx_tools::Dimension(*)(
+		gfx_tools::Dimension columns,
+		const M4Image::Color32* inputPointer,
+		const M4Image::Color32* inputYPointer,
+		M4Image::Color32* outputPointer,
+		float strength
+	);
+
+	ConvertHeightMapIntoNormalMapRow getConvertHeightMapIntoNormalMapRow(SIMD::Level level);
+
+	// lastInputYPointer is the row below the last row, if there is one
+	void convertHeightMapIntoNormalMapColor(
+		gfx_tools::Dimension width, gfx_tools::Dimension height,
+		M4Image::Color32* inputPointer, gfx_tools::Stride inputStride,
+		M4Image::Color32* outputPointer, gfx_tools::Stride outputStride,
+		double strength,
+		const M4Image::Color32* lastInputYPointer = nullptr,
+		SIMD::Level level = SIMD::LEVEL
+	);
+}
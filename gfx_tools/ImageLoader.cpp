@@ -1,5 +1,9 @@
 #include "pch.h"
 #include "ImageLoader.h"
+#include "Resample.h"
+#include "DecodeCache.h"
+#include "Swizzle.h"
+#include "Pool.h"
 #include <M4Image.h>
 
 namespace gfx_tools {
@@ -46,6 +50,8 @@ namespace gfx_tools {
 	}
 
 	ImageLoaderMultipleBuffer::~ImageLoaderMultipleBuffer() {
+		WaitPrefetches();
+		WaitEncodes();
 	}
 
 	void ImageLoaderMultipleBuffer::GetLOD(Lod lod, RawBuffer::Pointer pointer, Size stride, Size sizeInBytes) {
@@ -77,9 +83,49 @@ namespace gfx_tools {
 		// we want an exception to occur if it has no value
 		const RawBufferEx &rawBuffer = rawBufferOptionals[lod].value();
 
+		static constexpr ImageInfo::BitsPerPixel BYTES = 3;
+
 		if (rawBuffer.resizeInfoOptional.has_value()) {
 			const RawBufferEx::ResizeInfo &resizeInfo = rawBuffer.resizeInfoOptional.value();
 
+			// if nothing needs resizing, pixman is skipped and the rows are just copied (or swizzled)
+			if (resizeInfo.width == imageInfo.textureWidth
+				&& resizeInfo.height == imageInfo.textureHeight) {
+				const M4Image::COLOR_FORMAT RESIZE_COLOR_FORMAT = resizeImageInfo.GetColorFormat();
+				const M4Image::COLOR_FORMAT COLOR_FORMAT = imageInfo.GetColorFormat();
+
+				if (RESIZE_COLOR_FORMAT == COLOR_FORMAT) {
+					if (!imageInfo.textureHeight) {
+						return;
+					}
+
+					const size_t ROW_SIZE = (size_t)imageInfo.textureWidth * (imageInfo.GetBitsPerPixel() >> BYTES);
+
+					if (resizeInfo.stride == stride) {
+						memcpy(pointer, rawBuffer.pointer, ((size_t)(imageInfo.textureHeight - 1) * (size_t)stride) + ROW_SIZE);
+						return;
+					}
+
+					const unsigned char* rawBufferRowPointer = rawBuffer.pointer;
+
+					for (ImageInfo::Dimension row = 0; row < imageInfo.textureHeight; row++) {
+						memcpy(pointer, rawBufferRowPointer, ROW_SIZE);
+
+						pointer += stride;
+						rawBufferRowPointer += resizeInfo.stride;
+					}
+					return;
+				}
+
+				if (Swizzle::convert(
+					rawBuffer.pointer, RESIZE_COLOR_FORMAT, resizeInfo.stride,
+					pointer, COLOR_FORMAT, stride,
+					imageInfo.textureWidth, imageInfo.textureHeight
+				)) {
+					return;
+				}
+			}
+
 			size_t m4ImageStride = resizeInfo.stride;
 
 			const M4Image rawBufferM4Image(
@@ -104,7 +150,47 @@ namespace gfx_tools {
 			return;
 		}
 
-		LoadRawBuffer(rawBuffer, imageInfo, pointer, stride);
+		// this is only as much as the decoder writes: the last row doesn't have to be a whole stride
+		DecodeCache::Size decodeSize = imageInfo.textureHeight
+			? ((size_t)(imageInfo.textureHeight - 1) * (size_t)stride) + ((size_t)imageInfo.textureWidth * (imageInfo.GetBitsPerPixel() >> BYTES))
+			: 0;
+
+		DecodeCache &decodeCache = DecodeCache::get();
+		std::optional<DecodeCache::Key> keyOptional = std::nullopt;
+
+		if (decodeCache.getCapacity() && rawBuffer.pointer && decodeSize) {
+			// the raw buffer is hashed once, the first time it's gotten, not every time
+			// (not when it's set, because CreateLODRawBuffer sets it before the game fills it in)
+			auto &rawBufferHashOptional = rawBufferHashOptionals[lod];
+
+			if (!rawBufferHashOptional.has_value()) {
+				rawBufferHashOptional = Hash::get(rawBuffer.pointer, rawBuffer.size);
+			}
+
+			const DecodeCache::Key &KEY = keyOptional.emplace(
+				rawBufferHashOptional.value(),
+				rawBuffer.size,
+				GetExtension(),
+				imageInfo.textureWidth,
+				imageInfo.textureHeight,
+				imageInfo.GetColorFormat(),
+				stride
+			);
+
+			if (decodeCache.copy(KEY, pointer, decodeSize)) {
+				// so the workers don't decode it for nothing
+				prefetchOptionals[lod] = std::nullopt;
+				return;
+			}
+		}
+
+		if (!LoadPrefetch(lod, imageInfo, pointer, stride)) {
+			LoadRawBuffer(rawBuffer, imageInfo, pointer, stride);
+		}
+
+		if (keyOptional.has_value()) {
+			decodeCache.insert(keyOptional.value(), pointer, decodeSize);
+		}
 	}
 
 	void ImageLoaderMultipleBuffer::ResizeLOD(
@@ -128,36 +214,82 @@ namespace gfx_tools {
 		}
 		*/
 
-		size_t m4ImageStride = stride;
+		static constexpr ImageInfo::BitsPerPixel BYTES = 3;
 
-		const M4Image m4Image(
-			imageInfo.textureWidth,
-			imageInfo.textureHeight,
-			m4ImageStride,
-			imageInfo.GetColorFormat(),
-			pointer
-		);
+		// pixman (which GetLOD blits with) requires the stride to be a multiple of four
+		static constexpr size_t STRIDE_ALIGNMENT = 4;
 
-		m4ImageStride = 0;
+		int bytes = imageInfo.GetBitsPerPixel() >> BYTES;
 
-		M4Image resizeM4Image(
-			(int)resizeTextureWidth,
-			(int)resizeTextureHeight,
-			m4ImageStride,
-			imageInfo.GetColorFormat()
-		);
+		size_t resizeStride = (size_t)resizeTextureWidth * bytes;
+		resizeStride = ((resizeStride + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT) * STRIDE_ALIGNMENT;
+
+		RawBuffer::Size resizeSize = (RawBuffer::Size)(resizeTextureHeight * resizeStride);
+		RawBuffer::Pointer resizePointer = (RawBuffer::Pointer)Pool::ALLOCATOR.mallocSafe(resizeSize);
+
+		{
+			MAKE_SCOPE_EXIT(resizePointerScopeExit) {
+				Pool::ALLOCATOR.freeSafe(resizePointer);
+			};
 
-		resizeM4Image.blit(m4Image);
+			const M4Image::COLOR_FORMAT COLOR_FORMAT = imageInfo.GetColorFormat();
+
+			switch (COLOR_FORMAT) {
+				case M4Image::COLOR_FORMAT::RGBA:
+				case M4Image::COLOR_FORMAT::BGRA:
+				case M4Image::COLOR_FORMAT::LA:
+				case M4Image::COLOR_FORMAT::AL:
+				{
+					// Resample resizes the alpha straight, like any other channel
+					// but the colour needs to be weighted by the alpha, or transparent pixels bleed into their neighbours
+					// so images with alpha are still blitted with M4Image, which does that
+					size_t m4ImageStride = stride;
+
+					const M4Image m4Image(
+						imageInfo.textureWidth,
+						imageInfo.textureHeight,
+						m4ImageStride,
+						COLOR_FORMAT,
+						pointer
+					);
+
+					m4ImageStride = resizeStride;
+
+					M4Image resizeM4Image(
+						(int)resizeTextureWidth,
+						(int)resizeTextureHeight,
+						m4ImageStride,
+						COLOR_FORMAT,
+						resizePointer
+					);
+
+					resizeM4Image.blit(m4Image);
+				}
+				break;
+				default:
+				// every channel is resized the same way, so the colour format doesn't matter, only its size
+				Resample::resize(
+					pointer, (int)imageInfo.textureWidth, (int)imageInfo.textureHeight, stride,
+					resizePointer, (int)resizeTextureWidth, (int)resizeTextureHeight, resizeStride,
+					bytes
+				);
+			}
 
-		RawBufferEx::ResizeInfo resizeInfo((int)resizeTextureWidth, (int)resizeTextureHeight, m4ImageStride, qFactor);
+			resizePointerScopeExit.dismiss();
+		}
+
+		RawBufferEx::ResizeInfo resizeInfo((int)resizeTextureWidth, (int)resizeTextureHeight, resizeStride, qFactor);
 
 		SetLODRawBufferImpEx(
 			lod,
-			resizeM4Image.acquire(), (RawBuffer::Size)(resizeTextureHeight * m4ImageStride),
+			resizePointer, resizeSize,
 			true, resizeInfo, 0
 		);
 
 		resizeImageInfo = imageInfo;
+
+		// GetLODRawBuffer is going to want this encoded, so get a head start on it
+		EncodeLOD(lod);
 	}
 
 	void ImageLoaderMultipleBuffer::SetLOD(
@@ -179,7 +311,7 @@ namespace gfx_tools {
 	}
 
 	RawBuffer::Pointer ImageLoaderMultipleBuffer::CreateLODRawBuffer(Lod lod, RawBuffer::Size size) {
-		RawBuffer::Pointer pointer = (RawBuffer::Pointer)M4Image::allocator.mallocSafe(size);
+		RawBuffer::Pointer pointer = (RawBuffer::Pointer)Pool::ALLOCATOR.mallocSafe(size);
 		SetLODRawBufferImp(lod, pointer, size, true, 0);
 		return pointer;
 	}
@@ -223,7 +355,28 @@ namespace gfx_tools {
 		const RawBufferEx &rawBuffer = rawBufferOptional.value();
 
 		if (rawBuffer.resizeInfoOptional.has_value()) {
-			SaveRawBuffer(rawBuffer, pointer, size);
+			// ResizeLOD will have started encoding it already, but if that failed, try again
+			auto &encodeOptional = encodeOptionals[lod];
+
+			if (!encodeOptional.has_value()) {
+				EncodeLOD(lod);
+			}
+
+			Encode &encode = encodeOptional.value();
+
+			if (encode.future.valid()) {
+				try {
+					encode.future.get();
+				} catch (...) {
+					encodeOptional = std::nullopt;
+					throw;
+				}
+			}
+
+			// the caller gets their own copy to free, the same as when it was encoded every time
+			pointer = (RawBuffer::Pointer)M4Image::allocator.mallocSafe(encode.size);
+			memcpy(pointer, encode.pointer, encode.size);
+			size = encode.size;
 			pointerScopeExit.dismiss();
 			return;
 		}
@@ -297,11 +450,15 @@ namespace gfx_tools {
 			pointer
 		);
 
+		// if the image info is smaller than the image (because of the max texture size) M4Image decodes it
+		// at full size and scales it down itself
+		// a JPEG could be decoded at 1/2, 1/4 or 1/8 scale much faster, but neither M4Image nor libzap
+		// give us any way to ask for that, so this is left as it is until they do
 		m4Image.load(rawBuffer.pointer, rawBuffer.size, GetExtension());
 	}
 
 	void ImageLoaderMultipleBuffer::SaveRawBuffer(
-		const RawBufferEx &rawBuffer, RawBuffer::Pointer &pointer, RawBuffer::Size &size
+		const RawBufferEx &rawBuffer, const ImageInfo &imageInfo, RawBuffer::Pointer &pointer, RawBuffer::Size &size
 	) {
 		const RawBufferEx::ResizeInfo &resizeInfo = rawBuffer.resizeInfoOptional.value();
 
@@ -311,7 +468,7 @@ namespace gfx_tools {
 			resizeInfo.width,
 			resizeInfo.height,
 			m4ImageStride,
-			resizeImageInfo.GetColorFormat(),
+			imageInfo.GetColorFormat(),
 			rawBuffer.pointer
 		);
 
@@ -415,6 +572,7 @@ namespace gfx_tools {
 		}
 
 		validatedImageInfoOptionalScopeExit.dismiss();
+		PrefetchLODs();
 	}
 
 	void ImageLoaderMultipleBuffer::SetLODRawBufferImpEx(
@@ -427,7 +585,7 @@ namespace gfx_tools {
 		// we free on behalf of RawBufferEx, at least until we handoff to it
 		MAKE_SCOPE_EXIT(pointerScopeExit) {
 			if (owner) {
-				M4Image::allocator.freeSafe(pointer);
+				Pool::ALLOCATOR.freeSafe(pointer);
 			}
 		};
 
@@ -439,10 +597,15 @@ namespace gfx_tools {
 			numberOfRawBuffers = (Size)(lod + 1);
 		}
 
+		// a prefetch or encode of the old raw buffer must be done with it before it's replaced
+		prefetchOptionals[lod] = std::nullopt;
+		encodeOptionals[lod] = std::nullopt;
+
 		auto &rawBufferOptional = rawBufferOptionals[lod];
 		RawBuffer::Size difference = rawBufferOptional.has_value() ? rawBufferOptional.value().size : 0;
 
 		rawBufferOptional.emplace(pointer, size, owner, resizeInfoOptional);
+		rawBufferHashOptionals[lod] = std::nullopt;
 		pointerScopeExit.dismiss();
 
 		rawBufferTotalSize += size - difference;
@@ -460,6 +623,187 @@ namespace gfx_tools {
 		}
 	}
 
+	ImageLoaderMultipleBuffer::Prefetch::~Prefetch() {
+		if (!taskPointer || workersPointer->cancel(taskPointer)) {
+			return;
+		}
+
+		try {
+			workersPointer->wait(taskPointer);
+		} catch (...) {
+			// the prefetch is being thrown away anyway
+		}
+	}
+
+	void ImageLoaderMultipleBuffer::PrefetchLODs() {
+		Workers::Pointer workersPointer = getWorkers();
+
+		// with nothing to decode them at the same time, it'd be slower to decode them early and copy them
+		if (!workersPointer) {
+			return;
+		}
+
+		const ImageInfo &imageInfo = validatedImageInfoOptional.value().Get();
+
+		static constexpr Lod MAIN_LOD = 0;
+
+		for (Lod lod = MAIN_LOD + 1; lod < numberOfRawBuffers; lod++) {
+			auto &prefetchOptional = prefetchOptionals[lod];
+
+			// if the image info is gotten again, the LODs that are already being prefetched are left alone
+			if (prefetchOptional.has_value()) {
+				continue;
+			}
+
+			// a prefetch that can't be started isn't an error, the LOD is just decoded when it's gotten
+			try {
+				PrefetchLOD(lod, imageInfo, workersPointer);
+			} catch (...) {
+				prefetchOptional = std::nullopt;
+			}
+		}
+	}
+
+	void ImageLoaderMultipleBuffer::PrefetchLOD(Lod lod, const ImageInfo &imageInfo, const Workers::Pointer &workersPointer) {
+		const auto &rawBufferOptional = rawBufferOptionals[lod];
+
+		if (!rawBufferOptional.has_value()) {
+			return;
+		}
+
+		const RawBufferEx &rawBuffer = rawBufferOptional.value();
+
+		// resized LODs are already decoded, so there is nothing to gain
+		if (!rawBuffer.pointer || rawBuffer.resizeInfoOptional.has_value()) {
+			return;
+		}
+
+		static constexpr ImageInfo::BitsPerPixel BYTES = 3;
+
+		// same as in ResizeLOD
+		static constexpr size_t STRIDE_ALIGNMENT = 4;
+
+		size_t stride = (size_t)imageInfo.textureWidth * (imageInfo.GetBitsPerPixel() >> BYTES);
+		stride = ((stride + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT) * STRIDE_ALIGNMENT;
+
+		size_t size = (size_t)imageInfo.textureHeight * stride;
+
+		if (!size) {
+			return;
+		}
+
+		Prefetch &prefetch = prefetchOptionals[lod].emplace();
+		prefetch.imageInfo = imageInfo;
+		prefetch.stride = stride;
+		prefetch.pointer = std::unique_ptr<unsigned char[]>(new unsigned char[size]);
+		prefetch.workersPointer = workersPointer;
+
+		// errors are kept in the task, and GetLOD just decodes it again to get the same error as usual
+		// (the prefetch is always done with before the raw buffer or the prefetch itself goes away)
+		prefetch.taskPointer = workersPointer->post([this, &rawBuffer, &prefetch] {
+			LoadRawBuffer(rawBuffer, prefetch.imageInfo, prefetch.pointer.get(), (Size)prefetch.stride);
+		});
+	}
+
+	bool ImageLoaderMultipleBuffer::LoadPrefetch(Lod lod, const ImageInfo &imageInfo, RawBuffer::Pointer pointer, Size stride) {
+		auto &prefetchOptional = prefetchOptionals[lod];
+
+		if (!prefetchOptional.has_value()) {
+			return false;
+		}
+
+		// a prefetch is only ever used once, whether it was any good or not
+		SCOPE_EXIT {
+			prefetchOptional = std::nullopt;
+		};
+
+		Prefetch &prefetch = prefetchOptional.value();
+
+		if (prefetch.imageInfo.textureWidth != imageInfo.textureWidth
+			|| prefetch.imageInfo.textureHeight != imageInfo.textureHeight
+			|| prefetch.imageInfo.GetColorFormat() != imageInfo.GetColorFormat()) {
+			return false;
+		}
+
+		Workers &workers = *prefetch.workersPointer;
+
+		// if no worker has got to it yet, it's quicker to decode it straight into the pointer than to decode it and copy it
+		if (workers.cancel(prefetch.taskPointer)) {
+			prefetch.taskPointer = nullptr;
+			return false;
+		}
+
+		try {
+			workers.wait(prefetch.taskPointer);
+		} catch (...) {
+			return false;
+		}
+
+		prefetch.taskPointer = nullptr;
+
+		static constexpr ImageInfo::BitsPerPixel BYTES = 3;
+
+		const size_t ROW_SIZE = (size_t)imageInfo.textureWidth * (imageInfo.GetBitsPerPixel() >> BYTES);
+
+		const unsigned char* prefetchRowPointer = prefetch.pointer.get();
+
+		for (ImageInfo::Dimension row = 0; row < imageInfo.textureHeight; row++) {
+			memcpy(pointer, prefetchRowPointer, ROW_SIZE);
+
+			pointer += stride;
+			prefetchRowPointer += prefetch.stride;
+		}
+		return true;
+	}
+
+	void ImageLoaderMultipleBuffer::WaitPrefetches() {
+		// destroying a prefetch waits for its decode
+		for (Lod lod = 0; lod < NUMBER_OF_LOD_MAX; lod++) {
+			prefetchOptionals[lod] = std::nullopt;
+		}
+	}
+
+	ImageLoaderMultipleBuffer::Encode::~Encode() {
+		if (future.valid()) {
+			future.wait();
+		}
+
+		M4Image::allocator.freeSafe(pointer);
+	}
+
+	void ImageLoaderMultipleBuffer::EncodeLOD(Lod lod) {
+		auto &encodeOptional = encodeOptionals[lod];
+		encodeOptional = std::nullopt;
+
+		const RawBufferEx &rawBuffer = rawBufferOptionals[lod].value();
+
+		// the image info is copied, because resizeImageInfo changes with the next ResizeLOD
+		Encode &encode = encodeOptional.emplace();
+		encode.imageInfo = resizeImageInfo;
+
+		// the encode is kept until the LOD is set again (and always waited for before the raw buffer goes away)
+		encode.future = std::async(std::launch::async, [this, &rawBuffer, &encode] {
+			RawBuffer::Pointer pointer = nullptr;
+			RawBuffer::Size size = 0;
+			SaveRawBuffer(rawBuffer, encode.imageInfo, pointer, size);
+
+			encode.pointer = pointer;
+			encode.size = size;
+		});
+	}
+
+	void ImageLoaderMultipleBuffer::WaitEncodes() {
+		// destroying an encode waits for it
+		for (Lod lod = 0; lod < NUMBER_OF_LOD_MAX; lod++) {
+			encodeOptionals[lod] = std::nullopt;
+		}
+	}
+
+	ImageLoaderMultipleBufferZAP::~ImageLoaderMultipleBufferZAP() {
+		WaitPrefetches();
+		WaitEncodes();
+	}
+
 	const L_TCHAR* ImageLoaderMultipleBufferZAP::GetExtension() {
 		return "ZAP";
 	}
@@ -514,7 +858,7 @@ namespace gfx_tools {
 	}
 
 	void ImageLoaderMultipleBufferZAP::SaveRawBuffer(
-		const RawBufferEx &rawBuffer, RawBuffer::Pointer &pointer, RawBuffer::Size &size
+		const RawBufferEx &rawBuffer, const ImageInfo &imageInfo, RawBuffer::Pointer &pointer, RawBuffer::Size &size
 	) {
 		const RawBufferEx::ResizeInfo &RESIZE_INFO = rawBuffer.resizeInfoOptional.value();
 
@@ -527,7 +871,7 @@ namespace gfx_tools {
 			RESIZE_INFO.width,
 			RESIZE_INFO.height,
 			zapStride,
-			(zap_uint_t)resizeImageInfo.GetColorFormat(),
+			(zap_uint_t)imageInfo.GetColorFormat(),
 			ZAP_IMAGE_FORMAT_JPG,
 			ZAP_IMAGE_FORMAT_PNG
 		);
@@ -539,6 +883,11 @@ namespace gfx_tools {
 		size = (Size)zapSize;
 	}
 
+	ImageLoaderMultipleBufferTGA::~ImageLoaderMultipleBufferTGA() {
+		WaitPrefetches();
+		WaitEncodes();
+	}
+
 	const L_TCHAR* ImageLoaderMultipleBufferTGA::GetExtension() {
 		return "TGA";
 	}
@@ -547,6 +896,11 @@ namespace gfx_tools {
 		return FILE_TGA;
 	}
 
+	ImageLoaderMultipleBufferPNG::~ImageLoaderMultipleBufferPNG() {
+		WaitPrefetches();
+		WaitEncodes();
+	}
+
 	const L_TCHAR* ImageLoaderMultipleBufferPNG::GetExtension() {
 		return "PNG";
 	}
@@ -555,6 +909,11 @@ namespace gfx_tools {
 		return FILE_PNG;
 	}
 
+	ImageLoaderMultipleBufferJPEG::~ImageLoaderMultipleBufferJPEG() {
+		WaitPrefetches();
+		WaitEncodes();
+	}
+
 	const L_TCHAR* ImageLoaderMultipleBufferJPEG::GetExtension() {
 		return "JPEG"; // normally "JFIF" but must be "JPEG" for M4Image to recognize it
 	}
@@ -563,6 +922,11 @@ namespace gfx_tools {
 		return FILE_JPEG;
 	}
 
+	ImageLoaderMultipleBufferBMP::~ImageLoaderMultipleBufferBMP() {
+		WaitPrefetches();
+		WaitEncodes();
+	}
+
 	const L_TCHAR* ImageLoaderMultipleBufferBMP::GetExtension() {
 		return "BMP";
 	}
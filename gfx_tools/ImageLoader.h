@@ -5,7 +5,11 @@
 #include "ImageInfo.h"
 #include "PixelFormat.h"
 #include "FormatHint.h"
+#include "Hash.h"
+#include "Workers.h"
 #include <optional>
+#include <memory>
+#include <future>
 
 namespace gfx_tools {
 	class ImageLoader : public ares::Resource {
@@ -95,7 +99,7 @@ namespace gfx_tools {
 		) = 0;
 
 		virtual void GFX_TOOLS_CALL SaveRawBuffer(
-			const RawBufferEx &rawBuffer, RawBuffer::Pointer &pointer, RawBuffer::Size &size
+			const RawBufferEx &rawBuffer, const ImageInfo &imageInfo, RawBuffer::Pointer &pointer, RawBuffer::Size &size
 		) = 0;
 
 		virtual void GFX_TOOLS_CALL GetImageInfoImpEx() = 0;
@@ -187,7 +191,7 @@ namespace gfx_tools {
 		) override;
 
 		virtual void GFX_TOOLS_CALL SaveRawBuffer(
-			const RawBufferEx &rawBuffer, RawBuffer::Pointer &pointer, RawBuffer::Size &size
+			const RawBufferEx &rawBuffer, const ImageInfo &imageInfo, RawBuffer::Pointer &pointer, RawBuffer::Size &size
 		) override;
 
 		virtual void GFX_TOOLS_CALL GetImageInfoImpEx() override;
@@ -200,12 +204,61 @@ namespace gfx_tools {
 			ubi::RefCounted* refCountedPointer = nullptr
 		) override;
 
+		struct Prefetch {
+			ImageInfo imageInfo;
+			size_t stride = 0;
+			std::unique_ptr<unsigned char[]> pointer = nullptr;
+
+			// the decode is done by the workers, and is taken back or waited for before the pointer is freed
+			Workers::Pointer workersPointer = nullptr;
+			Workers::TaskPointer taskPointer = nullptr;
+
+			~Prefetch();
+		};
+
+		// once the image info is known, every raw buffer has been filled in
+		// so the LODs after the first can be decoded by the workers while the first is gotten
+		void GFX_TOOLS_CALL PrefetchLODs();
+		void GFX_TOOLS_CALL PrefetchLOD(Lod lod, const ImageInfo &imageInfo, const Workers::Pointer &workersPointer);
+
+		bool GFX_TOOLS_CALL LoadPrefetch(Lod lod, const ImageInfo &imageInfo, RawBuffer::Pointer pointer, Size stride);
+
+		// the prefetches call LoadRawBuffer, which is virtual
+		// so every most derived destructor must call this first, before the object stops being what it was
+		void GFX_TOOLS_CALL WaitPrefetches();
+
+		struct Encode {
+			ImageInfo imageInfo;
+			RawBuffer::Pointer pointer = nullptr;
+			RawBuffer::Size size = 0;
+
+			// this is waited for before the pointer is freed
+			std::future<void> future = {};
+
+			~Encode();
+		};
+
+		void GFX_TOOLS_CALL EncodeLOD(Lod lod);
+
+		// same as WaitPrefetches, for SaveRawBuffer
+		void GFX_TOOLS_CALL WaitEncodes();
+
 		Size numberOfRawBuffers = 0;
 		std::optional<RawBufferEx> rawBufferOptionals[NUMBER_OF_LOD_MAX] = {};
+
+		// for the decode cache, so each raw buffer only has to be hashed once
+		std::optional<Hash::Value> rawBufferHashOptionals[NUMBER_OF_LOD_MAX] = {};
 		ImageInfo resizeImageInfo;
+
+		// these must come after the raw buffers, so they are done before the raw buffers are freed
+		std::optional<Prefetch> prefetchOptionals[NUMBER_OF_LOD_MAX] = {};
+		std::optional<Encode> encodeOptionals[NUMBER_OF_LOD_MAX] = {};
 	};
 
 	class ImageLoaderMultipleBufferZAP : public ImageLoaderMultipleBuffer {
+		public:
+		virtual GFX_TOOLS_CALL ~ImageLoaderMultipleBufferZAP();
+
 		protected:
 		virtual const L_TCHAR* GFX_TOOLS_CALL GetExtension() override;
 		virtual L_INT GFX_TOOLS_CALL GetFormat() override;
@@ -221,11 +274,14 @@ namespace gfx_tools {
 		) override;
 
 		virtual void GFX_TOOLS_CALL SaveRawBuffer(
-			const RawBufferEx &rawBuffer, RawBuffer::Pointer &pointer, Size &size
+			const RawBufferEx &rawBuffer, const ImageInfo &imageInfo, RawBuffer::Pointer &pointer, Size &size
 		) override;
 	};
 
 	class ImageLoaderMultipleBufferTGA : public ImageLoaderMultipleBuffer {
+		public:
+		virtual GFX_TOOLS_CALL ~ImageLoaderMultipleBufferTGA();
+
 		protected:
 		static constexpr L_INT FILE_TGA = 4;
 
@@ -234,6 +290,9 @@ namespace gfx_tools {
 	};
 
 	class ImageLoaderMultipleBufferPNG : public ImageLoaderMultipleBuffer {
+		public:
+		virtual GFX_TOOLS_CALL ~ImageLoaderMultipleBufferPNG();
+
 		protected:
 		static constexpr L_INT FILE_PNG = 75;
 
@@ -242,6 +301,9 @@ namespace gfx_tools {
 	};
 
 	class ImageLoaderMultipleBufferJPEG : public ImageLoaderMultipleBuffer {
+		public:
+		virtual GFX_TOOLS_CALL ~ImageLoaderMultipleBufferJPEG();
+
 		protected:
 		static constexpr L_INT FILE_JPEG = 10;
 
@@ -250,6 +312,9 @@ namespace gfx_tools {
 	};
 
 	class ImageLoaderMultipleBufferBMP : public ImageLoaderMultipleBuffer {
+		public:
+		virtual GFX_TOOLS_CALL ~ImageLoaderMultipleBufferBMP();
+
 		protected:
 		static constexpr L_INT FILE_BMP = 6;
 
@@ -0,0 +1,269 @@
+#include "pch.h"
+#include "Pool.h"
+#include <algorithm>
+#include <new>
+
+namespace gfx_tools {
+	struct ThreadCache {
+		// only classes up to 1 MB are kept per thread, so no thread sits on too much
+		static constexpr size_t CLASS_BITS_MAX = 20;
+		static constexpr size_t CLASS_INDEX_MAX = CLASS_BITS_MAX - Pool::CLASS_BITS_MIN;
+
+		// these are atomic so that Pool::clear can take them away from another thread
+		std::atomic<void*> blocks[CLASS_INDEX_MAX + 1] = {};
+
+		ThreadCache() {
+			Pool &pool = Pool::get();
+
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			pool.threadCacheVector.push_back(this);
+		}
+
+		~ThreadCache() {
+			Pool &pool = Pool::get();
+
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+
+				Pool::ThreadCacheVector::iterator threadCacheVectorIterator = std::find(
+					pool.threadCacheVector.begin(),
+					pool.threadCacheVector.end(),
+					this
+				);
+
+				if (threadCacheVectorIterator != pool.threadCacheVector.end()) {
+					pool.threadCacheVector.erase(threadCacheVectorIterator);
+				}
+			}
+
+			for (size_t i = 0; i <= CLASS_INDEX_MAX; i++) {
+				void* block = blocks[i].exchange(nullptr);
+
+				if (block) {
+					pool.freeShared(block, i);
+				}
+			}
+		}
+	};
+
+	static thread_local ThreadCache threadCache;
+
+	const M4Image::Allocator Pool::ALLOCATOR = M4Image::Allocator(mallocProc, freeProc, reAllocProc);
+
+	Pool &Pool::get() {
+		// this is deliberately never destroyed, because a thread can exit and give its blocks back
+		// after the static destructors have run (the blocks themselves are released by clear)
+		alignas(Pool) static unsigned char poolStorage[sizeof(Pool)] = {};
+		static Pool &pool = *new (poolStorage) Pool();
+		return pool;
+	}
+
+	void* Pool::allocate(size_t size) {
+		if (!size) {
+			return nullptr;
+		}
+		return allocateClass(getClassIndex(size), size);
+	}
+
+	void* Pool::reallocate(void* block, size_t size) {
+		if (!block) {
+			return allocate(size);
+		}
+
+		const Header &HEADER = getHeader(block);
+
+		// it already fits (this is the point of size classes)
+		if (size <= HEADER.size) {
+			return block;
+		}
+
+		// like realloc, the old block is left alone if this fails
+		void* reallocatedBlock = allocate(size);
+
+		if (!reallocatedBlock) {
+			return nullptr;
+		}
+
+		memcpy(reallocatedBlock, block, HEADER.size);
+		free(block);
+		return reallocatedBlock;
+	}
+
+	void Pool::free(void* block) {
+		if (!block) {
+			return;
+		}
+
+		const Header &HEADER = getHeader(block);
+		usedSize -= HEADER.size;
+
+		if (HEADER.classIndex == UNPOOLED) {
+			release(block);
+			return;
+		}
+
+		freeClass(block, HEADER.classIndex);
+	}
+
+	void Pool::clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// every thread's blocks can go too, not just this one's
+		for (
+			ThreadCacheVector::iterator threadCacheVectorIterator = threadCacheVector.begin();
+			threadCacheVectorIterator != threadCacheVector.end();
+			threadCacheVectorIterator++
+		) {
+			std::atomic<void*>* blocks = (*threadCacheVectorIterator)->blocks;
+
+			for (size_t i = 0; i <= ThreadCache::CLASS_INDEX_MAX; i++) {
+				void* block = blocks[i].exchange(nullptr);
+
+				if (block) {
+					release(block);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < CLASSES; i++) {
+			BlockVector &blockVector = blockVectors[i];
+
+			for (
+				BlockVector::iterator blockVectorIterator = blockVector.begin();
+				blockVectorIterator != blockVector.end();
+				blockVectorIterator++
+			) {
+				release(*blockVectorIterator);
+			}
+
+			blockVector.clear();
+		}
+
+		cachedSize = 0;
+	}
+
+	Pool::Statistics Pool::getStatistics() {
+		Statistics statistics = {};
+		statistics.hits = hits;
+		statistics.misses = misses;
+		statistics.releases = releases;
+		statistics.usedSize = usedSize;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		statistics.cachedSize = cachedSize;
+		return statistics;
+	}
+
+	size_t Pool::getClassIndex(size_t size) {
+		if (size > getClassSize(CLASSES - 1)) {
+			return UNPOOLED;
+		}
+
+		size_t classIndex = 0;
+
+		while (getClassSize(classIndex) < size) {
+			classIndex++;
+		}
+		return classIndex;
+	}
+
+	size_t Pool::getClassSize(size_t classIndex) {
+		return (size_t)1 << (classIndex + CLASS_BITS_MIN);
+	}
+
+	Pool::Header &Pool::getHeader(void* block) {
+		return *(Header*)((unsigned char*)block - HEADER_SIZE);
+	}
+
+	void* Pool::mallocProc(size_t size) {
+		return get().allocate(size);
+	}
+
+	void Pool::freeProc(void* block) {
+		get().free(block);
+	}
+
+	void* Pool::reAllocProc(void* block, size_t size) {
+		return get().reallocate(block, size);
+	}
+
+	void* Pool::allocateClass(size_t classIndex, size_t size) {
+		size_t blockSize = size;
+
+		if (classIndex != UNPOOLED) {
+			blockSize = getClassSize(classIndex);
+
+			void* block = nullptr;
+
+			if (classIndex <= ThreadCache::CLASS_INDEX_MAX) {
+				block = threadCache.blocks[classIndex].exchange(nullptr);
+			}
+
+			if (!block) {
+				std::lock_guard<std::mutex> lock(mutex);
+
+				BlockVector &blockVector = blockVectors[classIndex];
+
+				if (!blockVector.empty()) {
+					block = blockVector.back();
+					blockVector.pop_back();
+					cachedSize -= blockSize;
+				}
+			}
+
+			if (block) {
+				hits++;
+				usedSize += blockSize;
+				return block;
+			}
+		}
+
+		misses++;
+
+		unsigned char* pointer = (unsigned char*)_aligned_malloc(HEADER_SIZE + blockSize, ALIGNMENT);
+
+		if (!pointer) {
+			return nullptr;
+		}
+
+		Header &header = *(Header*)pointer;
+		header.classIndex = classIndex;
+		header.size = blockSize;
+
+		usedSize += blockSize;
+		return pointer + HEADER_SIZE;
+	}
+
+	void Pool::freeClass(void* block, size_t classIndex) {
+		if (classIndex <= ThreadCache::CLASS_INDEX_MAX) {
+			void* threadBlock = nullptr;
+
+			if (threadCache.blocks[classIndex].compare_exchange_strong(threadBlock, block)) {
+				return;
+			}
+		}
+
+		freeShared(block, classIndex);
+	}
+
+	void Pool::freeShared(void* block, size_t classIndex) {
+		size_t classSize = getClassSize(classIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (cachedSize + classSize <= CACHED_SIZE_MAX) {
+				blockVectors[classIndex].push_back(block);
+				cachedSize += classSize;
+				return;
+			}
+		}
+
+		release(block);
+	}
+
+	void Pool::release(void* block) {
+		releases++;
+		_aligned_free((unsigned char*)block - HEADER_SIZE);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <M4Image.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace gfx_tools {
+	struct ThreadCache;
+
+	// an allocator for the big buffers we keep to ourselves (raw buffers, resized LODs and prefetches)
+	// loading a node creates and frees dozens of them, mostly in the same few sizes
+	// so freed buffers are kept in power of two size classes to be handed out again
+	// (and each thread keeps one of each smaller class to itself, so it doesn't need the lock for those)
+	// buffers from here must never be given to the game, because it frees them with its own allocator
+	class Pool : NonCopyable {
+		public:
+		struct Statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t releases = 0;
+			size_t usedSize = 0;
+			size_t cachedSize = 0;
+		};
+
+		static const M4Image::Allocator ALLOCATOR;
+
+		static Pool &get();
+
+		void* allocate(size_t size);
+		void* reallocate(void* block, size_t size);
+		void free(void* block);
+
+		// releases every block that is kept around, including the ones kept by each thread
+		void clear();
+		Statistics getStatistics();
+
+		private:
+		friend struct ThreadCache;
+
+		// classes are 4 KB, 8 KB, 16 KB... up to 64 MB, bigger than that isn't pooled
+		static constexpr size_t CLASS_BITS_MIN = 12;
+		static constexpr size_t CLASS_BITS_MAX = 26;
+		static constexpr size_t CLASSES = CLASS_BITS_MAX - CLASS_BITS_MIN + 1;
+		static constexpr size_t UNPOOLED = CLASSES;
+
+		// only this much is kept around in total, the rest is freed for real
+		// (this is a 32-bit process, and the game's own allocations come first)
+		static constexpr size_t CACHED_SIZE_MAX = 0x1000000;
+
+		// the block's class is kept in front of it
+		// this is as big as the alignment so the block is still aligned
+		static constexpr size_t ALIGNMENT = 64;
+		static constexpr size_t HEADER_SIZE = ALIGNMENT;
+
+		struct Header {
+			size_t classIndex = UNPOOLED;
+			size_t size = 0;
+		};
+
+		using BlockVector = std::vector<void*>;
+		using ThreadCacheVector = std::vector<ThreadCache*>;
+
+		static size_t getClassIndex(size_t size);
+		static size_t getClassSize(size_t classIndex);
+		static Header &getHeader(void* block);
+
+		static void* mallocProc(size_t size);
+		static void freeProc(void* block);
+		static void* reAllocProc(void* block, size_t size);
+
+		void* allocateClass(size_t classIndex, size_t size);
+		void freeClass(void* block, size_t classIndex);
+		void freeShared(void* block, size_t classIndex);
+		void release(void* block);
+
+		std::mutex mutex = {};
+		BlockVector blockVectors[CLASSES] = {};
+		size_t cachedSize = 0;
+		ThreadCacheVector threadCacheVector = {};
+
+		std::atomic<uint64_t> hits = 0;
+		std::atomic<uint64_t> misses = 0;
+		std::atomic<uint64_t> releases = 0;
+		std::atomic<size_t> usedSize = 0;
+	};
+}
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "RawBuffer.h"
+#include "Pool.h"
 #include <M4Image.h>
 
 namespace gfx_tools {
@@ -13,8 +14,9 @@ namespace gfx_tools {
 	}
 
 	RawBuffer::~RawBuffer() {
+		// owned raw buffers are always ours, so they come from the pool
 		if (owner) {
-			M4Image::allocator.freeSafe(pointer);
+			Pool::ALLOCATOR.freeSafe(pointer);
 		}
 	}
 	
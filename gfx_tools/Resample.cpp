@@ -0,0 +1,842 @@
+#include "pch.h"
+#include "Resample.h"
+#include "SIMD.h"
+#include <memory>
+#include <math.h>
+#include <stdlib.h>
+
+namespace Resample {
+	using Fixed = Weights::Fixed;
+
+	Weights::Weights(int sourceSize, int destinationSize, int alignment)
+		: sourceSize(sourceSize),
+		destinationSize(destinationSize) {
+		if (sourceSize <= 0) {
+			throw std::invalid_argument("sourceSize must be greater than zero");
+		}
+
+		if (destinationSize <= 0) {
+			throw std::invalid_argument("destinationSize must be greater than zero");
+		}
+
+		if (alignment <= 0) {
+			throw std::invalid_argument("alignment must be greater than zero");
+		}
+
+		// when shrinking, the filter is widened so that every source pixel contributes
+		// (when enlarging, it is one source pixel wide on either side, which is just bilinear)
+		double scale = (double)sourceSize / destinationSize;
+		double support = __max(scale, 1.0);
+
+		// first work out the weights without worrying about the taps being the same
+		// pixels past the edges are clamped, so their weight goes to the edge pixel
+		const int RAW_TAPS = (int)ceil(support * 2.0) + 2;
+
+		std::vector<int> rawFirstVector(destinationSize);
+		std::vector<int> rawCountVector(destinationSize);
+		std::vector<double> rawVector((size_t)destinationSize * RAW_TAPS, 0.0);
+
+		int count = 1;
+
+		for (int destination = 0; destination < destinationSize; destination++) {
+			double center = (destination + 0.5) * scale;
+			int begin = (int)floor(center - support);
+			int end = (int)ceil(center + support);
+
+			int first = sourceSize;
+			int last = -1;
+
+			for (int source = begin; source < end; source++) {
+				if (1.0 - fabs((source + 0.5 - center) / support) > 0.0) {
+					int clamped = __min(sourceSize - 1, __max(0, source));
+					first = __min(first, clamped);
+					last = __max(last, clamped);
+				}
+			}
+
+			double* raw = &rawVector[(size_t)destination * RAW_TAPS];
+
+			for (int source = begin; source < end; source++) {
+				double weight = 1.0 - fabs((source + 0.5 - center) / support);
+
+				if (weight > 0.0) {
+					raw[__min(sourceSize - 1, __max(0, source)) - first] += weight;
+				}
+			}
+
+			rawFirstVector[destination] = first;
+			rawCountVector[destination] = last - first + 1;
+			count = __max(count, rawCountVector[destination]);
+		}
+
+		// pad the taps out to the alignment, but never past the source
+		// (in which case, the taps won't be aligned and the SIMD kernels won't be used)
+		taps = __min(sourceSize, ((count + alignment - 1) / alignment) * alignment);
+
+		firstVector.resize(destinationSize);
+		fixedVector.assign((size_t)destinationSize * taps, 0);
+		floatVector.assign((size_t)destinationSize * taps, 0.0f);
+
+		for (int destination = 0; destination < destinationSize; destination++) {
+			const double* raw = &rawVector[(size_t)destination * RAW_TAPS];
+			int rawFirst = rawFirstVector[destination];
+			int rawCount = rawCountVector[destination];
+
+			// move the window back if it would go past the end of the source
+			int first = __min(rawFirst, sourceSize - taps);
+			int offset = rawFirst - first;
+			firstVector[destination] = first;
+
+			double total = 0.0;
+
+			for (int i = 0; i < rawCount; i++) {
+				total += raw[i];
+			}
+
+			Fixed* fixed = &fixedVector[(size_t)destination * taps];
+			float* floats = &floatVector[(size_t)destination * taps];
+
+			int fixedTotal = 0;
+			int largest = offset;
+
+			for (int i = 0; i < rawCount; i++) {
+				double weight = raw[i] / total;
+				int tap = offset + i;
+
+				floats[tap] = (float)weight;
+				fixed[tap] = (Fixed)floor(weight * FIXED_ONE + 0.5);
+				fixedTotal += fixed[tap];
+
+				if (fixed[tap] > fixed[largest]) {
+					largest = tap;
+				}
+			}
+
+			// the fixed point weights must add up to exactly one, or flat colours would drift
+			// (for 2:1 and 4:1 they come out exact anyway: 1 3 3 1 and 1 3 5 7 7 5 3 1)
+			fixed[largest] += (Fixed)(FIXED_ONE - fixedTotal);
+		}
+	}
+
+	int Weights::getSourceSize() const {
+		return sourceSize;
+	}
+
+	int Weights::getDestinationSize() const {
+		return destinationSize;
+	}
+
+	int Weights::getTaps() const {
+		return taps;
+	}
+
+	int Weights::getFirst(int destination) const {
+		return firstVector[destination];
+	}
+
+	const Fixed* Weights::getFixed(int destination) const {
+		return &fixedVector[(size_t)destination * taps];
+	}
+
+	const float* Weights::getFloat(int destination) const {
+		return &floatVector[(size_t)destination * taps];
+	}
+
+	static constexpr int FIXED_ROUND = 1 << (Weights::FIXED_BITS - 1);
+
+	static inline unsigned char fixedToByte(int value) {
+		static constexpr int BYTE_MAX = 0xFF;
+
+		value >>= Weights::FIXED_BITS;
+		return (unsigned char)__min(BYTE_MAX, __max(0, value));
+	}
+
+	// two adjacent weights, as the pair of shorts that madd expects
+	static inline int32_t fixedPair(const Fixed* fixed) {
+		return (int32_t)((uint32_t)(uint16_t)fixed[0] | ((uint32_t)(uint16_t)fixed[1] << 16));
+	}
+
+	// each of the kernels below does one row
+	// the horizontal kernels read one source row and write one destination row
+	// the vertical kernels read taps source rows, stride apart, and write one destination row of size elements
+	using Horizontal8 = void(*)(const Weights &weights, const unsigned char* sourcePointer, unsigned char* destinationPointer, int bytes);
+	using Vertical8 = void(*)(const Fixed* fixed, int taps, const unsigned char* sourcePointer, size_t sourceStride, unsigned char* destinationPointer, size_t size);
+	using HorizontalFloat = void(*)(const Weights &weights, const float* sourcePointer, float* destinationPointer);
+	using VerticalFloat = void(*)(const float* floats, int taps, const unsigned char* sourcePointer, size_t sourceStride, float* destinationPointer, size_t size);
+
+	static void horizontal8Scalar(const Weights &weights, const unsigned char* sourcePointer, unsigned char* destinationPointer, int bytes) {
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const unsigned char* pixelPointer = sourcePointer + (size_t)weights.getFirst(destination) * bytes;
+			const Fixed* fixed = weights.getFixed(destination);
+
+			for (int channel = 0; channel < bytes; channel++) {
+				int value = FIXED_ROUND;
+
+				for (int tap = 0; tap < TAPS; tap++) {
+					value += fixed[tap] * pixelPointer[tap * bytes + channel];
+				}
+
+				*destinationPointer++ = fixedToByte(value);
+			}
+		}
+	}
+
+	static void vertical8Scalar(const Fixed* fixed, int taps, const unsigned char* sourcePointer, size_t sourceStride, unsigned char* destinationPointer, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			int value = FIXED_ROUND;
+			const unsigned char* columnPointer = sourcePointer + i;
+
+			for (int tap = 0; tap < taps; tap++) {
+				value += fixed[tap] * *columnPointer;
+				columnPointer += sourceStride;
+			}
+
+			destinationPointer[i] = fixedToByte(value);
+		}
+	}
+
+	static void horizontalFloatScalar(const Weights &weights, const float* sourcePointer, float* destinationPointer) {
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const float* pixelPointer = sourcePointer + weights.getFirst(destination);
+			const float* floats = weights.getFloat(destination);
+
+			// sum in four lanes, in the same order as the SIMD kernels do
+			// (so the result doesn't depend on which kernel the machine happened to pick)
+			float values[4] = {};
+
+			for (int tap = 0; tap < TAPS; tap++) {
+				values[tap & 3] += floats[tap] * pixelPointer[tap];
+			}
+
+			destinationPointer[destination] = (values[0] + values[1]) + (values[2] + values[3]);
+		}
+	}
+
+	static void verticalFloatScalar(const float* floats, int taps, const unsigned char* sourcePointer, size_t sourceStride, float* destinationPointer, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			float value = 0.0f;
+			const unsigned char* columnPointer = sourcePointer + i * sizeof(float);
+
+			for (int tap = 0; tap < taps; tap++) {
+				value += floats[tap] * *(const float*)columnPointer;
+				columnPointer += sourceStride;
+			}
+
+			destinationPointer[i] = value;
+		}
+	}
+
+	#ifdef SIMD_X86
+	// the eight bit horizontal kernels only handle four channel pixels
+	// (two pixels at a time for SSE4.1, four for AVX2) so the channels of each pixel line up for madd
+	SIMD_TARGET_SSE41 static void horizontal8SSE41(const Weights &weights, const unsigned char* sourcePointer, unsigned char* destinationPointer, int bytes) {
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		// interleave the channels of the two pixels: b0 b1 g0 g1 r0 r1 a0 a1
+		const __m128i INTERLEAVE = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+		const __m128i ROUND = _mm_set1_epi32(FIXED_ROUND);
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const unsigned char* pixelPointer = sourcePointer + (size_t)weights.getFirst(destination) * bytes;
+			const Fixed* fixed = weights.getFixed(destination);
+
+			__m128i value = ROUND;
+
+			for (int tap = 0; tap < TAPS; tap += 2) {
+				__m128i pixels = _mm_loadl_epi64((const __m128i*)(pixelPointer + tap * bytes));
+				pixels = _mm_cvtepu8_epi16(_mm_shuffle_epi8(pixels, INTERLEAVE));
+				value = _mm_add_epi32(value, _mm_madd_epi16(pixels, _mm_set1_epi32(fixedPair(fixed + tap))));
+			}
+
+			value = _mm_srai_epi32(value, Weights::FIXED_BITS);
+			value = _mm_packs_epi32(value, value);
+			value = _mm_packus_epi16(value, value);
+
+			int32_t pixel = _mm_cvtsi128_si32(value);
+			memcpy(destinationPointer, &pixel, sizeof(pixel));
+			destinationPointer += sizeof(pixel);
+		}
+	}
+
+	SIMD_TARGET_AVX2 static void horizontal8AVX2(const Weights &weights, const unsigned char* sourcePointer, unsigned char* destinationPointer, int bytes) {
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		// pixels 0 and 1 end up in the low lane, pixels 2 and 3 in the high lane
+		const __m128i INTERLEAVE = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+		const __m256i PAIRS = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+		const __m128i ROUND = _mm_set1_epi32(FIXED_ROUND);
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const unsigned char* pixelPointer = sourcePointer + (size_t)weights.getFirst(destination) * bytes;
+			const Fixed* fixed = weights.getFixed(destination);
+
+			__m256i values = _mm256_setzero_si256();
+
+			for (int tap = 0; tap < TAPS; tap += 4) {
+				__m128i pixels = _mm_loadu_si128((const __m128i*)(pixelPointer + tap * bytes));
+				__m256i pixelsWide = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(pixels, INTERLEAVE));
+
+				__m256i pairs = _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)(fixed + tap)));
+				pairs = _mm256_permutevar8x32_epi32(pairs, PAIRS);
+
+				values = _mm256_add_epi32(values, _mm256_madd_epi16(pixelsWide, pairs));
+			}
+
+			__m128i value = _mm_add_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+			value = _mm_srai_epi32(_mm_add_epi32(value, ROUND), Weights::FIXED_BITS);
+			value = _mm_packs_epi32(value, value);
+			value = _mm_packus_epi16(value, value);
+
+			int32_t pixel = _mm_cvtsi128_si32(value);
+			memcpy(destinationPointer, &pixel, sizeof(pixel));
+			destinationPointer += sizeof(pixel);
+		}
+	}
+
+	// the vertical kernels work on two rows at a time, interleaving their bytes so madd can do both
+	// this works for any number of channels, because every byte is filtered the same way
+	SIMD_TARGET_SSE41 static void vertical8SSE41(const Fixed* fixed, int taps, const unsigned char* sourcePointer, size_t sourceStride, unsigned char* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(__m128i);
+
+		const __m128i ZERO = _mm_setzero_si128();
+		const __m128i ROUND = _mm_set1_epi32(FIXED_ROUND);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			__m128i values[4] = { ROUND, ROUND, ROUND, ROUND };
+			const unsigned char* rowPointer = sourcePointer + i;
+
+			for (int tap = 0; tap < taps; tap += 2) {
+				__m128i rowA = _mm_loadu_si128((const __m128i*)rowPointer);
+				rowPointer += sourceStride;
+
+				__m128i rowB = ZERO;
+				int32_t pair = 0;
+
+				if (tap + 1 < taps) {
+					rowB = _mm_loadu_si128((const __m128i*)rowPointer);
+					rowPointer += sourceStride;
+					pair = fixedPair(fixed + tap);
+				} else {
+					pair = (uint16_t)fixed[tap];
+				}
+
+				__m128i pairs = _mm_set1_epi32(pair);
+				__m128i low = _mm_unpacklo_epi8(rowA, rowB);
+				__m128i high = _mm_unpackhi_epi8(rowA, rowB);
+
+				values[0] = _mm_add_epi32(values[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, ZERO), pairs));
+				values[1] = _mm_add_epi32(values[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, ZERO), pairs));
+				values[2] = _mm_add_epi32(values[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, ZERO), pairs));
+				values[3] = _mm_add_epi32(values[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, ZERO), pairs));
+			}
+
+			__m128i low = _mm_packs_epi32(_mm_srai_epi32(values[0], Weights::FIXED_BITS), _mm_srai_epi32(values[1], Weights::FIXED_BITS));
+			__m128i high = _mm_packs_epi32(_mm_srai_epi32(values[2], Weights::FIXED_BITS), _mm_srai_epi32(values[3], Weights::FIXED_BITS));
+			_mm_storeu_si128((__m128i*)(destinationPointer + i), _mm_packus_epi16(low, high));
+		}
+
+		vertical8Scalar(fixed, taps, sourcePointer + i, sourceStride, destinationPointer + i, size - i);
+	}
+
+	SIMD_TARGET_AVX2 static void vertical8AVX2(const Fixed* fixed, int taps, const unsigned char* sourcePointer, size_t sourceStride, unsigned char* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(__m256i);
+
+		// the unpacks and packs all work within lanes, so they undo each other and the bytes stay in order
+		const __m256i ZERO = _mm256_setzero_si256();
+		const __m256i ROUND = _mm256_set1_epi32(FIXED_ROUND);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			__m256i values[4] = { ROUND, ROUND, ROUND, ROUND };
+			const unsigned char* rowPointer = sourcePointer + i;
+
+			for (int tap = 0; tap < taps; tap += 2) {
+				__m256i rowA = _mm256_loadu_si256((const __m256i*)rowPointer);
+				rowPointer += sourceStride;
+
+				__m256i rowB = ZERO;
+				int32_t pair = 0;
+
+				if (tap + 1 < taps) {
+					rowB = _mm256_loadu_si256((const __m256i*)rowPointer);
+					rowPointer += sourceStride;
+					pair = fixedPair(fixed + tap);
+				} else {
+					pair = (uint16_t)fixed[tap];
+				}
+
+				__m256i pairs = _mm256_set1_epi32(pair);
+				__m256i low = _mm256_unpacklo_epi8(rowA, rowB);
+				__m256i high = _mm256_unpackhi_epi8(rowA, rowB);
+
+				values[0] = _mm256_add_epi32(values[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, ZERO), pairs));
+				values[1] = _mm256_add_epi32(values[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, ZERO), pairs));
+				values[2] = _mm256_add_epi32(values[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, ZERO), pairs));
+				values[3] = _mm256_add_epi32(values[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, ZERO), pairs));
+			}
+
+			__m256i low = _mm256_packs_epi32(_mm256_srai_epi32(values[0], Weights::FIXED_BITS), _mm256_srai_epi32(values[1], Weights::FIXED_BITS));
+			__m256i high = _mm256_packs_epi32(_mm256_srai_epi32(values[2], Weights::FIXED_BITS), _mm256_srai_epi32(values[3], Weights::FIXED_BITS));
+			_mm256_storeu_si256((__m256i*)(destinationPointer + i), _mm256_packus_epi16(low, high));
+		}
+
+		vertical8SSE41(fixed, taps, sourcePointer + i, sourceStride, destinationPointer + i, size - i);
+	}
+
+	SIMD_TARGET_SSE41 static void horizontalFloatSSE41(const Weights &weights, const float* sourcePointer, float* destinationPointer) {
+		static constexpr int STEP = sizeof(__m128) / sizeof(float);
+
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const float* pixelPointer = sourcePointer + weights.getFirst(destination);
+			const float* floats = weights.getFloat(destination);
+
+			__m128 value = _mm_setzero_ps();
+
+			for (int tap = 0; tap < TAPS; tap += STEP) {
+				value = _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps(pixelPointer + tap), _mm_loadu_ps(floats + tap)));
+			}
+
+			value = _mm_hadd_ps(value, value);
+			value = _mm_hadd_ps(value, value);
+			destinationPointer[destination] = _mm_cvtss_f32(value);
+		}
+	}
+
+	SIMD_TARGET_SSE41 static void verticalFloatSSE41(const float* floats, int taps, const unsigned char* sourcePointer, size_t sourceStride, float* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(__m128) / sizeof(float);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			__m128 value = _mm_setzero_ps();
+			const unsigned char* rowPointer = sourcePointer + i * sizeof(float);
+
+			for (int tap = 0; tap < taps; tap++) {
+				value = _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps((const float*)rowPointer), _mm_set1_ps(floats[tap])));
+				rowPointer += sourceStride;
+			}
+
+			_mm_storeu_ps(destinationPointer + i, value);
+		}
+
+		verticalFloatScalar(floats, taps, sourcePointer + i * sizeof(float), sourceStride, destinationPointer + i, size - i);
+	}
+
+	SIMD_TARGET_AVX2 static void verticalFloatAVX2(const float* floats, int taps, const unsigned char* sourcePointer, size_t sourceStride, float* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(__m256) / sizeof(float);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			__m256 value = _mm256_setzero_ps();
+			const unsigned char* rowPointer = sourcePointer + i * sizeof(float);
+
+			for (int tap = 0; tap < taps; tap++) {
+				value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_loadu_ps((const float*)rowPointer), _mm256_set1_ps(floats[tap])));
+				rowPointer += sourceStride;
+			}
+
+			_mm256_storeu_ps(destinationPointer + i, value);
+		}
+
+		verticalFloatSSE41(floats, taps, sourcePointer + i * sizeof(float), sourceStride, destinationPointer + i, size - i);
+	}
+	#endif
+
+	#ifdef SIMD_NEON
+	static void horizontal8NEON(const Weights &weights, const unsigned char* sourcePointer, unsigned char* destinationPointer, int bytes) {
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const unsigned char* pixelPointer = sourcePointer + (size_t)weights.getFirst(destination) * bytes;
+			const Fixed* fixed = weights.getFixed(destination);
+
+			int32x4_t value = vdupq_n_s32(FIXED_ROUND);
+
+			for (int tap = 0; tap < TAPS; tap++) {
+				uint32_t pixel = 0;
+				memcpy(&pixel, pixelPointer + tap * bytes, sizeof(pixel));
+
+				int16x4_t channels = vreinterpret_s16_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(pixel)))));
+				value = vmlal_n_s16(value, channels, fixed[tap]);
+			}
+
+			uint16x4_t narrow = vqshrun_n_s32(value, Weights::FIXED_BITS);
+			uint32_t pixel = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(narrow, narrow))), 0);
+			memcpy(destinationPointer, &pixel, sizeof(pixel));
+			destinationPointer += sizeof(pixel);
+		}
+	}
+
+	static void vertical8NEON(const Fixed* fixed, int taps, const unsigned char* sourcePointer, size_t sourceStride, unsigned char* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(uint8x16_t);
+
+		const int32x4_t ROUND = vdupq_n_s32(FIXED_ROUND);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			int32x4_t values[4] = { ROUND, ROUND, ROUND, ROUND };
+			const unsigned char* rowPointer = sourcePointer + i;
+
+			for (int tap = 0; tap < taps; tap++) {
+				uint8x16_t row = vld1q_u8(rowPointer);
+				rowPointer += sourceStride;
+
+				int16x8_t low = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(row)));
+				int16x8_t high = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(row)));
+
+				values[0] = vmlal_n_s16(values[0], vget_low_s16(low), fixed[tap]);
+				values[1] = vmlal_n_s16(values[1], vget_high_s16(low), fixed[tap]);
+				values[2] = vmlal_n_s16(values[2], vget_low_s16(high), fixed[tap]);
+				values[3] = vmlal_n_s16(values[3], vget_high_s16(high), fixed[tap]);
+			}
+
+			uint16x8_t low = vcombine_u16(vqshrun_n_s32(values[0], Weights::FIXED_BITS), vqshrun_n_s32(values[1], Weights::FIXED_BITS));
+			uint16x8_t high = vcombine_u16(vqshrun_n_s32(values[2], Weights::FIXED_BITS), vqshrun_n_s32(values[3], Weights::FIXED_BITS));
+			vst1q_u8(destinationPointer + i, vcombine_u8(vqmovn_u16(low), vqmovn_u16(high)));
+		}
+
+		vertical8Scalar(fixed, taps, sourcePointer + i, sourceStride, destinationPointer + i, size - i);
+	}
+
+	static void horizontalFloatNEON(const Weights &weights, const float* sourcePointer, float* destinationPointer) {
+		static constexpr int STEP = sizeof(float32x4_t) / sizeof(float);
+
+		const int TAPS = weights.getTaps();
+		const int DESTINATION_SIZE = weights.getDestinationSize();
+
+		for (int destination = 0; destination < DESTINATION_SIZE; destination++) {
+			const float* pixelPointer = sourcePointer + weights.getFirst(destination);
+			const float* floats = weights.getFloat(destination);
+
+			float32x4_t value = vdupq_n_f32(0.0f);
+
+			for (int tap = 0; tap < TAPS; tap += STEP) {
+				value = vmlaq_f32(value, vld1q_f32(pixelPointer + tap), vld1q_f32(floats + tap));
+			}
+
+			float32x2_t values = vpadd_f32(vget_low_f32(value), vget_high_f32(value));
+			destinationPointer[destination] = vget_lane_f32(values, 0) + vget_lane_f32(values, 1);
+		}
+	}
+
+	static void verticalFloatNEON(const float* floats, int taps, const unsigned char* sourcePointer, size_t sourceStride, float* destinationPointer, size_t size) {
+		static constexpr size_t STEP = sizeof(float32x4_t) / sizeof(float);
+
+		size_t i = 0;
+
+		for (; i + STEP <= size; i += STEP) {
+			float32x4_t value = vdupq_n_f32(0.0f);
+			const unsigned char* rowPointer = sourcePointer + i * sizeof(float);
+
+			for (int tap = 0; tap < taps; tap++) {
+				value = vmlaq_n_f32(value, vld1q_f32((const float*)rowPointer), floats[tap]);
+				rowPointer += sourceStride;
+			}
+
+			vst1q_f32(destinationPointer + i, value);
+		}
+
+		verticalFloatScalar(floats, taps, sourcePointer + i * sizeof(float), sourceStride, destinationPointer + i, size - i);
+	}
+	#endif
+
+	// the horizontal kernels need the taps to be a multiple of how many they do at once
+	// so the weights are made with that alignment, and if the source is too small for it, we fall back
+	static Horizontal8 getHorizontal8(int bytes, int &alignment) {
+		static constexpr int BYTES_SIMD = 4;
+
+		alignment = 1;
+
+		if (bytes != BYTES_SIMD) {
+			return horizontal8Scalar;
+		}
+
+		switch (SIMD::LEVEL) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			alignment = 4;
+			return horizontal8AVX2;
+			case SIMD::Level::SSE41:
+			alignment = 2;
+			return horizontal8SSE41;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return horizontal8NEON;
+			#endif
+			default:
+			break;
+		}
+		return horizontal8Scalar;
+	}
+
+	static Vertical8 getVertical8() {
+		switch (SIMD::LEVEL) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			return vertical8AVX2;
+			case SIMD::Level::SSE41:
+			return vertical8SSE41;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return vertical8NEON;
+			#endif
+			default:
+			break;
+		}
+		return vertical8Scalar;
+	}
+
+	// the float kernels all use the same weights and add up four lanes the same way
+	// so that converting on a different machine gives exactly the same output
+	// (for this reason, there is no eight lane AVX2 version of this one)
+	static HorizontalFloat getHorizontalFloat(int &alignment) {
+		alignment = 4;
+
+		switch (SIMD::LEVEL) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			case SIMD::Level::SSE41:
+			return horizontalFloatSSE41;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return horizontalFloatNEON;
+			#endif
+			default:
+			break;
+		}
+		return horizontalFloatScalar;
+	}
+
+	static VerticalFloat getVerticalFloat() {
+		switch (SIMD::LEVEL) {
+			#ifdef SIMD_X86
+			case SIMD::Level::AVX2:
+			return verticalFloatAVX2;
+			case SIMD::Level::SSE41:
+			return verticalFloatSSE41;
+			#endif
+			#ifdef SIMD_NEON
+			case SIMD::Level::NEON:
+			return verticalFloatNEON;
+			#endif
+			default:
+			break;
+		}
+		return verticalFloatScalar;
+	}
+
+	static void copyRows(
+		const unsigned char* sourcePointer,
+		size_t sourceStride,
+		unsigned char* destinationPointer,
+		size_t destinationStride,
+		size_t rowSize,
+		int height
+	) {
+		for (int y = 0; y < height; y++) {
+			memcpy(destinationPointer, sourcePointer, rowSize);
+			sourcePointer += sourceStride;
+			destinationPointer += destinationStride;
+		}
+	}
+
+	static void validate(int sourceWidth, int sourceHeight, const void* sourcePointer, int destinationWidth, int destinationHeight, const void* destinationPointer) {
+		if (!sourcePointer) {
+			throw std::invalid_argument("sourcePointer must not be NULL");
+		}
+
+		if (!destinationPointer) {
+			throw std::invalid_argument("destinationPointer must not be NULL");
+		}
+
+		if (sourceWidth <= 0 || sourceHeight <= 0) {
+			throw std::invalid_argument("source dimensions must be greater than zero");
+		}
+
+		if (destinationWidth <= 0 || destinationHeight <= 0) {
+			throw std::invalid_argument("destination dimensions must be greater than zero");
+		}
+	}
+
+	void resize(
+		const unsigned char* sourcePointer,
+		int sourceWidth,
+		int sourceHeight,
+		size_t sourceStride,
+		unsigned char* destinationPointer,
+		int destinationWidth,
+		int destinationHeight,
+		size_t destinationStride,
+		int bytes
+	) {
+		validate(sourceWidth, sourceHeight, sourcePointer, destinationWidth, destinationHeight, destinationPointer);
+
+		if (bytes <= 0) {
+			throw std::invalid_argument("bytes must be greater than zero");
+		}
+
+		const size_t DESTINATION_ROW_SIZE = (size_t)destinationWidth * bytes;
+
+		bool horizontal = sourceWidth != destinationWidth;
+		bool vertical = sourceHeight != destinationHeight;
+
+		if (!horizontal && !vertical) {
+			copyRows(sourcePointer, sourceStride, destinationPointer, destinationStride, DESTINATION_ROW_SIZE, destinationHeight);
+			return;
+		}
+
+		// the horizontal pass goes straight to the destination if there's no vertical pass
+		// otherwise it goes to an intermediate image, which the vertical pass reads from
+		std::unique_ptr<unsigned char[]> intermediatePointer = nullptr;
+
+		const unsigned char* verticalPointer = sourcePointer;
+		size_t verticalStride = sourceStride;
+
+		if (horizontal) {
+			int alignment = 1;
+			Horizontal8 horizontal8 = getHorizontal8(bytes, alignment);
+			Weights weights(sourceWidth, destinationWidth, alignment);
+
+			if (weights.getTaps() % alignment) {
+				horizontal8 = horizontal8Scalar;
+			}
+
+			unsigned char* horizontalPointer = destinationPointer;
+			size_t horizontalStride = destinationStride;
+
+			if (vertical) {
+				intermediatePointer = std::unique_ptr<unsigned char[]>(new unsigned char[DESTINATION_ROW_SIZE * sourceHeight]);
+				horizontalPointer = intermediatePointer.get();
+				horizontalStride = DESTINATION_ROW_SIZE;
+
+				verticalPointer = horizontalPointer;
+				verticalStride = horizontalStride;
+			}
+
+			for (int y = 0; y < sourceHeight; y++) {
+				horizontal8(weights, sourcePointer, horizontalPointer, bytes);
+				sourcePointer += sourceStride;
+				horizontalPointer += horizontalStride;
+			}
+		}
+
+		if (vertical) {
+			Vertical8 vertical8 = getVertical8();
+			Weights weights(sourceHeight, destinationHeight);
+
+			const int TAPS = weights.getTaps();
+
+			for (int y = 0; y < destinationHeight; y++) {
+				vertical8(
+					weights.getFixed(y),
+					TAPS,
+					verticalPointer + (size_t)weights.getFirst(y) * verticalStride,
+					verticalStride,
+					destinationPointer,
+					DESTINATION_ROW_SIZE
+				);
+
+				destinationPointer += destinationStride;
+			}
+		}
+	}
+
+	void resize(
+		const float* sourcePointer,
+		int sourceWidth,
+		int sourceHeight,
+		size_t sourceStride,
+		float* destinationPointer,
+		int destinationWidth,
+		int destinationHeight,
+		size_t destinationStride
+	) {
+		validate(sourceWidth, sourceHeight, sourcePointer, destinationWidth, destinationHeight, destinationPointer);
+
+		const size_t DESTINATION_ROW_SIZE = (size_t)destinationWidth * sizeof(float);
+
+		bool horizontal = sourceWidth != destinationWidth;
+		bool vertical = sourceHeight != destinationHeight;
+
+		if (!horizontal && !vertical) {
+			copyRows((const unsigned char*)sourcePointer, sourceStride, (unsigned char*)destinationPointer, destinationStride, DESTINATION_ROW_SIZE, destinationHeight);
+			return;
+		}
+
+		std::unique_ptr<float[]> intermediatePointer = nullptr;
+
+		const unsigned char* verticalPointer = (const unsigned char*)sourcePointer;
+		size_t verticalStride = sourceStride;
+
+		if (horizontal) {
+			int alignment = 1;
+			HorizontalFloat horizontalFloat = getHorizontalFloat(alignment);
+			Weights weights(sourceWidth, destinationWidth, alignment);
+
+			if (weights.getTaps() % alignment) {
+				horizontalFloat = horizontalFloatScalar;
+			}
+
+			unsigned char* horizontalPointer = (unsigned char*)destinationPointer;
+			size_t horizontalStride = destinationStride;
+
+			if (vertical) {
+				intermediatePointer = std::unique_ptr<float[]>(new float[(size_t)destinationWidth * sourceHeight]);
+				horizontalPointer = (unsigned char*)intermediatePointer.get();
+				horizontalStride = DESTINATION_ROW_SIZE;
+
+				verticalPointer = horizontalPointer;
+				verticalStride = horizontalStride;
+			}
+
+			const unsigned char* rowPointer = (const unsigned char*)sourcePointer;
+
+			for (int y = 0; y < sourceHeight; y++) {
+				horizontalFloat(weights, (const float*)rowPointer, (float*)horizontalPointer);
+				rowPointer += sourceStride;
+				horizontalPointer += horizontalStride;
+			}
+		}
+
+		if (vertical) {
+			VerticalFloat verticalFloat = getVerticalFloat();
+			Weights weights(sourceHeight, destinationHeight);
+
+			const int TAPS = weights.getTaps();
+			unsigned char* rowPointer = (unsigned char*)destinationPointer;
+
+			for (int y = 0; y < destinationHeight; y++) {
+				verticalFloat(
+					weights.getFloat(y),
+					TAPS,
+					verticalPointer + (size_t)weights.getFirst(y) * verticalStride,
+					verticalStride,
+					(float*)rowPointer,
+					(size_t)destinationWidth
+				);
+
+				rowPointer += destinationStride;
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// a separable resampler using a triangle (tent) filter, the same shape as nvtt's ResizeFilter_Triangle
+// but it isn't the same as nvtt's resize: the filter is point sampled (nvtt box samples it) and
+// pixels past the edges are clamped (nvtt mirrors them) so the output is close to nvtt's, not identical
+// the horizontal and vertical passes are vectorized with AVX2, SSE4.1 or NEON, depending on the CPU
+namespace Resample {
+	// the filter weights along one axis
+	// these are calculated once per resize, and then reused for every row (or column)
+	class Weights {
+		public:
+		using Fixed = int16_t;
+
+		// the eight bit kernels use fixed point weights with this many fractional bits
+		static constexpr int FIXED_BITS = 14;
+		static constexpr int FIXED_ONE = 1 << FIXED_BITS;
+
+		// every destination pixel uses the same number of taps (padded with zero weights if need be)
+		// and the taps are a multiple of alignment, so the SIMD kernels don't need a tail
+		Weights(int sourceSize, int destinationSize, int alignment = 1);
+
+		int getSourceSize() const;
+		int getDestinationSize() const;
+		int getTaps() const;
+		int getFirst(int destination) const;
+		const Fixed* getFixed(int destination) const;
+		const float* getFloat(int destination) const;
+
+		private:
+		int sourceSize = 0;
+		int destinationSize = 0;
+		int taps = 0;
+
+		std::vector<int> firstVector = {};
+		std::vector<Fixed> fixedVector = {};
+		std::vector<float> floatVector = {};
+	};
+
+	// strides are in bytes, and bytes is the number of bytes per pixel (channels are resized independently)
+	void resize(
+		const unsigned char* sourcePointer,
+		int sourceWidth,
+		int sourceHeight,
+		size_t sourceStride,
+		unsigned char* destinationPointer,
+		int destinationWidth,
+		int destinationHeight,
+		size_t destinationStride,
+		int bytes
+	);
+
+	// resizes a single float channel (like those of an nvtt::Surface)
+	void resize(
+		const float* sourcePointer,
+		int sourceWidth,
+		int sourceHeight,
+		size_t sourceStride,
+		float* destinationPointer,
+		int destinationWidth,
+		int destinationHeight,
+		size_t destinationStride
+	);
+}
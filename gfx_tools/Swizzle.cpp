@@ -0,0 +1,271 @@
+#include "pch.h"
+#include "Swizzle.h"
+#include "SIMD.h"
+#include <array>
+#include <utility>
+
+namespace Swizzle {
+	using COLOR_FORMAT = M4Image::COLOR_FORMAT;
+
+	// RGBA, RGBX, BGRA, BGRX, RGB and BGR are the first six colour formats
+	static constexpr size_t COLOR_FORMATS = 6;
+
+	enum struct Channel {
+		R,
+		G,
+		B,
+		A,
+		X
+	};
+
+	struct Layout {
+		size_t bytes = 0;
+		Channel channels[4] = {};
+	};
+
+	static constexpr Layout getLayout(size_t colorFormat) {
+		switch ((COLOR_FORMAT)colorFormat) {
+			case COLOR_FORMAT::RGBA:
+			return { 4, { Channel::R, Channel::G, Channel::B, Channel::A } };
+			case COLOR_FORMAT::RGBX:
+			return { 4, { Channel::R, Channel::G, Channel::B, Channel::X } };
+			case COLOR_FORMAT::BGRA:
+			return { 4, { Channel::B, Channel::G, Channel::R, Channel::A } };
+			case COLOR_FORMAT::BGRX:
+			return { 4, { Channel::B, Channel::G, Channel::R, Channel::X } };
+			case COLOR_FORMAT::RGB:
+			return { 3, { Channel::R, Channel::G, Channel::B, Channel::X } };
+			case COLOR_FORMAT::BGR:
+			return { 3, { Channel::B, Channel::G, Channel::R, Channel::X } };
+			default:
+			break;
+		}
+		return {};
+	}
+
+	// for destination bytes that don't come from the source (X, or A when the source has no alpha)
+	static constexpr int OPAQUE = -1;
+
+	static constexpr int getSourceByte(size_t sourceColorFormat, size_t destinationColorFormat, size_t destinationByte) {
+		const Layout SOURCE_LAYOUT = getLayout(sourceColorFormat);
+		const Channel CHANNEL = getLayout(destinationColorFormat).channels[destinationByte];
+
+		if (CHANNEL == Channel::X) {
+			return OPAQUE;
+		}
+
+		for (size_t i = 0; i < SOURCE_LAYOUT.bytes; i++) {
+			if (SOURCE_LAYOUT.channels[i] == CHANNEL) {
+				return (int)i;
+			}
+		}
+		return OPAQUE;
+	}
+
+	template <size_t SOURCE, size_t DESTINATION>
+	struct Kernel {
+		static constexpr size_t SOURCE_BYTES = getLayout(SOURCE).bytes;
+		static constexpr size_t DESTINATION_BYTES = getLayout(DESTINATION).bytes;
+
+		// the SIMD versions do four pixels per sixteen bytes (so twelve of them, for three byte formats)
+		static constexpr size_t VECTOR_PIXELS = 4;
+		static constexpr size_t VECTOR_SIZE = 16;
+
+		// they always load and store sixteen bytes, so they must stop while there's that much left of both
+		static constexpr size_t VECTOR_PIXELS_MIN = __max(VECTOR_PIXELS,
+			(VECTOR_SIZE + __min(SOURCE_BYTES, DESTINATION_BYTES) - 1) / __min(SOURCE_BYTES, DESTINATION_BYTES));
+
+		static constexpr unsigned char SHUFFLE_ZERO = 0x80;
+		static constexpr unsigned char OPAQUE_ALPHA = 0xFF;
+
+		// the shuffle for one vector (repeated twice, for AVX2)
+		// bytes not coming from the source are zeroed by the shuffle, then ORed with the opaque mask
+		struct Masks {
+			unsigned char shuffle[VECTOR_SIZE * 2] = {};
+			unsigned char opaque[VECTOR_SIZE * 2] = {};
+		};
+
+		static constexpr Masks getMasks() {
+			Masks masks = {};
+
+			for (size_t i = 0; i < VECTOR_SIZE * 2; i++) {
+				size_t vectorByte = i % VECTOR_SIZE;
+				size_t pixel = vectorByte / DESTINATION_BYTES;
+
+				masks.shuffle[i] = SHUFFLE_ZERO;
+
+				if (pixel >= VECTOR_PIXELS) {
+					continue;
+				}
+
+				int sourceByte = getSourceByte(SOURCE, DESTINATION, vectorByte % DESTINATION_BYTES);
+
+				if (sourceByte == OPAQUE) {
+					masks.opaque[i] = OPAQUE_ALPHA;
+					continue;
+				}
+
+				masks.shuffle[i] = (unsigned char)((pixel * SOURCE_BYTES) + sourceByte);
+			}
+			return masks;
+		}
+
+		static constexpr Masks MASKS = getMasks();
+
+		template <int SOURCE_BYTE>
+		static unsigned char getByte(const unsigned char* sourcePointer) {
+			if constexpr (SOURCE_BYTE == OPAQUE) {
+				return OPAQUE_ALPHA;
+			} else {
+				return sourcePointer[SOURCE_BYTE];
+			}
+		}
+
+		static void scalar(const unsigned char* sourcePointer, unsigned char* destinationPointer, size_t pixels) {
+			for (size_t i = 0; i < pixels; i++) {
+				destinationPointer[0] = getByte<getSourceByte(SOURCE, DESTINATION, 0)>(sourcePointer);
+				destinationPointer[1] = getByte<getSourceByte(SOURCE, DESTINATION, 1)>(sourcePointer);
+				destinationPointer[2] = getByte<getSourceByte(SOURCE, DESTINATION, 2)>(sourcePointer);
+
+				if constexpr (DESTINATION_BYTES == 4) {
+					destinationPointer[3] = getByte<getSourceByte(SOURCE, DESTINATION, 3)>(sourcePointer);
+				}
+
+				sourcePointer += SOURCE_BYTES;
+				destinationPointer += DESTINATION_BYTES;
+			}
+		}
+
+		#ifdef SIMD_X86
+		SIMD_TARGET_SSE41 static void sse41(const unsigned char* sourcePointer, unsigned char* destinationPointer, size_t pixels) {
+			const __m128i SHUFFLE = _mm_loadu_si128((const __m128i*)MASKS.shuffle);
+			const __m128i OPAQUE_MASK = _mm_loadu_si128((const __m128i*)MASKS.opaque);
+
+			while (pixels >= VECTOR_PIXELS_MIN) {
+				__m128i color = _mm_loadu_si128((const __m128i*)sourcePointer);
+				color = _mm_or_si128(_mm_shuffle_epi8(color, SHUFFLE), OPAQUE_MASK);
+
+				// for three byte destinations, the last four bytes are overwritten by the next pixels
+				_mm_storeu_si128((__m128i*)destinationPointer, color);
+
+				sourcePointer += VECTOR_PIXELS * SOURCE_BYTES;
+				destinationPointer += VECTOR_PIXELS * DESTINATION_BYTES;
+				pixels -= VECTOR_PIXELS;
+			}
+
+			scalar(sourcePointer, destinationPointer, pixels);
+		}
+
+		// the shuffle can't cross from one half of the vector to the other
+		// so this only helps when both colour formats are four bytes, otherwise it's the same as SSE4.1
+		SIMD_TARGET_AVX2 static void avx2(const unsigned char* sourcePointer, unsigned char* destinationPointer, size_t pixels) {
+			if constexpr (SOURCE_BYTES == 4 && DESTINATION_BYTES == 4) {
+				static constexpr size_t AVX2_VECTOR_PIXELS = VECTOR_PIXELS * 2;
+
+				const __m256i SHUFFLE = _mm256_loadu_si256((const __m256i*)MASKS.shuffle);
+				const __m256i OPAQUE_MASK = _mm256_loadu_si256((const __m256i*)MASKS.opaque);
+
+				while (pixels >= AVX2_VECTOR_PIXELS) {
+					__m256i color = _mm256_loadu_si256((const __m256i*)sourcePointer);
+					color = _mm256_or_si256(_mm256_shuffle_epi8(color, SHUFFLE), OPAQUE_MASK);
+					_mm256_storeu_si256((__m256i*)destinationPointer, color);
+
+					sourcePointer += AVX2_VECTOR_PIXELS * SOURCE_BYTES;
+					destinationPointer += AVX2_VECTOR_PIXELS * DESTINATION_BYTES;
+					pixels -= AVX2_VECTOR_PIXELS;
+				}
+			}
+
+			sse41(sourcePointer, destinationPointer, pixels);
+		}
+		#endif
+
+		#ifdef SIMD_NEON
+		static void neon(const unsigned char* sourcePointer, unsigned char* destinationPointer, size_t pixels) {
+			// out of range indices (like 0x80) come out as zero, the same as on x86
+			const uint8x16_t SHUFFLE = vld1q_u8(MASKS.shuffle);
+			const uint8x16_t OPAQUE_MASK = vld1q_u8(MASKS.opaque);
+
+			while (pixels >= VECTOR_PIXELS_MIN) {
+				uint8x16_t color = vld1q_u8(sourcePointer);
+				color = vorrq_u8(vqtbl1q_u8(color, SHUFFLE), OPAQUE_MASK);
+				vst1q_u8(destinationPointer, color);
+
+				sourcePointer += VECTOR_PIXELS * SOURCE_BYTES;
+				destinationPointer += VECTOR_PIXELS * DESTINATION_BYTES;
+				pixels -= VECTOR_PIXELS;
+			}
+
+			scalar(sourcePointer, destinationPointer, pixels);
+		}
+		#endif
+	};
+
+	template <size_t SOURCE, size_t DESTINATION>
+	static Row getKernelRow() {
+		if constexpr (SOURCE == DESTINATION) {
+			return nullptr;
+		} else {
+			switch (SIMD::LEVEL) {
+				#ifdef SIMD_X86
+				case SIMD::Level::AVX2:
+				return Kernel<SOURCE, DESTINATION>::avx2;
+				case SIMD::Level::SSE41:
+				return Kernel<SOURCE, DESTINATION>::sse41;
+				#endif
+				#ifdef SIMD_NEON
+				case SIMD::Level::NEON:
+				return Kernel<SOURCE, DESTINATION>::neon;
+				#endif
+				default:
+				break;
+			}
+			return Kernel<SOURCE, DESTINATION>::scalar;
+		}
+	}
+
+	using Rows = std::array<Row, COLOR_FORMATS>;
+	using RowTable = std::array<Rows, COLOR_FORMATS>;
+
+	template <size_t SOURCE, size_t... DESTINATION>
+	static Rows getRows(std::index_sequence<DESTINATION...>) {
+		return { getKernelRow<SOURCE, DESTINATION>()... };
+	}
+
+	template <size_t... SOURCE>
+	static RowTable getRowTable(std::index_sequence<SOURCE...>) {
+		return { getRows<SOURCE>(std::make_index_sequence<COLOR_FORMATS>())... };
+	}
+
+	Row getRow(COLOR_FORMAT sourceColorFormat, COLOR_FORMAT destinationColorFormat) {
+		static const RowTable ROW_TABLE = getRowTable(std::make_index_sequence<COLOR_FORMATS>());
+
+		size_t source = (size_t)sourceColorFormat;
+		size_t destination = (size_t)destinationColorFormat;
+
+		if (source >= COLOR_FORMATS || destination >= COLOR_FORMATS) {
+			return nullptr;
+		}
+		return ROW_TABLE[source][destination];
+	}
+
+	bool convert(
+		const unsigned char* sourcePointer, COLOR_FORMAT sourceColorFormat, size_t sourceStride,
+		unsigned char* destinationPointer, COLOR_FORMAT destinationColorFormat, size_t destinationStride,
+		size_t width, size_t height
+	) {
+		Row row = getRow(sourceColorFormat, destinationColorFormat);
+
+		if (!row) {
+			return false;
+		}
+
+		for (size_t i = 0; i < height; i++) {
+			row(sourcePointer, destinationPointer, width);
+
+			sourcePointer += sourceStride;
+			destinationPointer += destinationStride;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+#include <M4Image.h>
+
+// converts rows of pixels between the eight bit RGB colour formats (RGBA, RGBX, BGRA, BGRX, RGB and BGR)
+// without going through pixman, for when the colour format is all that changes
+// there is a kernel for every pair, generated at compile time, and vectorized with AVX2, SSE4.1 or NEON
+// alpha that doesn't exist in the source comes out opaque, and so does X
+namespace Swizzle {
+	using Row = void(*)(const unsigned char* sourcePointer, unsigned char* destinationPointer, size_t pixels);
+
+	// returns nullptr if there is no kernel for these colour formats (or if they're the same)
+	Row getRow(M4Image::COLOR_FORMAT sourceColorFormat, M4Image::COLOR_FORMAT destinationColorFormat);
+
+	// returns false (and does nothing) if there is no kernel for these colour formats
+	bool convert(
+		const unsigned char* sourcePointer, M4Image::COLOR_FORMAT sourceColorFormat, size_t sourceStride,
+		unsigned char* destinationPointer, M4Image::COLOR_FORMAT destinationColorFormat, size_t destinationStride,
+		size_t width, size_t height
+	);
+}
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "Workers.h"
+#include <algorithm>
+
+namespace gfx_tools {
+	Workers::Job::Job(const Function &function, size_t parts)
+		: function(function),
+		parts(parts) {
+	}
+
+	Workers::Task::Task(const TaskFunction &function)
+		: function(function) {
+	}
+
+	Workers::Workers(size_t threads) {
+		threadVector.reserve(threads);
+
+		for (size_t i = 0; i < threads; i++) {
+			threadVector.emplace_back(thread, std::ref(*this));
+		}
+	}
+
+	Workers::~Workers() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		conditionVariable.notify_all();
+
+		for (
+			auto threadVectorIterator = threadVector.begin();
+			threadVectorIterator != threadVector.end();
+			threadVectorIterator++
+		) {
+			threadVectorIterator->join();
+		}
+	}
+
+	size_t Workers::getThreads() const {
+		return threadVector.size();
+	}
+
+	void Workers::run(size_t parts, const Function &function) {
+		if (!parts) {
+			return;
+		}
+
+		Job job(function, parts);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobPointerDeque.push_back(&job);
+		}
+
+		// only as many workers are woken up as there are parts for (we do one ourselves)
+		// because waking one up costs about as much whether it gets a part or not
+		size_t wake = __min(parts - 1, threadVector.size());
+
+		for (size_t i = 0; i < wake; i++) {
+			conditionVariable.notify_one();
+		}
+
+		// help out with our own job until there are no parts left to start
+		// (the job may not be first in the queue, but only our own job's parts are done here)
+		for (;;) {
+			size_t part = 0;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (job.started == job.parts) {
+					break;
+				}
+
+				part = job.started++;
+
+				if (job.started == job.parts) {
+					jobPointerDeque.erase(std::find(jobPointerDeque.begin(), jobPointerDeque.end(), &job));
+				}
+			}
+
+			function(part);
+			finish(job);
+		}
+
+		// now only wait on the parts the workers already started
+		std::unique_lock<std::mutex> lock(mutex);
+
+		job.doneConditionVariable.wait(lock, [&] {
+			return job.done == job.parts;
+		});
+	}
+
+	Workers::TaskPointer Workers::post(const TaskFunction &function) {
+		TaskPointer taskPointer = std::make_shared<Task>(function);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			taskPointerDeque.push_back(taskPointer);
+		}
+
+		conditionVariable.notify_one();
+		return taskPointer;
+	}
+
+	void Workers::wait(const TaskPointer &taskPointer) {
+		Task &task = *taskPointer;
+
+		if (cancel(taskPointer)) {
+			task.function();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		task.doneConditionVariable.wait(lock, [&] {
+			return task.done;
+		});
+
+		if (task.exceptionPointer) {
+			std::rethrow_exception(task.exceptionPointer);
+		}
+	}
+
+	bool Workers::cancel(const TaskPointer &taskPointer) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (taskPointer->started) {
+			return false;
+		}
+
+		taskPointer->started = true;
+		taskPointerDeque.erase(std::find(taskPointerDeque.begin(), taskPointerDeque.end(), taskPointer));
+		return true;
+	}
+
+	void Workers::run(Task &task) {
+		std::exception_ptr exceptionPointer = nullptr;
+
+		try {
+			task.function();
+		} catch (...) {
+			exceptionPointer = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		task.exceptionPointer = exceptionPointer;
+		task.done = true;
+		task.doneConditionVariable.notify_all();
+	}
+
+	void Workers::thread(Workers &workers) {
+		Job* jobPointer = nullptr;
+		size_t part = 0;
+		TaskPointer taskPointer = nullptr;
+
+		while (workers.start(jobPointer, part, taskPointer)) {
+			if (taskPointer) {
+				workers.run(*taskPointer);
+				taskPointer = nullptr;
+				continue;
+			}
+
+			jobPointer->function(part);
+			workers.finish(*jobPointer);
+		}
+	}
+
+	bool Workers::start(Job* &jobPointer, size_t &part, TaskPointer &taskPointer) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		conditionVariable.wait(lock, [&] {
+			return stopping || !jobPointerDeque.empty() || !taskPointerDeque.empty();
+		});
+
+		if (stopping) {
+			return false;
+		}
+
+		// someone is waiting on the parts of a job, but nobody is waiting on a task yet
+		// (and if they are, they'll just do it themselves)
+		if (jobPointerDeque.empty()) {
+			taskPointer = taskPointerDeque.front();
+			taskPointer->started = true;
+			taskPointerDeque.pop_front();
+			return true;
+		}
+
+		jobPointer = jobPointerDeque.front();
+		Job &job = *jobPointer;
+		part = job.started++;
+
+		// once every part is started, no one else should look at the job
+		// (it will go away as soon as the last part is done)
+		if (job.started == job.parts) {
+			jobPointerDeque.pop_front();
+		}
+		return true;
+	}
+
+	void Workers::finish(Job &job) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// this must be done with the lock held, because the job is gone as soon as it's seen to be done
+		if (++job.done == job.parts) {
+			job.doneConditionVariable.notify_one();
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <exception>
+
+namespace gfx_tools {
+	// a small pool of threads to split large conversions across
+	// the thread that calls run always does some of the work itself, and never waits on work nobody has started
+	// so even if every worker is busy (or the game is hogging the CPU) it can't deadlock, it's just slower
+	// work can also be posted to be done in the background, which is only started once no run has parts left
+	class Workers : NonCopyable {
+		public:
+		using Pointer = std::shared_ptr<Workers>;
+		using Function = std::function<void(size_t part)>;
+		using TaskFunction = std::function<void()>;
+
+		class Task : NonCopyable {
+			friend class Workers;
+
+			private:
+			TaskFunction function = {};
+			bool started = false;
+			bool done = false;
+			std::exception_ptr exceptionPointer = nullptr;
+			std::condition_variable doneConditionVariable = {};
+
+			public:
+			Task(const TaskFunction &function);
+		};
+
+		using TaskPointer = std::shared_ptr<Task>;
+
+		Workers(size_t threads);
+		~Workers();
+		size_t getThreads() const;
+		void run(size_t parts, const Function &function);
+
+		// every task that is posted must be waited for or cancelled before the workers go away
+		TaskPointer post(const TaskFunction &function);
+
+		// if no worker has started the task yet, this thread does it instead (again, so it never waits on nobody)
+		// rethrows whatever the task threw
+		void wait(const TaskPointer &taskPointer);
+
+		// takes the task back and returns true if no worker has started it yet
+		// otherwise returns false, and it must still be waited for
+		bool cancel(const TaskPointer &taskPointer);
+
+		private:
+		struct Job {
+			const Function &function;
+			size_t parts = 0;
+			size_t started = 0;
+			size_t done = 0;
+			std::condition_variable doneConditionVariable = {};
+
+			Job(const Function &function, size_t parts);
+		};
+
+		using JobPointerDeque = std::deque<Job*>;
+		using TaskPointerDeque = std::deque<TaskPointer>;
+
+		static void thread(Workers &workers);
+
+		bool start(Job* &jobPointer, size_t &part, TaskPointer &taskPointer);
+		void finish(Job &job);
+		void run(Task &task);
+
+		std::mutex mutex = {};
+		std::condition_variable conditionVariable = {};
+		JobPointerDeque jobPointerDeque = {};
+		TaskPointerDeque taskPointerDeque = {};
+		bool stopping = false;
+		std::vector<std::thread> threadVector = {};
+	};
+
+	// returns NULL if there's no point in using them (like if there's only one core)
+	Workers::Pointer getWorkers();
+}
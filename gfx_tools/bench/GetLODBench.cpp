@@ -0,0 +1,203 @@
+// times what GetLOD does with a resized LOD that is already the right size, for every pair of colour formats
+// (source format, target format) that Swizzle covers: the old way, a pixman SRC composite (what M4Image::blit comes down to
+// when nothing is scaled) against the new way, a memcpy if the formats are the same or a Swizzle kernel if they're not
+// and checks that both come out the same
+// M4Image's own setup on top of the composite isn't counted, so the old times are if anything too fast
+// build from this folder, once per SIMD level (NONE, SSE41, AVX2 or NEON) with pixman-1 built from vendor/pixman-1:
+//   g++ -std=c++17 -O2 -DSIMD_LEVEL=AVX2 -include bench.h -I.. -I../../vendor/libzap/include -I../../vendor/scope_guard/include
+//     -I../../vendor/M4Image/include -I../../vendor/pixman-1/include GetLODBench.cpp ../Swizzle.cpp -lpixman-1 -o GetLODBench
+// returns zero if every pair came out the same
+#include "../pch.h"
+#include "../Swizzle.h"
+#include <pixman.h>
+#include <vector>
+
+using COLOR_FORMAT = M4Image::COLOR_FORMAT;
+
+struct Format {
+	COLOR_FORMAT colorFormat = COLOR_FORMAT::RGBA;
+	size_t bytes = 0;
+	pixman_format_code_t pixmanFormat = {};
+	const char* name = "";
+};
+
+// pixman's formats are packed pixels, so on a little endian machine the byte order is reversed
+static const Format FORMATS[] = {
+	{ COLOR_FORMAT::RGBA, 4, PIXMAN_a8b8g8r8, "RGBA" },
+	{ COLOR_FORMAT::RGBX, 4, PIXMAN_x8b8g8r8, "RGBX" },
+	{ COLOR_FORMAT::BGRA, 4, PIXMAN_a8r8g8b8, "BGRA" },
+	{ COLOR_FORMAT::BGRX, 4, PIXMAN_x8r8g8b8, "BGRX" },
+	{ COLOR_FORMAT::RGB, 3, PIXMAN_b8g8r8, "RGB" },
+	{ COLOR_FORMAT::BGR, 3, PIXMAN_r8g8b8, "BGR" }
+};
+
+static constexpr size_t FORMATS_SIZE = sizeof(FORMATS) / sizeof(*FORMATS);
+
+static const int SIZES[] = { 64, 256, 1024 };
+
+// same as in ResizeLOD
+static constexpr size_t STRIDE_ALIGNMENT = 4;
+
+static size_t getStride(int width, size_t bytes) {
+	return (((size_t)width * bytes + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT) * STRIDE_ALIGNMENT;
+}
+
+static bool isX(COLOR_FORMAT colorFormat) {
+	return colorFormat == COLOR_FORMAT::RGBX || colorFormat == COLOR_FORMAT::BGRX;
+}
+
+static void blitPixman(
+	unsigned char* sourcePointer, const Format &sourceFormat, size_t sourceStride,
+	unsigned char* destinationPointer, const Format &destinationFormat, size_t destinationStride,
+	int width, int height
+) {
+	pixman_image_t* sourceImage = pixman_image_create_bits(sourceFormat.pixmanFormat, width, height, (uint32_t*)sourcePointer, (int)sourceStride);
+	pixman_image_t* destinationImage = pixman_image_create_bits(destinationFormat.pixmanFormat, width, height, (uint32_t*)destinationPointer, (int)destinationStride);
+
+	SCOPE_EXIT {
+		pixman_image_unref(sourceImage);
+		pixman_image_unref(destinationImage);
+	};
+
+	pixman_image_composite32(PIXMAN_OP_SRC, sourceImage, NULL, destinationImage, 0, 0, 0, 0, 0, 0, width, height);
+}
+
+// the same as GetLOD
+static void copy(
+	const unsigned char* sourcePointer, const Format &sourceFormat, size_t sourceStride,
+	unsigned char* destinationPointer, const Format &destinationFormat, size_t destinationStride,
+	int width, int height
+) {
+	if (sourceFormat.colorFormat != destinationFormat.colorFormat) {
+		Swizzle::convert(
+			sourcePointer, sourceFormat.colorFormat, sourceStride,
+			destinationPointer, destinationFormat.colorFormat, destinationStride,
+			width, height
+		);
+		return;
+	}
+
+	const size_t ROW_SIZE = (size_t)width * sourceFormat.bytes;
+
+	if (sourceStride == destinationStride) {
+		memcpy(destinationPointer, sourcePointer, ((size_t)(height - 1) * destinationStride) + ROW_SIZE);
+		return;
+	}
+
+	for (int row = 0; row < height; row++) {
+		memcpy(destinationPointer, sourcePointer, ROW_SIZE);
+
+		destinationPointer += destinationStride;
+		sourcePointer += sourceStride;
+	}
+}
+
+// X is left alone by pixman when it's the target, and comes out opaque from Swizzle, so it isn't compared
+static size_t compare(
+	const unsigned char* pixmanPointer, const unsigned char* copyPointer, const Format &format, size_t stride,
+	int width, int height
+) {
+	size_t differences = 0;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			for (size_t channel = 0; channel < format.bytes; channel++) {
+				if (channel == 3 && isX(format.colorFormat)) {
+					continue;
+				}
+
+				size_t index = y * stride + x * format.bytes + channel;
+
+				if (pixmanPointer[index] != copyPointer[index]) {
+					differences++;
+				}
+			}
+		}
+	}
+	return differences;
+}
+
+int main(int argc, char** argv) {
+	bool passed = true;
+
+	printf("SIMD level: %s\n", Bench::getLevelName());
+
+	for (size_t i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+		const int SIZE = SIZES[i];
+
+		// the game's pitch is the same as ours, or (for some textures) wider, so the rows have to be copied one at a time
+		for (size_t padding = 0; padding <= 64; padding += 64) {
+			printf("%dx%d, target stride %s (old us / new us, speedup)\n", SIZE, SIZE, padding ? "+64" : "the same");
+			printf("          ");
+
+			for (size_t j = 0; j < FORMATS_SIZE; j++) {
+				printf("%-22s", FORMATS[j].name);
+			}
+
+			printf("\n");
+
+			for (size_t j = 0; j < FORMATS_SIZE; j++) {
+				const Format &SOURCE_FORMAT = FORMATS[j];
+				const size_t SOURCE_STRIDE = getStride(SIZE, SOURCE_FORMAT.bytes);
+
+				std::vector<unsigned char> source(SIZE * SOURCE_STRIDE);
+				Bench::fill(source.data(), source.size());
+
+				// pixman expects opaque alpha for X, like the decoders write
+				if (isX(SOURCE_FORMAT.colorFormat)) {
+					for (size_t index = 3; index < source.size(); index += 4) {
+						source[index] = 0xFF;
+					}
+				}
+
+				printf("  %-6s->", SOURCE_FORMAT.name);
+
+				for (size_t k = 0; k < FORMATS_SIZE; k++) {
+					const Format &DESTINATION_FORMAT = FORMATS[k];
+					const size_t DESTINATION_STRIDE = getStride(SIZE, DESTINATION_FORMAT.bytes) + padding;
+
+					std::vector<unsigned char> pixman(SIZE * DESTINATION_STRIDE);
+					std::vector<unsigned char> copied(pixman.size());
+
+					double pixmanMilliseconds = Bench::time([&] {
+						blitPixman(
+							source.data(), SOURCE_FORMAT, SOURCE_STRIDE,
+							pixman.data(), DESTINATION_FORMAT, DESTINATION_STRIDE,
+							SIZE, SIZE
+						);
+					});
+
+					double copyMilliseconds = Bench::time([&] {
+						copy(
+							source.data(), SOURCE_FORMAT, SOURCE_STRIDE,
+							copied.data(), DESTINATION_FORMAT, DESTINATION_STRIDE,
+							SIZE, SIZE
+						);
+					});
+
+					size_t differences = compare(pixman.data(), copied.data(), DESTINATION_FORMAT, DESTINATION_STRIDE, SIZE, SIZE);
+
+					if (differences) {
+						passed = false;
+					}
+
+					char cell[32] = "";
+
+					snprintf(
+						cell, sizeof(cell), "%.1f/%.1f %.1fx%s",
+						pixmanMilliseconds * 1000.0, copyMilliseconds * 1000.0, pixmanMilliseconds / copyMilliseconds,
+						differences ? "!" : ""
+					);
+
+					printf("%-22s", cell);
+				}
+
+				printf("\n");
+			}
+		}
+	}
+
+	// a ! after a cell means the copy came out different from pixman
+	printf(passed ? "every pair came out the same\n" : "FAILED: some pairs came out different (marked with !)\n");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+// checks the SIMD height map kernels against the scalar ones, and times them
+// (the DuDv ones must be exact, the normal map ones within one)
+// every level this CPU supports is tested (the level is passed in, so it doesn't need building once per level)
+// build from this folder:
+//   g++ -std=c++17 -O2 -include bench.h -I.. -I../../vendor/libzap/include -I../../vendor/scope_guard/include
+//     -I../../vendor/M4Image/include HeightMapTest.cpp ../HeightMap.cpp -o HeightMapTest
+// returns zero if every level passed
+#include "../pch.h"
+#include "../HeightMap.h"
+#include <vector>
+
+using Dimension = gfx_tools::Dimension;
+using Stride = gfx_tools::Stride;
+
+static std::vector<SIMD::Level> getLevels() {
+	std::vector<SIMD::Level> levels = { SIMD::Level::NONE };
+	const SIMD::Level LEVEL = SIMD::detectLevel();
+
+	if (LEVEL == SIMD::Level::NEON) {
+		levels.push_back(SIMD::Level::NEON);
+	} else {
+		if (LEVEL >= SIMD::Level::SSE41) {
+			levels.push_back(SIMD::Level::SSE41);
+		}
+
+		if (LEVEL >= SIMD::Level::AVX2) {
+			levels.push_back(SIMD::Level::AVX2);
+		}
+	}
+	return levels;
+}
+
+// the channels wrap around, so 255 and 0 are one apart
+static int getChannelDifference(unsigned char a, unsigned char b) {
+	int difference = abs((int)a - (int)b);
+	return __min(difference, 256 - difference);
+}
+
+// widths around every vector size (so that every tail is hit) and a couple of big ones
+static const Dimension WIDTHS[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 640, 1023 };
+static const Dimension HEIGHTS[] = { 1, 2, 3, 17 };
+
+static const float STRENGTHS[] = { 0.0f, 0.25f, 1.0f, 2.5f, 8.0f, 100.0f };
+
+// the input is noise, so every difference from -255 to 255 comes up
+// the extra row is the row below, for testing bands
+static std::vector<M4Image::Color32> makeInput(Dimension width, Dimension height) {
+	std::vector<M4Image::Color32> input((size_t)width * (height + 1));
+	Bench::fill((unsigned char*)input.data(), input.size() * sizeof(M4Image::Color32), width * 31 + height);
+	return input;
+}
+
+static bool testNormalMap(SIMD::Level level) {
+	int differenceMax = 0;
+	size_t differences = 0;
+	size_t channels = 0;
+
+	for (size_t i = 0; i < sizeof(WIDTHS) / sizeof(*WIDTHS); i++) {
+		for (size_t j = 0; j < sizeof(HEIGHTS) / sizeof(*HEIGHTS); j++) {
+			for (size_t k = 0; k < sizeof(STRENGTHS) / sizeof(*STRENGTHS); k++) {
+				const Dimension WIDTH = WIDTHS[i];
+				const Dimension HEIGHT = HEIGHTS[j];
+				const Stride STRIDE = (Stride)(WIDTH * sizeof(M4Image::Color32));
+				const size_t SIZE = (size_t)WIDTH * HEIGHT;
+
+				std::vector<M4Image::Color32> input = makeInput(WIDTH, HEIGHT);
+				const M4Image::Color32* lastInputYPointer = input.data() + SIZE;
+
+				// once as a whole image, once as a band with a row below it, and once in place
+				for (int mode = 0; mode < 3; mode++) {
+					std::vector<M4Image::Color32> scalar(input.begin(), input.begin() + SIZE);
+					std::vector<M4Image::Color32> simd(input.begin(), input.begin() + SIZE);
+
+					const M4Image::Color32* rowBelowPointer = mode == 1 ? lastInputYPointer : nullptr;
+
+					std::vector<M4Image::Color32> scalarInput(input.begin(), input.begin() + SIZE);
+					std::vector<M4Image::Color32> simdInput(input.begin(), input.begin() + SIZE);
+
+					HeightMap::convertHeightMapIntoNormalMapColor(
+						WIDTH, HEIGHT,
+						mode == 2 ? scalar.data() : scalarInput.data(), STRIDE,
+						scalar.data(), STRIDE,
+						STRENGTHS[k], rowBelowPointer, SIMD::Level::NONE
+					);
+
+					HeightMap::convertHeightMapIntoNormalMapColor(
+						WIDTH, HEIGHT,
+						mode == 2 ? simd.data() : simdInput.data(), STRIDE,
+						simd.data(), STRIDE,
+						STRENGTHS[k], rowBelowPointer, level
+					);
+
+					for (size_t pixel = 0; pixel < SIZE; pixel++) {
+						for (size_t channel = 0; channel < 4; channel++) {
+							int difference = getChannelDifference(scalar[pixel].channels[channel], simd[pixel].channels[channel]);
+
+							if (difference) {
+								differences++;
+							}
+
+							differenceMax = __max(differenceMax, difference);
+							channels++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// the floats may round the other way from the doubles, but never by more than one
+	bool passed = differenceMax <= 1;
+
+	printf(
+		"  normal map: %s, %zu of %zu channels off by one, max difference %d\n",
+		passed ? "passed" : "FAILED",
+		differences, channels, differenceMax
+	);
+	return passed;
+}
+
+template<bool luminance>
+static bool testDuDvBumpMap(SIMD::Level level) {
+	size_t differences = 0;
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < sizeof(WIDTHS) / sizeof(*WIDTHS); i++) {
+		for (size_t j = 0; j < sizeof(HEIGHTS) / sizeof(*HEIGHTS); j++) {
+			const Dimension WIDTH = WIDTHS[i];
+			const Dimension HEIGHT = HEIGHTS[j];
+			const Stride INPUT_STRIDE = (Stride)(WIDTH * sizeof(M4Image::Color32));
+			const size_t SIZE = (size_t)WIDTH * HEIGHT;
+
+			std::vector<M4Image::Color32> input = makeInput(WIDTH, HEIGHT);
+			const M4Image::Color32* lastInputVPointer = input.data() + SIZE;
+
+			// the output is always as big as the input, so that it can also be converted in place
+			// (when it is, the output stride is the input stride)
+			for (int mode = 0; mode < 3; mode++) {
+				const Stride OUTPUT_STRIDE = (mode == 2 || luminance)
+					? INPUT_STRIDE
+					: (Stride)(WIDTH * sizeof(M4Image::Color16));
+
+				std::vector<M4Image::Color32> scalar(input.begin(), input.begin() + SIZE);
+				std::vector<M4Image::Color32> simd(input.begin(), input.begin() + SIZE);
+
+				const M4Image::Color32* rowBelowPointer = mode == 1 ? lastInputVPointer : nullptr;
+
+				std::vector<M4Image::Color32> scalarInput(input.begin(), input.begin() + SIZE);
+				std::vector<M4Image::Color32> simdInput(input.begin(), input.begin() + SIZE);
+
+				HeightMap::convertHeightMapIntoDuDvBumpMapColor<luminance>(
+					WIDTH, HEIGHT,
+					mode == 2 ? scalar.data() : scalarInput.data(), INPUT_STRIDE,
+					(M4Image::Color16*)scalar.data(), OUTPUT_STRIDE,
+					rowBelowPointer, SIMD::Level::NONE
+				);
+
+				HeightMap::convertHeightMapIntoDuDvBumpMapColor<luminance>(
+					WIDTH, HEIGHT,
+					mode == 2 ? simd.data() : simdInput.data(), INPUT_STRIDE,
+					(M4Image::Color16*)simd.data(), OUTPUT_STRIDE,
+					rowBelowPointer, level
+				);
+
+				// everything is compared, including what should have been left alone
+				const unsigned char* scalarPointer = (const unsigned char*)scalar.data();
+				const unsigned char* simdPointer = (const unsigned char*)simd.data();
+
+				for (size_t byte = 0; byte < SIZE * sizeof(M4Image::Color32); byte++) {
+					if (scalarPointer[byte] != simdPointer[byte]) {
+						differences++;
+					}
+
+					bytes++;
+				}
+			}
+		}
+	}
+
+	// this is all integer math, so it must be exactly the same
+	bool passed = !differences;
+
+	printf(
+		"  DuDv bump map (%s): %s, %zu of %zu bytes different\n",
+		luminance ? "XLVU" : "VU",
+		passed ? "passed" : "FAILED",
+		differences, bytes
+	);
+	return passed;
+}
+
+static void benchNormalMap(SIMD::Level level) {
+	static constexpr Dimension WIDTH = 1024;
+	static constexpr Dimension HEIGHT = 1024;
+	static constexpr Stride STRIDE = WIDTH * sizeof(M4Image::Color32);
+
+	std::vector<M4Image::Color32> input = makeInput(WIDTH, HEIGHT);
+	std::vector<M4Image::Color32> output((size_t)WIDTH * HEIGHT);
+
+	double milliseconds = Bench::time([&] {
+		HeightMap::convertHeightMapIntoNormalMapColor(
+			WIDTH, HEIGHT,
+			input.data(), STRIDE,
+			output.data(), STRIDE,
+			2.5, nullptr, level
+		);
+	});
+
+	printf("  normal map: 1024x1024 in %.2f ms (%.0f megapixels per second)\n", milliseconds, Bench::rate((size_t)WIDTH * HEIGHT, milliseconds));
+}
+
+template<bool luminance>
+static void benchDuDvBumpMap(SIMD::Level level) {
+	static constexpr Dimension WIDTH = 1024;
+	static constexpr Dimension HEIGHT = 1024;
+	static constexpr Stride INPUT_STRIDE = WIDTH * sizeof(M4Image::Color32);
+	static constexpr Stride OUTPUT_STRIDE = luminance ? INPUT_STRIDE : WIDTH * sizeof(M4Image::Color16);
+
+	std::vector<M4Image::Color32> input = makeInput(WIDTH, HEIGHT);
+	std::vector<M4Image::Color32> output((size_t)WIDTH * HEIGHT);
+
+	double milliseconds = Bench::time([&] {
+		HeightMap::convertHeightMapIntoDuDvBumpMapColor<luminance>(
+			WIDTH, HEIGHT,
+			input.data(), INPUT_STRIDE,
+			(M4Image::Color16*)output.data(), OUTPUT_STRIDE,
+			nullptr, level
+		);
+	});
+
+	printf(
+		"  DuDv bump map (%s): 1024x1024 in %.2f ms (%.0f megapixels per second)\n",
+		luminance ? "XLVU" : "VU",
+		milliseconds, Bench::rate((size_t)WIDTH * HEIGHT, milliseconds)
+	);
+}
+
+int main(int argc, char** argv) {
+	bool passed = true;
+	std::vector<SIMD::Level> levels = getLevels();
+
+	for (
+		std::vector<SIMD::Level>::iterator levelsIterator = levels.begin();
+		levelsIterator != levels.end();
+		levelsIterator++
+	) {
+		SIMD::Level level = *levelsIterator;
+
+		printf("SIMD level: %s\n", Bench::getLevelName(level));
+
+		if (!testNormalMap(level)) {
+			passed = false;
+		}
+
+		if (!testDuDvBumpMap<false>(level)) {
+			passed = false;
+		}
+
+		if (!testDuDvBumpMap<true>(level)) {
+			passed = false;
+		}
+
+		benchNormalMap(level);
+		benchDuDvBumpMap<false>(level);
+		benchDuDvBumpMap<true>(level);
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// times Resample against pixman (what ResizeLOD blitted with before) for the downscales ResizeLOD does
+// when a texture is bigger than the device caps allow, and reports how far apart their output is
+// build from this folder, once per SIMD level (NONE, SSE41, AVX2 or NEON) with pixman-1 built from vendor/pixman-1:
+//   g++ -std=c++17 -O2 -DSIMD_LEVEL=AVX2 -include bench.h -I.. -I../../vendor/libzap/include -I../../vendor/scope_guard/include
+//     -I../../vendor/pixman-1/include ResampleBench.cpp ../Resample.cpp -lpixman-1 -o ResampleBench
+// define BENCH_NVTT (and add nvtt's include folder and library) to also compare the float resize against nvtt's
+#include "../pch.h"
+#include "../Resample.h"
+#include <pixman.h>
+#include <vector>
+#include <math.h>
+
+#ifdef BENCH_NVTT
+#include <nvtt/nvtt.h>
+#endif
+
+struct Downscale {
+	int sourceWidth = 0;
+	int sourceHeight = 0;
+	int destinationWidth = 0;
+	int destinationHeight = 0;
+};
+
+// halving once or twice is what the caps and the texture quality setting do
+static const Downscale DOWNSCALES[] = {
+	{ 2048, 2048, 1024, 1024 },
+	{ 1024, 1024, 512, 512 },
+	{ 1024, 1024, 256, 256 },
+	{ 640, 480, 320, 240 }
+};
+
+struct Format {
+	int bytes = 0;
+	pixman_format_code_t pixmanFormat = {};
+	const char* name = "";
+};
+
+// the formats that go through Resample (the ones with alpha are still blitted)
+static const Format FORMATS[] = {
+	{ 1, PIXMAN_a8, "L" },
+	{ 3, PIXMAN_r8g8b8, "BGR" },
+	{ 4, PIXMAN_x8r8g8b8, "BGRX" }
+};
+
+static constexpr size_t STRIDE_ALIGNMENT = 4;
+
+static size_t getStride(int width, int bytes) {
+	return (((size_t)width * bytes + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT) * STRIDE_ALIGNMENT;
+}
+
+// pixman's closest equivalent to Resample's filter: a tent, as wide as the scale, point sampled
+// with the edges padded (clamped) like Resample does
+static void resizePixman(
+	unsigned char* sourcePointer, int sourceWidth, int sourceHeight, size_t sourceStride,
+	unsigned char* destinationPointer, int destinationWidth, int destinationHeight, size_t destinationStride,
+	pixman_format_code_t format
+) {
+	static constexpr int SUBSAMPLE_BITS = 4;
+
+	pixman_image_t* sourceImage = pixman_image_create_bits(format, sourceWidth, sourceHeight, (uint32_t*)sourcePointer, (int)sourceStride);
+	pixman_image_t* destinationImage = pixman_image_create_bits(format, destinationWidth, destinationHeight, (uint32_t*)destinationPointer, (int)destinationStride);
+
+	SCOPE_EXIT {
+		pixman_image_unref(sourceImage);
+		pixman_image_unref(destinationImage);
+	};
+
+	pixman_fixed_t scaleX = pixman_double_to_fixed((double)sourceWidth / destinationWidth);
+	pixman_fixed_t scaleY = pixman_double_to_fixed((double)sourceHeight / destinationHeight);
+
+	pixman_transform_t transform = {};
+	pixman_transform_init_scale(&transform, scaleX, scaleY);
+	pixman_image_set_transform(sourceImage, &transform);
+
+	int params = 0;
+	pixman_fixed_t* paramsPointer = pixman_filter_create_separable_convolution(
+		&params,
+		scaleX, scaleY,
+		PIXMAN_KERNEL_IMPULSE, PIXMAN_KERNEL_IMPULSE,
+		PIXMAN_KERNEL_LINEAR, PIXMAN_KERNEL_LINEAR,
+		SUBSAMPLE_BITS, SUBSAMPLE_BITS
+	);
+
+	pixman_image_set_filter(sourceImage, PIXMAN_FILTER_SEPARABLE_CONVOLUTION, paramsPointer, params);
+	free(paramsPointer);
+
+	pixman_image_set_repeat(sourceImage, PIXMAN_REPEAT_PAD);
+	pixman_image_composite32(PIXMAN_OP_SRC, sourceImage, NULL, destinationImage, 0, 0, 0, 0, 0, 0, destinationWidth, destinationHeight);
+}
+
+// the source is noise blurred a little, so that it has edges but isn't all edges
+static void fillSource(unsigned char* pointer, int width, int height, size_t stride, int bytes) {
+	std::vector<unsigned char> noise((size_t)width * height * bytes);
+	Bench::fill(noise.data(), noise.size());
+
+	const size_t ROW_SIZE = (size_t)width * bytes;
+
+	for (int y = 0; y < height; y++) {
+		for (size_t x = 0; x < ROW_SIZE; x++) {
+			unsigned int sum = 0;
+			unsigned int count = 0;
+
+			for (int offset = -1; offset <= 1; offset++) {
+				int row = y + offset;
+
+				if (row >= 0 && row < height) {
+					sum += noise[row * ROW_SIZE + x];
+					count++;
+				}
+			}
+
+			pointer[y * stride + x] = (unsigned char)(sum / count);
+		}
+	}
+}
+
+#ifdef BENCH_NVTT
+// nvtt resizes every channel as float, which is what the float overload of Resample is used for
+static void compareNvtt(const Downscale &downscale) {
+	const int SOURCE_WIDTH = downscale.sourceWidth;
+	const int SOURCE_HEIGHT = downscale.sourceHeight;
+	const int DESTINATION_WIDTH = downscale.destinationWidth;
+	const int DESTINATION_HEIGHT = downscale.destinationHeight;
+
+	const size_t SOURCE_STRIDE = getStride(SOURCE_WIDTH, 4);
+
+	std::vector<unsigned char> source(SOURCE_HEIGHT * SOURCE_STRIDE);
+	fillSource(source.data(), SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_STRIDE, 4);
+
+	nvtt::Surface surface;
+	surface.setImage(nvtt::InputFormat_BGRA_8UB, SOURCE_WIDTH, SOURCE_HEIGHT, 1, source.data());
+
+	std::vector<float> channel((size_t)SOURCE_WIDTH * SOURCE_HEIGHT);
+	memcpy(channel.data(), surface.channel(0), channel.size() * sizeof(float));
+
+	std::vector<float> resampled((size_t)DESTINATION_WIDTH * DESTINATION_HEIGHT);
+
+	double resampleMilliseconds = Bench::time([&] {
+		Resample::resize(
+			channel.data(), SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * sizeof(float),
+			resampled.data(), DESTINATION_WIDTH, DESTINATION_HEIGHT, DESTINATION_WIDTH * sizeof(float)
+		);
+	});
+
+	nvtt::Surface resizedSurface;
+
+	double nvttMilliseconds = Bench::time([&] {
+		resizedSurface = surface;
+		resizedSurface.resize(DESTINATION_WIDTH, DESTINATION_HEIGHT, 1, nvtt::ResizeFilter_Triangle);
+	});
+
+	const float* resizedChannel = resizedSurface.channel(0);
+
+	double difference = 0.0;
+	double differenceMax = 0.0;
+
+	for (size_t i = 0; i < resampled.size(); i++) {
+		double pixelDifference = fabs((double)resampled[i] - resizedChannel[i]) * 255.0;
+		difference += pixelDifference;
+		differenceMax = __max(differenceMax, pixelDifference);
+	}
+
+	printf(
+		"  nvtt float x4 channels: Resample %.2f ms, nvtt %.2f ms, mean difference %.3f, max %.3f (in eight bit steps)\n",
+		resampleMilliseconds * 4, nvttMilliseconds,
+		difference / resampled.size(), differenceMax
+	);
+}
+#endif
+
+int main(int argc, char** argv) {
+	printf("SIMD level: %s\n", Bench::getLevelName());
+
+	for (size_t i = 0; i < sizeof(DOWNSCALES) / sizeof(*DOWNSCALES); i++) {
+		const Downscale &DOWNSCALE = DOWNSCALES[i];
+
+		const int SOURCE_WIDTH = DOWNSCALE.sourceWidth;
+		const int SOURCE_HEIGHT = DOWNSCALE.sourceHeight;
+		const int DESTINATION_WIDTH = DOWNSCALE.destinationWidth;
+		const int DESTINATION_HEIGHT = DOWNSCALE.destinationHeight;
+
+		printf("%dx%d to %dx%d\n", SOURCE_WIDTH, SOURCE_HEIGHT, DESTINATION_WIDTH, DESTINATION_HEIGHT);
+
+		for (size_t j = 0; j < sizeof(FORMATS) / sizeof(*FORMATS); j++) {
+			const Format &FORMAT = FORMATS[j];
+
+			const size_t SOURCE_STRIDE = getStride(SOURCE_WIDTH, FORMAT.bytes);
+			const size_t DESTINATION_STRIDE = getStride(DESTINATION_WIDTH, FORMAT.bytes);
+
+			std::vector<unsigned char> source(SOURCE_HEIGHT * SOURCE_STRIDE);
+			std::vector<unsigned char> resampled(DESTINATION_HEIGHT * DESTINATION_STRIDE);
+			std::vector<unsigned char> pixman(DESTINATION_HEIGHT * DESTINATION_STRIDE);
+
+			fillSource(source.data(), SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_STRIDE, FORMAT.bytes);
+
+			double resampleMilliseconds = Bench::time([&] {
+				Resample::resize(
+					source.data(), SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_STRIDE,
+					resampled.data(), DESTINATION_WIDTH, DESTINATION_HEIGHT, DESTINATION_STRIDE,
+					FORMAT.bytes
+				);
+			});
+
+			double pixmanMilliseconds = Bench::time([&] {
+				resizePixman(
+					source.data(), SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_STRIDE,
+					pixman.data(), DESTINATION_WIDTH, DESTINATION_HEIGHT, DESTINATION_STRIDE,
+					FORMAT.pixmanFormat
+				);
+			});
+
+			// X is left alone by pixman, so it isn't compared
+			const int CHANNELS = FORMAT.pixmanFormat == PIXMAN_x8r8g8b8 ? 3 : FORMAT.bytes;
+
+			unsigned long long difference = 0;
+			int differenceMax = 0;
+			size_t channels = 0;
+
+			for (int y = 0; y < DESTINATION_HEIGHT; y++) {
+				for (int x = 0; x < DESTINATION_WIDTH; x++) {
+					for (int channel = 0; channel < CHANNELS; channel++) {
+						size_t index = y * DESTINATION_STRIDE + (size_t)x * FORMAT.bytes + channel;
+						int channelDifference = abs((int)resampled[index] - (int)pixman[index]);
+						difference += channelDifference;
+						differenceMax = __max(differenceMax, channelDifference);
+						channels++;
+					}
+				}
+			}
+
+			printf(
+				"  %-4s Resample %7.2f ms, pixman %7.2f ms (%.1fx), mean difference %.3f, max %d\n",
+				FORMAT.name,
+				resampleMilliseconds, pixmanMilliseconds, pixmanMilliseconds / resampleMilliseconds,
+				(double)difference / channels, differenceMax
+			);
+		}
+
+		#ifdef BENCH_NVTT
+		compareNvtt(DOWNSCALE);
+		#endif
+	}
+	return 0;
+}
@@ -0,0 +1,191 @@
+// measures what the banding thresholds in main.cpp are set from:
+// how long a height map kernel takes per pixel, and how long it takes to hand a job to the workers and get it back
+// if there is more than one core, it also times converting in bands against converting on one thread
+// to find the crossover directly
+// build from this folder:
+//   g++ -std=c++17 -O2 -include bench.h -I.. -I../../vendor/libzap/include -I../../vendor/scope_guard/include
+//     -I../../vendor/M4Image/include WorkersBench.cpp ../Workers.cpp ../HeightMap.cpp -lpthread -o WorkersBench
+#include "../pch.h"
+#include "../Workers.h"
+#include "../HeightMap.h"
+#include <vector>
+#include <thread>
+
+using Dimension = gfx_tools::Dimension;
+using Stride = gfx_tools::Stride;
+using Workers = gfx_tools::Workers;
+
+static constexpr Stride getStride(Dimension width) {
+	return (Stride)(width * sizeof(M4Image::Color32));
+}
+
+static constexpr Stride getDuDvBumpMapStride(Dimension width) {
+	return (Stride)(width * sizeof(M4Image::Color16));
+}
+
+static void convert(Dimension width, Dimension height, M4Image::Color32* inputPointer, M4Image::Color32* outputPointer) {
+	HeightMap::convertHeightMapIntoDuDvBumpMapColor<false>(
+		width, height,
+		inputPointer, getStride(width),
+		(M4Image::Color16*)outputPointer, getDuDvBumpMapStride(width)
+	);
+}
+
+// like convertBands in main.cpp, but never in place
+// (this and the above use the DuDv bump map kernel, because it's the cheapest, so it needs the most pixels to be worth it)
+static void convertBands(
+	Workers &workers, Dimension bands,
+	Dimension width, Dimension height,
+	M4Image::Color32* inputPointer, M4Image::Color32* outputPointer
+) {
+	const Dimension BAND_ROWS = (height + bands - 1) / bands;
+	bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+
+	workers.run(bands, [&](size_t band) {
+		Dimension row = (Dimension)band * BAND_ROWS;
+		Dimension rows = __min(BAND_ROWS, height - row);
+		Dimension rowBelow = row + rows;
+
+		HeightMap::convertHeightMapIntoDuDvBumpMapColor<false>(
+			width, rows,
+			inputPointer + (size_t)row * width, getStride(width),
+			(M4Image::Color16*)outputPointer + (size_t)row * width, getDuDvBumpMapStride(width),
+			rowBelow < height ? inputPointer + (size_t)rowBelow * width : nullptr
+		);
+	});
+}
+
+// nanoseconds per pixel for each kernel
+static double getPixelNanoseconds(bool duDv) {
+	static constexpr Dimension WIDTH = 1024;
+	static constexpr Dimension HEIGHT = 1024;
+
+	std::vector<M4Image::Color32> input((size_t)WIDTH * HEIGHT);
+	std::vector<M4Image::Color32> output(input.size());
+	Bench::fill((unsigned char*)input.data(), input.size() * sizeof(M4Image::Color32));
+
+	double milliseconds = Bench::time([&] {
+		if (duDv) {
+			convert(WIDTH, HEIGHT, input.data(), output.data());
+		} else {
+			HeightMap::convertHeightMapIntoNormalMapColor(
+				WIDTH, HEIGHT,
+				input.data(), getStride(WIDTH),
+				output.data(), getStride(WIDTH),
+				2.5
+			);
+		}
+	});
+	return milliseconds * 1000000.0 / ((size_t)WIDTH * HEIGHT);
+}
+
+// microseconds to run a job with nothing to do, with the workers asleep beforehand (as they are between conversions)
+// this is the most the workers can cost, if they then do none of the work
+static double getRunMicroseconds(Workers &workers, size_t parts) {
+	static constexpr int RUNS = 200;
+
+	double milliseconds = 0.0;
+
+	for (int run = 0; run < RUNS; run++) {
+		// give the workers time to go back to sleep
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		milliseconds += Bench::time([&] {
+			workers.run(parts, [](size_t part) {});
+		}, 1);
+	}
+	return milliseconds * 1000.0 / RUNS;
+}
+
+int main(int argc, char** argv) {
+	static constexpr size_t THREADS_MAX = 16;
+	static constexpr size_t IMAGE_PIXELS = 1024 * 1024;
+
+	const size_t HARDWARE_CONCURRENCY = std::thread::hardware_concurrency();
+
+	printf("SIMD level: %s, hardware concurrency: %zu\n", Bench::getLevelName(), HARDWARE_CONCURRENCY);
+
+	const double NORMAL_MAP_PIXEL_NANOSECONDS = getPixelNanoseconds(false);
+	const double DUDV_BUMP_MAP_PIXEL_NANOSECONDS = getPixelNanoseconds(true);
+
+	printf(
+		"kernels: normal map %.3f ns per pixel, DuDv bump map %.3f ns per pixel\n",
+		NORMAL_MAP_PIXEL_NANOSECONDS, DUDV_BUMP_MAP_PIXEL_NANOSECONDS
+	);
+
+	const double PIXEL_NANOSECONDS = __min(NORMAL_MAP_PIXEL_NANOSECONDS, DUDV_BUMP_MAP_PIXEL_NANOSECONDS);
+
+	double firstRunMicroseconds = 0.0;
+	double lastRunMicroseconds = 0.0;
+
+	for (size_t threads = 1; threads <= THREADS_MAX; threads *= 2) {
+		Workers workers(threads);
+
+		const size_t PARTS = threads + 1;
+		const double RUN_MICROSECONDS = getRunMicroseconds(workers, PARTS);
+
+		if (threads == 1) {
+			firstRunMicroseconds = RUN_MICROSECONDS;
+		}
+
+		lastRunMicroseconds = RUN_MICROSECONDS;
+
+		// splitting into parts on as many cores saves (1 - 1 / parts) of the time, which has to be more than this costs
+		const double CROSSOVER_PIXELS = RUN_MICROSECONDS * 1000.0 / (PIXEL_NANOSECONDS * (1.0 - 1.0 / PARTS));
+
+		printf(
+			"%2zu workers: %.1f us per run of %zu parts, break even at %.0f pixels (%.0f per part)\n",
+			threads, RUN_MICROSECONDS, PARTS, CROSSOVER_PIXELS, CROSSOVER_PIXELS / PARTS
+		);
+	}
+
+	// every worker adds about this much to a run (they're all woken up, whether there's a part for them or not)
+	// and the part it takes saves less and less: going from n - 1 to n parts saves 1 / (n * (n - 1)) of the time
+	const double WORKER_MICROSECONDS = (lastRunMicroseconds - firstRunMicroseconds) / (THREADS_MAX - 1);
+	const double IMAGE_MICROSECONDS = IMAGE_PIXELS * PIXEL_NANOSECONDS / 1000.0;
+
+	size_t parts = 2;
+
+	while (IMAGE_MICROSECONDS / (double)((parts + 1) * parts) >= WORKER_MICROSECONDS) {
+		parts++;
+	}
+
+	printf(
+		"each worker costs %.1f us, so a 1024x1024 DuDv bump map is worth splitting into at most %zu parts\n",
+		WORKER_MICROSECONDS, parts
+	);
+
+	// only the workers there are parts for should be woken up, so this should cost about the same as one worker
+	{
+		Workers workers(THREADS_MAX);
+		printf("%2zu workers: %.1f us per run of 2 parts\n", THREADS_MAX, getRunMicroseconds(workers, 2));
+	}
+
+	if (HARDWARE_CONCURRENCY <= 1) {
+		printf("only one core, so the bands can't be timed against one thread\n");
+		return 0;
+	}
+
+	// the measured crossover: square images, one thread against a band per core
+	Workers workers(HARDWARE_CONCURRENCY - 1);
+
+	for (Dimension size = 64; size <= 2048; size *= 2) {
+		std::vector<M4Image::Color32> input((size_t)size * size);
+		std::vector<M4Image::Color32> output(input.size());
+		Bench::fill((unsigned char*)input.data(), input.size() * sizeof(M4Image::Color32));
+
+		double milliseconds = Bench::time([&] {
+			convert(size, size, input.data(), output.data());
+		});
+
+		double bandsMilliseconds = Bench::time([&] {
+			convertBands(workers, (Dimension)HARDWARE_CONCURRENCY, size, size, input.data(), output.data());
+		});
+
+		printf(
+			"%4lux%-4lu one thread %.3f ms, %zu bands %.3f ms (%.2fx)\n",
+			size, size, milliseconds, HARDWARE_CONCURRENCY, bandsMilliseconds, milliseconds / bandsMilliseconds
+		);
+	}
+	return 0;
+}
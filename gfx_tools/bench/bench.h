@@ -0,0 +1,93 @@
+#pragma once
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include "../SIMD.h"
+
+// the benchmarks and tests in this folder aren't part of the solution
+// they are built by hand (the command is at the top of each one) with this header force included
+// so that they can also be built with GCC or Clang, which is how the numbers in the commit log were taken
+// they are built once per SIMD level by defining SIMD_LEVEL (see SIMD.h) to compare the kernels
+#ifndef _MSC_VER
+// the parts of MSVC that libzap.h, M4Image.h and the gfx_tools sources expect
+#include <strings.h>
+
+#define _stricmp strcasecmp
+#define _wcsicmp wcscasecmp
+#define __cdecl
+#define _cdecl
+#define __int64 long long
+#define __min(a, b) (((a) < (b)) ? (a) : (b))
+#define __max(a, b) (((a) > (b)) ? (a) : (b))
+
+inline size_t strnlen_s(const char* str, size_t sizeMax) {
+	return str ? strnlen(str, sizeMax) : 0;
+}
+
+inline size_t wcsnlen_s(const wchar_t* str, size_t sizeMax) {
+	return str ? wcsnlen(str, sizeMax) : 0;
+}
+
+inline void* _aligned_malloc(size_t size, size_t alignment) {
+	return aligned_alloc(alignment, ((size + alignment - 1) / alignment) * alignment);
+}
+
+inline void _aligned_free(void* block) {
+	free(block);
+}
+
+inline void* _aligned_realloc(void* block, size_t size, size_t alignment) {
+	return realloc(block, size);
+}
+#endif
+
+namespace Bench {
+	inline const char* getLevelName(SIMD::Level level = SIMD::LEVEL) {
+		switch (level) {
+			case SIMD::Level::SSE41:
+			return "SSE4.1";
+			case SIMD::Level::AVX2:
+			return "AVX2";
+			case SIMD::Level::NEON:
+			return "NEON";
+			default:
+			break;
+		}
+		return "none";
+	}
+
+	// the same input every time, so runs can be compared
+	inline void fill(unsigned char* pointer, size_t size, uint32_t seed = 1) {
+		for (size_t i = 0; i < size; i++) {
+			seed = seed * 1664525 + 1013904223;
+			pointer[i] = (unsigned char)(seed >> 24);
+		}
+	}
+
+	// runs the function a few times and returns the fastest run, in milliseconds
+	// (the fastest run is the one least disturbed by everything else on the machine)
+	template <typename Function> double time(Function function, int runs = 5) {
+		double fastest = 0.0;
+
+		for (int run = 0; run < runs; run++) {
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			function();
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+			if (!run || milliseconds < fastest) {
+				fastest = milliseconds;
+			}
+		}
+		return fastest;
+	}
+
+	// megapixels per second, given how many pixels were done in how long
+	inline double rate(size_t pixels, double milliseconds) {
+		return milliseconds > 0.0 ? pixels / milliseconds / 1000.0 : 0.0;
+	}
+}
@@ -2,150 +2,200 @@
 #include "main.h"
 #include "base.h"
 #include "Validate.h"
+#include "HeightMap.h"
+#include "Workers.h"
+#include "DecodeCache.h"
+#include "Pool.h"
 #include <math.h>
+#include <new>
+#include <string>
 #include <M4Image.h>
 
 namespace gfx_tools {
-	template<bool luminance>
-	void convertHeightMapIntoDuDvBumpMapColor(
-		Dimension width, Dimension height,
-		M4Image::Color32* inputPointer, Stride inputStride,
-		M4Image::Color16* outputPointer, Stride outputStride
-	) {
-		static constexpr size_t INPUT_CHANNEL_UV = 0;
-		static constexpr size_t INPUT_CHANNEL_LUMINANCE = 3;
-
-		static constexpr size_t OUTPUT_CHANNEL_DU = 0;
-		static constexpr size_t OUTPUT_CHANNEL_DV = 1;
-		static constexpr size_t OUTPUT_CHANNEL_LUMINANCE = 2;
-
-		M4Image::Color32* endPointer = (M4Image::Color32*)((unsigned char*)inputPointer + ((size_t)height * (size_t)inputStride) - inputStride);
-		M4Image::Color32* rowPointer = nullptr;
-
-		M4Image::Color32* inputColorPointer = nullptr;
-		M4Image::Color32* inputUColorPointer = nullptr;
-		M4Image::Color32* inputVColorPointer = nullptr;
+	using RefCount = unsigned long;
 
-		M4Image::Color16* outputColorPointer = nullptr;
+	static RefCount refCount = 0;
+	static bool initialized = false;
 
-		while (inputPointer <= endPointer) {
-			rowPointer = inputPointer + width - 1;
+	// the workers are only started the first time a conversion is big enough to need them
+	// and are stopped again when the last Shutdown happens
+	// (this mutex also protects refCount, because conversions may happen on any thread)
+	static std::mutex workersMutex = {};
 
-			// inputVColorPointer should point to the pixel one row below
-			inputColorPointer = inputPointer;
-			inputUColorPointer = inputPointer;
-			inputVColorPointer = (inputPointer == endPointer) ? inputPointer : (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
+	// this is deliberately never destroyed: if Shutdown is never called, destroying it would join
+	// the workers from a static destructor, under the loader lock, which deadlocks
+	// so in that case, they're left running and the process cleans them up when it exits
+	alignas(Workers::Pointer) static unsigned char workersPointerStorage[sizeof(Workers::Pointer)] = {};
+	static Workers::Pointer &workersPointer = *new (workersPointerStorage) Workers::Pointer();
 
-			outputColorPointer = outputPointer;
+	Workers::Pointer getWorkers() {
+		// past about ten parts, a 1024x1024 DuDv bump map (the cheapest kernel) saves less per part
+		// than it costs to wake up another worker (see bench/WorkersBench.cpp)
+		static constexpr size_t THREADS_MAX = 9;
 
-			while (inputColorPointer <= rowPointer) {
-				// inputUColorPointer should point to the pixel one column right
-				if (inputUColorPointer != rowPointer) {
-					inputUColorPointer++;
-				}
+		std::lock_guard<std::mutex> lock(workersMutex);
 
-				M4Image::Color32 &inputColor = *inputColorPointer;
-				M4Image::Color16 &outputColor = *outputColorPointer;
+		if (!refCount) {
+			return nullptr;
+		}
 
-				// DU is done last so input and output buffer may be the same
-				outputColor.channels[OUTPUT_CHANNEL_DV] = (unsigned char)(inputColor.channels[INPUT_CHANNEL_UV]
-					- inputVColorPointer++->channels[INPUT_CHANNEL_UV]);
+		if (!workersPointer) {
+			// the thread doing the conversion counts as one of them
+			size_t threads = std::thread::hardware_concurrency();
 
-				outputColor.channels[OUTPUT_CHANNEL_DU] = (unsigned char)(inputColor.channels[INPUT_CHANNEL_UV]
-					- inputUColorPointer->channels[INPUT_CHANNEL_UV]);
+			if (threads <= 1) {
+				return nullptr;
+			}
 
-				if constexpr (luminance) {
-					((M4Image::Color32*)outputColorPointer)->channels[OUTPUT_CHANNEL_LUMINANCE] =
-						inputColorPointer->channels[INPUT_CHANNEL_LUMINANCE];
-					
-					outputColorPointer = (M4Image::Color16*)((M4Image::Color32*)outputColorPointer + 1);
-				} else {
-					outputColorPointer++;
-				}
+			#ifdef _WIN32
+			// the worker threads run code in this DLL, so it must never be unloaded while they're running
+			// (it's simplest to just never unload it, once there have been workers)
+			HMODULE module = NULL;
 
-				inputColorPointer++;
+			if (!GetModuleHandleExA(
+				GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+				(LPCSTR)getWorkers, &module
+			)) {
+				return nullptr;
 			}
+			#endif
 
-			inputPointer = (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
-			outputPointer = (M4Image::Color16*)((unsigned char*)outputPointer + outputStride);
+			workersPointer = std::make_shared<Workers>(__min(threads - 1, THREADS_MAX));
 		}
+		return workersPointer;
 	}
 
-	void convertHeightMapIntoNormalMapColor(
+	using ConvertBand = std::function<void(Dimension row, Dimension rows, const M4Image::Color32* lastInputYPointer)>;
+
+	// large images are split into bands of rows, which are converted at the same time
+	// convertBand is called with the first row of each band, its number of rows, and the row below it (or null at the bottom)
+	static void convertBands(
 		Dimension width, Dimension height,
-		M4Image::Color32* inputPointer, Stride inputStride,
-		M4Image::Color32* outputPointer, Stride outputStride,
-		double strength
+		const unsigned char* inputPointer, Stride inputStride,
+		const unsigned char* outputPointer, Stride outputStride,
+		const ConvertBand &convertBand
 	) {
-		static constexpr size_t INPUT_CHANNEL_XY = 0;
+		// every band has at least this many pixels, so an image needs twice this to be split at all
+		// handing out two parts broke even somewhere between 40000 and 110000 pixels of the cheapest kernel
+		// and each part after that at about 10000 to 30000 (see bench/WorkersBench.cpp)
+		static constexpr size_t BAND_PIXELS_MIN = 0x10000;
+
+		MAKE_SCOPE_EXIT(convertScopeExit) {
+			convertBand(0, height, nullptr);
+		};
+
+		const size_t PIXELS = (size_t)width * (size_t)height;
 
-		static constexpr size_t OUTPUT_CHANNEL_B = 0;
-		static constexpr size_t OUTPUT_CHANNEL_G = 1;
-		static constexpr size_t OUTPUT_CHANNEL_R = 2;
-		static constexpr size_t OUTPUT_CHANNEL_A = 3;
+		if (PIXELS < BAND_PIXELS_MIN * 2) {
+			return;
+		}
+
+		// if the output overlaps the input, the only case handled is converting in place
+		// in which case the band below will overwrite the row each band needs from it, so those are copied first
+		const unsigned char* inputEndPointer = inputPointer + (size_t)height * (size_t)inputStride;
+		const unsigned char* outputEndPointer = outputPointer + (size_t)height * (size_t)outputStride;
+		bool inPlace = outputPointer < inputEndPointer && inputPointer < outputEndPointer;
+
+		if (inPlace && (outputPointer != inputPointer || outputStride != inputStride)) {
+			return;
+		}
 
-		static constexpr double MULTIPLIER = 127.0;
-		static constexpr unsigned char BGR_GRAY = 128;
-		static constexpr unsigned char ALPHA_OPAQUE = 255;
+		Workers::Pointer workersPointer = getWorkers();
+
+		if (!workersPointer) {
+			return;
+		}
 
-		M4Image::Color32* endPointer = (M4Image::Color32*)((unsigned char*)inputPointer + ((size_t)height * (size_t)inputStride) - inputStride);
-		M4Image::Color32* rowPointer = nullptr;
+		Dimension bands = (Dimension)__min(workersPointer->getThreads() + 1, __min(PIXELS / BAND_PIXELS_MIN, (size_t)height));
 
-		M4Image::Color32* inputColorPointer = nullptr;
-		M4Image::Color32* inputXColorPointer = nullptr;
-		M4Image::Color32* inputYColorPointer = nullptr;
+		if (bands < 2) {
+			return;
+		}
 
-		M4Image::Color32* outputColorPointer = nullptr;
+		const Dimension BAND_ROWS = (height + bands - 1) / bands;
+		bands = (height + BAND_ROWS - 1) / BAND_ROWS;
 
-		double x = 0.0;
-		double y = 0.0;
-		double z = 0.0;
+		const size_t ROW_SIZE = (size_t)width * sizeof(M4Image::Color32);
 
-		while (inputPointer <= endPointer) {
-			rowPointer = inputPointer + width - 1;
+		std::unique_ptr<unsigned char[]> rowsPointer = nullptr;
 
-			// inputYColorPointer should point to the pixel one row below
-			inputColorPointer = inputPointer;
-			inputXColorPointer = inputPointer;
-			inputYColorPointer = (inputPointer == endPointer) ? inputPointer : (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
-			
-			outputColorPointer = outputPointer;
+		if (inPlace) {
+			rowsPointer = std::unique_ptr<unsigned char[]>(new unsigned char[ROW_SIZE * (bands - 1)]);
 
-			while (inputColorPointer <= rowPointer) {
-				// inputXColorPointer should point to the pixel one column right
-				if (inputXColorPointer != rowPointer) {
-					inputXColorPointer++;
-				}
+			for (Dimension band = 1; band < bands; band++) {
+				memcpy(rowsPointer.get() + ROW_SIZE * (band - 1), inputPointer + (size_t)(band * BAND_ROWS) * (size_t)inputStride, ROW_SIZE);
+			}
+		}
 
-				M4Image::Color32 &inputColor = *inputColorPointer;
-				M4Image::Color32 &outputColor = *outputColorPointer;
+		convertScopeExit.dismiss();
 
-				// these specifically need to be signed, we want them to either be negative or positive
-				// (but we only cast to signed char after doing the subtraction, as it's entirely expected this could underflow)
-				x = strength * (inputXColorPointer->channels[INPUT_CHANNEL_XY] - inputColor.channels[INPUT_CHANNEL_XY]);
-				y = strength * (inputYColorPointer++->channels[INPUT_CHANNEL_XY] - inputColor.channels[INPUT_CHANNEL_XY]);
-				z = 1.0 / sqrt(x * x + y * y + 1.0) * MULTIPLIER;
+		workersPointer->run(bands, [&](size_t band) {
+			Dimension row = (Dimension)band * BAND_ROWS;
+			Dimension rows = __min(BAND_ROWS, height - row);
+			Dimension rowBelow = row + rows;
 
-				outputColor.channels[OUTPUT_CHANNEL_B] = (unsigned char)(BGR_GRAY + (unsigned char)z);
-				outputColor.channels[OUTPUT_CHANNEL_G] = (unsigned char)(BGR_GRAY - (unsigned char)(y * z));
-				outputColor.channels[OUTPUT_CHANNEL_R] = (unsigned char)(BGR_GRAY - (unsigned char)(x * z));
-				outputColor.channels[OUTPUT_CHANNEL_A] = ALPHA_OPAQUE;
+			const M4Image::Color32* lastInputYPointer = nullptr;
 
-				outputColorPointer++;
-				inputColorPointer++;
+			if (rowBelow < height) {
+				lastInputYPointer = inPlace
+					? (const M4Image::Color32*)(rowsPointer.get() + ROW_SIZE * band)
+					: (const M4Image::Color32*)(inputPointer + (size_t)rowBelow * (size_t)inputStride);
 			}
 
-			inputPointer = (M4Image::Color32*)((unsigned char*)inputPointer + inputStride);
-			outputPointer = (M4Image::Color32*)((unsigned char*)outputPointer + outputStride);
-		}
+			convertBand(row, rows, lastInputYPointer);
+		});
 	}
 
-	using RefCount = unsigned long;
+	// written to the debugger, and if the GFX_TOOLS_LOG environment variable is set, appended to the file it names
+	// (so that the decode cache's budget can be judged from a normal run of the game, without a debugger)
+	static void logStatistics() {
+		#ifdef _WIN32
+		const DecodeCache::Statistics STATISTICS = DecodeCache::get().getStatistics();
 
-	static RefCount refCount = 0;
-	static bool initialized = false;
+		std::string statistics = "gfx_tools decode cache: "
+			+ std::to_string(STATISTICS.hits) + " hits, "
+			+ std::to_string(STATISTICS.misses) + " misses, "
+			+ std::to_string(STATISTICS.evictions) + " evictions, "
+			+ std::to_string(STATISTICS.entries) + " entries ("
+			+ std::to_string(STATISTICS.size) + " of " + std::to_string(STATISTICS.capacity) + " bytes)\n";
+
+		const Pool::Statistics POOL_STATISTICS = Pool::get().getStatistics();
+
+		statistics += "gfx_tools pool: "
+			+ std::to_string(POOL_STATISTICS.hits) + " hits, "
+			+ std::to_string(POOL_STATISTICS.misses) + " misses, "
+			+ std::to_string(POOL_STATISTICS.releases) + " releases ("
+			+ std::to_string(POOL_STATISTICS.usedSize) + " bytes used, "
+			+ std::to_string(POOL_STATISTICS.cachedSize) + " bytes cached)\n";
+
+		OutputDebugStringA(statistics.c_str());
+
+		char path[MAX_PATH] = "";
+		DWORD pathSize = GetEnvironmentVariableA("GFX_TOOLS_LOG", path, MAX_PATH);
+
+		if (!pathSize || pathSize >= MAX_PATH) {
+			return;
+		}
+
+		HANDLE file = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (file == INVALID_HANDLE_VALUE) {
+			return;
+		}
+
+		SCOPE_EXIT {
+			CloseHandle(file);
+		};
+
+		// it's only statistics, so if this fails there's nothing worth doing about it
+		DWORD numberOfBytesWritten = 0;
+		WriteFile(file, statistics.c_str(), (DWORD)statistics.size(), &numberOfBytesWritten, NULL);
+		#endif
+	}
 
 	void Init() {
+		std::lock_guard<std::mutex> lock(workersMutex);
+
 		if (refCount++) {
 			return;
 		}
@@ -162,8 +212,26 @@ namespace gfx_tools {
 	}
 
 	void Shutdown() {
+		// if this is the last one, the workers are stopped after the lock is released
+		// (unless a conversion is still using them, then it stops them when it's done)
+		Workers::Pointer releasedWorkersPointer = nullptr;
+
+		std::lock_guard<std::mutex> lock(workersMutex);
+
 		if (refCount) {
 			refCount--;
+
+			if (!refCount) {
+				releasedWorkersPointer = std::move(workersPointer);
+
+				logStatistics();
+
+				// the decoded images aren't needed anymore if nothing is using us
+				DecodeCache::get().clear();
+
+				// same for any buffers the pool is holding onto
+				Pool::get().clear();
+			}
 		}
 	}
 
@@ -178,19 +246,32 @@ namespace gfx_tools {
 			return;
 		}
 
-		if (luminance) {
-			convertHeightMapIntoDuDvBumpMapColor<true>(
-				width, height,
-				(M4Image::Color32*)inputPointer, inputStride,
-				(M4Image::Color16*)outputPointer, outputStride
-			);
-		} else {
-			convertHeightMapIntoDuDvBumpMapColor<false>(
-				width, height,
-				(M4Image::Color32*)inputPointer, inputStride,
-				(M4Image::Color16*)outputPointer, outputStride
-			);
-		}
+		convertBands(
+			width, height,
+			inputPointer, inputStride,
+			outputPointer, outputStride,
+
+			[&](Dimension row, Dimension rows, const M4Image::Color32* lastInputVPointer) {
+				M4Image::Color32* bandInputPointer = (M4Image::Color32*)(inputPointer + (size_t)row * (size_t)inputStride);
+				M4Image::Color16* bandOutputPointer = (M4Image::Color16*)(outputPointer + (size_t)row * (size_t)outputStride);
+
+				if (luminance) {
+					HeightMap::convertHeightMapIntoDuDvBumpMapColor<true>(
+						width, rows,
+						bandInputPointer, inputStride,
+						bandOutputPointer, outputStride,
+						lastInputVPointer
+					);
+				} else {
+					HeightMap::convertHeightMapIntoDuDvBumpMapColor<false>(
+						width, rows,
+						bandInputPointer, inputStride,
+						bandOutputPointer, outputStride,
+						lastInputVPointer
+					);
+				}
+			}
+		);
 	}
 
 	void ConvertHeightMapIntoNormalMap(
@@ -199,11 +280,20 @@ namespace gfx_tools {
 		unsigned char* outputPointer, EnumPixelFormat outputEnumPixelFormat, Stride outputStride,
 		float strength
 	) {
-		convertHeightMapIntoNormalMapColor(
+		convertBands(
 			width, height,
-			(M4Image::Color32*)inputPointer, inputStride,
-			(M4Image::Color32*)outputPointer, outputStride,
-			strength
+			inputPointer, inputStride,
+			outputPointer, outputStride,
+
+			[&](Dimension row, Dimension rows, const M4Image::Color32* lastInputYPointer) {
+				HeightMap::convertHeightMapIntoNormalMapColor(
+					width, rows,
+					(M4Image::Color32*)(inputPointer + (size_t)row * (size_t)inputStride), inputStride,
+					(M4Image::Color32*)(outputPointer + (size_t)row * (size_t)outputStride), outputStride,
+					strength,
+					lastInputYPointer
+				);
+			}
 		);
 	}
 };